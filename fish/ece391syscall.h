@@ -5,6 +5,12 @@
 
 /* All calls return >= 0 on success or -1 on failure. */
 
+/*
+ * 1 while the wrappers enter the kernel with SYSENTER, 0 for INT $0x80,
+ * -1 until the first call checked the CPU. May be set to 0.
+ */
+extern int32_t ece391_sysenter;
+
 /*  
  * Note that the system call for halt will have to make sure that only
  * the low byte of EBX (the status argument) is returned to the calling
@@ -20,5 +26,156 @@ extern int32_t ece391_close (int32_t fd);
 extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 
+/*
+ * Scheduling controls. A pid of -1 means the calling program. Priority 0
+ * is the highest, 7 the lowest, 4 the default. A timeslice of 0 ms goes
+ * back to the default for the priority. Programs executed afterwards
+ * inherit both settings.
+ */
+extern int32_t ece391_setpriority (int32_t pid, int32_t prio);
+extern int32_t ece391_getpriority (int32_t pid);
+extern int32_t ece391_set_timeslice (int32_t pid, int32_t ms);
+
+/*
+ * Real-time classes, they run before SCHED_NORMAL programs and preempt
+ * them when an RTC read returns, for up to 950 ms of every second per
+ * CPU. For SCHED_RR the parameter is a fixed priority (0 highest to 7).
+ * For SCHED_EDF it is a relative deadline in ms, 0 meaning the period
+ * of the program's RTC reads. A period counts as missed when the next
+ * RTC read comes after its deadline. Only the caller (pid -1 or its own)
+ * and its children can be moved.
+ */
+enum sched_policies {
+	SCHED_NORMAL = 0,
+	SCHED_RR,
+	SCHED_EDF
+};
+
+extern int32_t ece391_set_scheduler (int32_t pid, int32_t policy, int32_t param);
+extern int32_t ece391_get_scheduler (int32_t pid);
+extern int32_t ece391_deadline_misses (int32_t pid);
+
+/*
+ * Kernel lock contention, one "name acquired contended spin" line per
+ * lock. Spin time is in units of 1024 CPU cycles.
+ */
+extern int32_t ece391_lock_stat (uint8_t* buf, int32_t nbytes);
+
+/*
+ * Interrupts-off profile: a header line naming the histogram buckets,
+ * then one "file:line count max buckets..." line per place in the kernel
+ * that turned interrupts off. Times are in CPU cycles. Only the header
+ * unless the kernel was built with IRQSOFF_PROFILE.
+ */
+extern int32_t ece391_irqsoff_stat (uint8_t* buf, int32_t nbytes);
+
+/*
+ * Scheduler statistics: a header line, one "pid cpu state class prio ticks
+ * name" line per process or kernel thread, then the idle and busy ticks.
+ */
+extern int32_t ece391_sched_stat (uint8_t* buf, int32_t nbytes);
+
+/*
+ * Shared submission / completion rings. Fill sq[sq_tail % IORING_ENTRIES],
+ * advance sq_tail, then io_enter runs every queued entry in order and
+ * appends one completion each, res being what the system call returns.
+ * Completions are read from cq_head up to cq_tail. With IORING_SQPOLL
+ * the kernel also drains the ring on timer ticks, up to the first
+ * terminal or RTC read; those could sleep and wait for io_enter.
+ */
+#define IORING_ENTRIES	64
+#define IORING_SQPOLL	0x1
+
+#define IORING_OP_NOP	0
+#define IORING_OP_READ	1
+#define IORING_OP_WRITE	2
+#define IORING_OP_OPEN	3
+#define IORING_OP_CLOSE	4
+
+typedef struct io_sqe {
+	uint32_t opcode;
+	int32_t fd;
+	uint32_t addr;		/* buffer, or file name for IORING_OP_OPEN */
+	int32_t len;
+	uint32_t user_data;	/* copied to the completion */
+} io_sqe_t;
+
+typedef struct io_cqe {
+	uint32_t user_data;
+	int32_t res;
+} io_cqe_t;
+
+typedef struct io_ring {
+	volatile uint32_t sq_head;	/* kernel */
+	volatile uint32_t sq_tail;	/* program */
+	volatile uint32_t cq_head;	/* program */
+	volatile uint32_t cq_tail;	/* kernel */
+	uint32_t flags;
+	uint32_t submitted;
+	io_sqe_t sq[IORING_ENTRIES];
+	io_cqe_t cq[IORING_ENTRIES];
+} io_ring_t;
+
+/* Registers (and empties) the rings, NULL drops them. */
+extern int32_t ece391_io_setup (io_ring_t* ring, uint32_t flags);
+
+/* Runs up to to_submit queued entries, returns how many it took. */
+extern int32_t ece391_io_enter (uint32_t to_submit);
+
+/*
+ * Monotonic clock from the calibrated TSC, nanosecond resolution. The
+ * only clock is CLOCK_MONOTONIC, time since boot.
+ */
+#define CLOCK_MONOTONIC	1
+
+typedef struct timespec {
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+} timespec_t;
+
+extern int32_t ece391_clock_gettime (int32_t clock_id, timespec_t* ts);
+
+/*
+ * Blocking sleeps on a kernel timer, rounded up to the 10 ms scheduler
+ * tick. Nothing interrupts a sleep, nanosleep always zeroes rem.
+ */
+extern int32_t ece391_sleep (uint32_t ms);
+extern int32_t ece391_nanosleep (const timespec_t* req, timespec_t* rem);
+
+/*
+ * Makes terminal and RTC reads of fd return -1 after ms milliseconds
+ * without input. 0 waits forever again.
+ */
+extern int32_t ece391_read_timeout (int32_t fd, int32_t ms);
+
+/*
+ * OR'ed into the frequency written to an RTC fd: each read then puts
+ * the number of RTC ticks since the previous read in a uint32_t and
+ * returns 4. It only waits when no tick was missed, so a late program
+ * catches up with one read.
+ */
+#define RTC_COALESCE	0x10000
+
+/*
+ * Sampling profiler. prof_ctl starts sampling every CPU hz (1 to 100)
+ * times a second, dropping old samples, 0 stops. prof_dump moves
+ * samples out as "cpu pid cs eip name" lines, CS and EIP in hex, and
+ * returns 0 once there are none left. A NULL buf sends them all to
+ * COM1 instead. profsym.py symbolizes either output.
+ */
+extern int32_t ece391_prof_ctl (int32_t hz);
+extern int32_t ece391_prof_dump (uint8_t* buf, int32_t nbytes);
+
+/*
+ * Tracepoints. trace_ctl(1) starts recording system calls, context
+ * switches, IRQs, page faults, execute and halt on every CPU, dropping
+ * old records, 0 stops. trace_dump moves 20 byte binary records out,
+ * a header record first, and returns 0 once there are none left. A
+ * NULL buf sends them all to COM1 instead. trace2json.py turns them
+ * into Chrome/Perfetto trace JSON.
+ */
+extern int32_t ece391_trace_ctl (int32_t on);
+extern int32_t ece391_trace_dump (uint8_t* buf, int32_t nbytes);
+
 #endif /* ECE391SYSCALL_H */
 
@@ -11,5 +11,24 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_SETPRIORITY  11
+#define SYS_GETPRIORITY  12
+#define SYS_SET_TIMESLICE  13
+#define SYS_SET_SCHEDULER  14
+#define SYS_GET_SCHEDULER  15
+#define SYS_DEADLINE_MISSES  16
+#define SYS_LOCK_STAT  17
+#define SYS_IRQSOFF_STAT  18
+#define SYS_SCHED_STAT  19
+#define SYS_IO_SETUP  20
+#define SYS_IO_ENTER  21
+#define SYS_CLOCK_GETTIME  22
+#define SYS_SLEEP  23
+#define SYS_NANOSLEEP  24
+#define SYS_READ_TIMEOUT  25
+#define SYS_PROF_CTL  26
+#define SYS_PROF_DUMP  27
+#define SYS_TRACE_CTL  28
+#define SYS_TRACE_DUMP  29
 
 #endif /* ECE391SYSNUM_H */
@@ -18,11 +18,13 @@ uint8_t file1[] = "frame1.txt";
 extern int mp1_ioctl(unsigned long arg, unsigned long cmd);
 extern void mp1_rtc_tasklet(unsigned long trash);
 
+static int32_t rtc_frames(int32_t rtc_fd);
+
 static struct mp1_blink_struct blink_array[80*25];
 
 int main(void)
 {
-    int rtc_fd, ret_val, i, garbage;
+    int rtc_fd, ret_val, i;
     struct mp1_blink_struct blink_struct;
 
     ece391_memset(blink_array, 0, sizeof(struct mp1_blink_struct)*80*25);
@@ -35,12 +37,14 @@ int main(void)
 
     add_frames(file0, file1, rtc_fd);
 
-    ret_val = 32;
+    ret_val = 32 | RTC_COALESCE;
     ret_val = ece391_write(rtc_fd, &ret_val, 4);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
+    /* Each frame is due by the next RTC tick */
+    ece391_set_scheduler(-1, SCHED_EDF, 0);
+
+    for(i=0; i<WAIT; ) {
+        i += rtc_frames(rtc_fd);
     }
 
     blink_struct.on_char = 'I';
@@ -51,23 +55,20 @@ int main(void)
 
     mp1_ioctl((unsigned long)&blink_struct, RTC_ADD);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
+    for(i=0; i<WAIT; ) {
+        i += rtc_frames(rtc_fd);
     }
 
     mp1_ioctl((40 << 16 | (6*80+60)), RTC_SYNC);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
+    for(i=0; i<WAIT; ) {
+        i += rtc_frames(rtc_fd);
     }
 
     mp1_ioctl(6*80+60, RTC_REMOVE);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
+    for(i=0; i<WAIT; ) {
+        i += rtc_frames(rtc_fd);
     }
 
     ece391_close(rtc_fd);
@@ -75,6 +76,23 @@ int main(void)
     return 0;
 }
 
+/*
+ * Waits for the next RTC tick and advances the animation once for every
+ * tick since the last call, so frames dropped while descheduled are made
+ * up for with one read. Returns the number of ticks.
+ */
+static int32_t
+rtc_frames(int32_t rtc_fd)
+{
+    uint32_t ticks, n;
+
+    if (ece391_read(rtc_fd, &ticks, 4) != 4)
+        ticks = 1;
+    for (n = 0; n < ticks; n++)
+        mp1_rtc_tasklet(0);
+    return ticks;
+}
+
 void
 add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 {
@@ -0,0 +1,284 @@
+/* apic.c - Functions to interact with the local APIC of each processor
+ * vim:ts=4 noexpandtab
+ */
+
+#include "apic.h"
+#include "lib.h"
+#include "paging.h"
+#include "scheduling.h"
+#include "smp.h"
+
+/* Register block, NULL until lapic_map */
+static volatile uint32_t* lapic = NULL;
+
+/* Timer counts (divide by 16) per scheduler tick, measured on the boot CPU */
+static uint32_t lapic_timer_count = 0;
+
+/* Timer counts per PIT input clock, 8.8 fixed point, for CPU 0's one-shot */
+static uint32_t lapic_per_cycle = 0;
+
+/*
+ * lapic_read / lapic_write
+ *   DESCRIPTION: Access a 32-bit local APIC register
+ *   INPUTS: reg -- register offset (LAPIC_*)
+ *           val -- value to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: register value (lapic_read)
+ *   SIDE EFFECTS: writes may send an IPI or start the timer
+ */
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg >> 2];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg >> 2] = val;
+}
+
+/*
+ * lapic_present
+ *   DESCRIPTION: Checks CPUID for an on-chip local APIC
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if present, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int lapic_present(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile ("cpuid"
+            : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+            : "a" (1)
+    );
+    return (edx & 0x200) != 0;          // bit 9: APIC on chip
+}
+
+/*
+ * lapic_map
+ *   DESCRIPTION: Maps the local APIC registers uncached into every
+ *                address space
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes the 4 MB page holding LAPIC_BASE
+ */
+void lapic_map(void) {
+    lapic = (volatile uint32_t*) map_mmio_4mb(LAPIC_BASE);
+}
+
+/*
+ * lapic_init
+ *   DESCRIPTION: Software enables the calling CPU's local APIC. The
+ *                boot CPU takes 8259 interrupts through LINT0 (virtual
+ *                wire mode) until irq_init picks the I/O APIC, the
+ *                others only get IPIs, I/O APIC interrupts and their
+ *                own timer
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: timer stays masked until lapic_timer_start
+ */
+void lapic_init(void) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VECTOR);
+    if (smp_processor_id() == 0) {
+        lapic_write(LAPIC_LVT_LINT0, LAPIC_DM_EXTINT);
+        lapic_write(LAPIC_LVT_LINT1, LAPIC_DM_NMI);
+    } else {
+        lapic_write(LAPIC_LVT_LINT0, LAPIC_MASKED);
+        lapic_write(LAPIC_LVT_LINT1, LAPIC_MASKED);
+    }
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED);
+    lapic_write(LAPIC_TPR, 0);          // accept every vector
+    lapic_eoi();
+}
+
+/*
+ * lapic_mask_extint
+ *   DESCRIPTION: Disconnects the 8259s from the boot CPU once the I/O
+ *                APIC delivers device interrupts
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void lapic_mask_extint(void) {
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_MASKED);
+}
+
+/*
+ * lapic_id
+ *   DESCRIPTION: Local APIC ID of the calling CPU
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: ID used as IPI destination
+ *   SIDE EFFECTS: none
+ */
+int lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/*
+ * lapic_eoi
+ *   DESCRIPTION: Ends the local APIC interrupt being serviced (timer,
+ *                IPIs, I/O APIC interrupts). 8259 interrupts use send_eoi
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void lapic_eoi(void) {
+    if (lapic != NULL) {
+        lapic_write(LAPIC_EOI, 0);
+    }
+}
+
+/*
+ * lapic_icr
+ *   DESCRIPTION: Sends an inter-processor interrupt and waits until the
+ *                local APIC accepted it
+ *   INPUTS: apic_id -- destination (ignored with LAPIC_ICR_OTHERS)
+ *           cmd -- low command word: vector, delivery mode, flags
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void lapic_icr(int apic_id, uint32_t cmd) {
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);   // destination field, bits 24-31
+    lapic_write(LAPIC_ICR_LO, cmd);
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING) {
+        asm volatile ("pause" : : : "memory");
+    }
+}
+
+/*
+ * lapic_send_ipi / lapic_send_ipi_others
+ *   DESCRIPTION: Raises vector on one CPU / on every other CPU
+ *   INPUTS: apic_id -- destination CPU
+ *           vector -- IDT entry to run there
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void lapic_send_ipi(int apic_id, int vector) {
+    lapic_icr(apic_id, LAPIC_DM_FIXED | vector);
+}
+
+void lapic_send_ipi_others(int vector) {
+    lapic_icr(0, LAPIC_ICR_OTHERS | LAPIC_DM_FIXED | vector);
+}
+
+/*
+ * lapic_send_init
+ *   DESCRIPTION: Resets a CPU into its wait-for-SIPI state
+ *   INPUTS: apic_id -- CPU to reset
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the MP spec asks for 10 ms before the first SIPI
+ */
+void lapic_send_init(int apic_id) {
+    lapic_icr(apic_id, LAPIC_DM_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+    lapic_icr(apic_id, LAPIC_DM_INIT | LAPIC_ICR_LEVEL);
+}
+
+/*
+ * lapic_send_sipi
+ *   DESCRIPTION: Starts a CPU in real mode at page:0
+ *   INPUTS: apic_id -- CPU waiting for SIPI
+ *           page -- 4 kB page number of the startup code, below 1 MB
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void lapic_send_sipi(int apic_id, uint32_t page) {
+    lapic_icr(apic_id, LAPIC_DM_STARTUP | (page & 0xFF));
+}
+
+/*
+ * lapic_timer_calibrate
+ *   DESCRIPTION: Counts local APIC timer decrements over one scheduler
+ *                tick, timed with PIT channel 2
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: busy waits one tick (10 ms)
+ */
+void lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    pit_delay_us(1000000 / PIT_HZ);
+    lapic_timer_count = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);   // stop
+
+    /* A full 16-bit shot times this fits 32 bits up to a ~4.8 GHz bus clock */
+    lapic_per_cycle = (lapic_timer_count << 8) / PIT_TICK_CYCLES;
+    if (lapic_per_cycle == 0) {
+        lapic_per_cycle = 1;
+    }
+}
+
+/*
+ * lapic_timer_start
+ *   DESCRIPTION: Starts the calling CPU's timer at PIT_HZ
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: LAPIC_TIMER_VECTOR fires periodically from now on
+ */
+void lapic_timer_start(void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+}
+
+/*
+ * lapic_timer_oneshot
+ *   DESCRIPTION: Arms a single timer interrupt on the calling CPU, in
+ *                place of a PIT channel 0 one-shot
+ *   INPUTS: pit_cycles -- delay in PIT input clocks, at most PIT_MAX_SHOT
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: replaces any shot already armed
+ */
+void lapic_timer_oneshot(uint32_t pit_cycles) {
+    uint32_t count = (pit_cycles * lapic_per_cycle) >> 8;
+
+    if (count == 0) {
+        count = 1;
+    }
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR);   // one-shot mode
+    lapic_write(LAPIC_TIMER_INIT, count);               // starts counting
+}
+
+/*
+ * lapic_timer_remaining
+ *   DESCRIPTION: Time left in the armed one-shot
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PIT input clocks left, 0 once expired
+ *   SIDE EFFECTS: none
+ */
+uint32_t lapic_timer_remaining(void) {
+    uint32_t count = lapic_read(LAPIC_TIMER_CUR);
+
+    /* count * 256 / lapic_per_cycle without overflowing 32 bits */
+    return (count / lapic_per_cycle) * 256 + ((count % lapic_per_cycle) << 8) / lapic_per_cycle;
+}
+
+/*
+ * lapic_timer_handler
+ *   DESCRIPTION: Scheduler tick of an application processor, or of the
+ *                boot CPU when its local APIC timer replaced the PIT
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may switch tasks
+ */
+void lapic_timer_handler(void) {
+    if (smp_processor_id() == 0) {
+        pit_handler();                  // EOIs through send_eoi(0)
+        return;
+    }
+    lapic_eoi();
+    sched_ap_tick();
+}
@@ -0,0 +1,86 @@
+/* apic.h - Defines used in interactions with the local APIC of each
+ * processor (inter-processor interrupts, per-CPU timer)
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+
+/* Physical address of the local APIC registers, same on every CPU */
+#define LAPIC_BASE          0xFEE00000
+
+/* Register offsets */
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080       // task priority
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0       // spurious interrupt vector
+#define LAPIC_ICR_LO        0x300       // interrupt command, writing it sends the IPI
+#define LAPIC_ICR_HI        0x310       // IPI destination
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_TIMER_INIT    0x380
+#define LAPIC_TIMER_CUR     0x390
+#define LAPIC_TIMER_DIV     0x3E0
+
+/* Register bits */
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_MASKED        0x10000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_DIV_16        0x3
+#define LAPIC_DM_FIXED      0x000       // delivery modes
+#define LAPIC_DM_NMI        0x400
+#define LAPIC_DM_INIT       0x500
+#define LAPIC_DM_STARTUP    0x600
+#define LAPIC_DM_EXTINT     0x700
+#define LAPIC_ICR_PENDING   0x1000      // delivery status
+#define LAPIC_ICR_ASSERT    0x4000
+#define LAPIC_ICR_LEVEL     0x8000
+#define LAPIC_ICR_OTHERS    0xC0000     // all CPUs but the sender
+
+/* Vectors of interrupts raised by the local APICs */
+#define LAPIC_TIMER_VECTOR  0xF0
+#define RESCHED_VECTOR      0xF1        // run queue of the target changed
+#define TLB_FLUSH_VECTOR    0xF2        // shared page table entries changed
+#define SPURIOUS_VECTOR     0xFF
+
+/* CPU has a local APIC (CPUID) */
+int lapic_present(void);
+
+/* Maps the registers, done once by the boot CPU */
+void lapic_map(void);
+
+/* Enables the local APIC of the calling CPU */
+void lapic_init(void);
+
+/* Stops 8259 interrupts on LINT0, the I/O APIC took over */
+void lapic_mask_extint(void);
+
+int lapic_id(void);
+
+void lapic_eoi(void);
+
+/* Inter-processor interrupts */
+void lapic_send_ipi(int apic_id, int vector);
+
+void lapic_send_ipi_others(int vector);
+
+void lapic_send_init(int apic_id);
+
+void lapic_send_sipi(int apic_id, uint32_t page);
+
+/* Per-CPU scheduler tick for the CPUs the PIT does not reach, and for
+ * the boot CPU with the I/O APIC backend */
+void lapic_timer_calibrate(void);
+
+void lapic_timer_start(void);
+
+void lapic_timer_oneshot(uint32_t pit_cycles);
+
+uint32_t lapic_timer_remaining(void);
+
+void lapic_timer_handler(void);
+
+#endif /* _APIC_H */
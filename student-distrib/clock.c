@@ -0,0 +1,138 @@
+/* clock.c - Monotonic nanosecond clock from the TSC
+ * vim:ts=4 noexpandtab
+ */
+
+#include "clock.h"
+#include "lib.h"
+#include "scheduling.h"
+#include "tsc.h"
+#include "x86_desc.h"
+
+/* ns covered by the difference of the two calibration delays */
+#define CLOCK_CAL_NS        ((uint64_t) (CLOCK_CAL_CYCLES - CLOCK_CAL_SHORT) * NSEC_PER_SEC / MAX_PIT_SPEED)
+
+uint32_t clock_mult = 0;
+uint32_t tsc_khz = 0;
+
+/* TSC at clock_init, time 0 */
+static uint64_t clock_base_tsc = 0;
+
+/*
+ * clock_measure
+ *   DESCRIPTION: TSC cycles spent in the shortest of CLOCK_CAL_RUNS PIT
+ *                channel 2 delays
+ *   INPUTS: pit_cycles -- length of the delay in PIT input clocks
+ *   OUTPUTS: none
+ *   RETURN VALUE: cycles
+ *   SIDE EFFECTS: busy waits CLOCK_CAL_RUNS times pit_cycles
+ */
+static uint64_t clock_measure(uint32_t pit_cycles) {
+    uint64_t start, cycles, best = ~0ULL;
+    int i;
+
+    for (i = 0; i < CLOCK_CAL_RUNS; i++) {
+        start = rdtsc();
+        pit_delay_cycles(pit_cycles);
+        cycles = rdtsc() - start;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+/*
+ * clock_init
+ *   DESCRIPTION: Calibrates the TSC against the PIT and starts the clock
+ *                at 0
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: busy waits about 255 ms with interrupts off. Sets
+ *                 clock_mult and tsc_khz
+ */
+void clock_init(void) {
+    uint64_t cycles, scaled, khz;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    cycles = clock_measure(CLOCK_CAL_CYCLES) - clock_measure(CLOCK_CAL_SHORT);
+    restore_flags(flags);
+
+    /* mult = ns << CLOCK_SHIFT / cycles has to fit 32 bits */
+    if (cycles <= ((CLOCK_CAL_NS << CLOCK_SHIFT) >> 32)) {
+        cycles = ((CLOCK_CAL_NS << CLOCK_SHIFT) >> 32) + 1;
+    }
+    scaled = CLOCK_CAL_NS << CLOCK_SHIFT;
+    div64_32(&scaled, (uint32_t) cycles);
+    clock_mult = (uint32_t) scaled;
+
+    /* kHz = cycles / (PIT cycles / PIT rate) / 1000 */
+    khz = cycles * MAX_PIT_SPEED;
+    div64_32(&khz, CLOCK_CAL_CYCLES - CLOCK_CAL_SHORT);
+    div64_32(&khz, 1000);
+    tsc_khz = (uint32_t) khz;
+
+    clock_base_tsc = rdtsc();
+}
+
+/*
+ * clock_cycles_to_ns
+ *   DESCRIPTION: Converts a TSC difference, the 96-bit product is built
+ *                from two 32 by 32 bit multiplications
+ *   INPUTS: cycles -- TSC cycles
+ *   OUTPUTS: none
+ *   RETURN VALUE: nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_cycles_to_ns(uint64_t cycles) {
+    return (((uint64_t) (uint32_t) cycles * clock_mult) >> CLOCK_SHIFT) +
+           (((uint64_t) (uint32_t) (cycles >> 32) * clock_mult) << (32 - CLOCK_SHIFT));
+}
+
+/*
+ * clock_tsc_to_ns
+ *   DESCRIPTION: Time of a TSC reading
+ *   INPUTS: tsc -- value read on any CPU
+ *   OUTPUTS: none
+ *   RETURN VALUE: ns since clock_init, 0 for readings before it
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_tsc_to_ns(uint64_t tsc) {
+    if (tsc <= clock_base_tsc) {
+        return 0;
+    }
+    return clock_cycles_to_ns(tsc - clock_base_tsc);
+}
+
+/*
+ * clock_ns
+ *   DESCRIPTION: Monotonic clock, assumes the CPUs' TSCs run in step
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: ns since clock_init
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_ns(void) {
+    return clock_tsc_to_ns(rdtsc());
+}
+
+/*
+ * clock_read
+ *   DESCRIPTION: Splits a clock's time into seconds and nanoseconds
+ *   INPUTS: clock_id -- CLOCK_MONOTONIC, ts -- where to put the time
+ *   OUTPUTS: *ts
+ *   RETURN VALUE: 0 on success, -1 for unknown clocks or a NULL ts
+ *   SIDE EFFECTS: none
+ */
+int32_t clock_read(int32_t clock_id, timespec_t* ts) {
+    uint64_t ns;
+
+    if (clock_id != CLOCK_MONOTONIC || ts == NULL) {
+        return -1;
+    }
+    ns = clock_ns();
+    ts->tv_nsec = div64_32(&ns, NSEC_PER_SEC);
+    ts->tv_sec = (uint32_t) ns;
+    return 0;
+}
@@ -0,0 +1,68 @@
+/* clock.h - Monotonic nanosecond clock from the TSC, calibrated against
+ * the PIT at boot
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include "types.h"
+
+/* ns = cycles * clock_mult >> CLOCK_SHIFT, for TSCs of 1 MHz and up */
+#define CLOCK_SHIFT         22
+
+/* Calibration: TSC cycles over a long and a short PIT channel 2 delay,
+ * the difference cancels the cost of programming the PIT. The shortest
+ * of CLOCK_CAL_RUNS runs wins, interruptions only make runs longer */
+#define CLOCK_CAL_CYCLES    59659       // ~50 ms of PIT input clocks
+#define CLOCK_CAL_SHORT     1193        // ~1 ms
+#define CLOCK_CAL_RUNS      5
+
+/* clock ids of clock_read and the clock_gettime system call */
+#define CLOCK_MONOTONIC     1
+
+#define NSEC_PER_SEC        1000000000
+
+/* Time as clock_gettime returns it */
+typedef struct timespec {
+    uint32_t tv_sec;
+    uint32_t tv_nsec;
+} timespec_t;
+
+/* Cycles to ns scale, valid after clock_init */
+extern uint32_t clock_mult;
+extern uint32_t tsc_khz;
+
+/* Divides *n by base in place and returns the remainder, 64-bit division
+ * without libgcc */
+static inline uint32_t div64_32(uint64_t* n, uint32_t base) {
+    uint32_t hi = (uint32_t) (*n >> 32);
+    uint32_t lo = (uint32_t) *n;
+    uint32_t q_hi = hi / base;
+    uint32_t q_lo, rem;
+
+    hi %= base;
+    asm ("divl %4"
+            : "=a" (q_lo), "=d" (rem)
+            : "a" (lo), "d" (hi), "rm" (base)
+    );
+    *n = ((uint64_t) q_hi << 32) | q_lo;
+    return rem;
+}
+
+/* Measures the TSC against the PIT, call once at boot */
+void clock_init(void);
+
+/* TSC cycles to ns */
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+
+/* Nanoseconds since clock_init at TSC value tsc */
+uint64_t clock_tsc_to_ns(uint64_t tsc);
+
+/* Nanoseconds since clock_init */
+uint64_t clock_ns(void);
+
+/* Fills ts with the time of a clock */
+int32_t clock_read(int32_t clock_id, timespec_t* ts);
+
+#endif /* _CLOCK_H */
@@ -127,22 +127,22 @@ void ex_c_handler_14(){
     // printf("Page Fault Line Number: %d\n", get_line_number());
 
     printf("PCB %d: \n", 0);
-    printf("Parent: %d, ESP: %x, EBP: %x, Terminal: %d\n", get_pcb_pid(0).parent_pcb_pid, get_pcb_pid(0).esp, get_pcb_pid(0).ebp, get_pcb_pid(0).terminal_idx);
+    printf("Parent: %d, ESP: %x, CR3: %x, Terminal: %d\n", get_pcb_pid(0).parent_pcb_pid, get_pcb_pid(0).ctx.esp, get_pcb_pid(0).ctx.cr3, get_pcb_pid(0).terminal_idx);
     
     printf("PCB %d: \n", 1);
-    printf("Parent: %d, ESP: %x, EBP: %x, Terminal: %d\n", get_pcb_pid(1).parent_pcb_pid, get_pcb_pid(1).esp, get_pcb_pid(1).ebp, get_pcb_pid(1).terminal_idx);
+    printf("Parent: %d, ESP: %x, CR3: %x, Terminal: %d\n", get_pcb_pid(1).parent_pcb_pid, get_pcb_pid(1).ctx.esp, get_pcb_pid(1).ctx.cr3, get_pcb_pid(1).terminal_idx);
     
     printf("PCB %d: \n", 2);
-    printf("Parent: %d, ESP: %x, EBP: %x, Terminal: %d\n", get_pcb_pid(2).parent_pcb_pid, get_pcb_pid(2).esp, get_pcb_pid(2).ebp, get_pcb_pid(2).terminal_idx);
+    printf("Parent: %d, ESP: %x, CR3: %x, Terminal: %d\n", get_pcb_pid(2).parent_pcb_pid, get_pcb_pid(2).ctx.esp, get_pcb_pid(2).ctx.cr3, get_pcb_pid(2).terminal_idx);
     
     printf("PCB %d: \n", 3);
-    printf("Parent: %d, ESP: %x, EBP: %x, Terminal: %d\n", get_pcb_pid(3).parent_pcb_pid, get_pcb_pid(3).esp, get_pcb_pid(3).ebp, get_pcb_pid(3).terminal_idx);
+    printf("Parent: %d, ESP: %x, CR3: %x, Terminal: %d\n", get_pcb_pid(3).parent_pcb_pid, get_pcb_pid(3).ctx.esp, get_pcb_pid(3).ctx.cr3, get_pcb_pid(3).terminal_idx);
     
     printf("PCB %d: \n", 4);
-    printf("Parent: %d, ESP: %x, EBP: %x, Terminal: %d\n", get_pcb_pid(4).parent_pcb_pid, get_pcb_pid(4).esp, get_pcb_pid(4).ebp, get_pcb_pid(4).terminal_idx);
+    printf("Parent: %d, ESP: %x, CR3: %x, Terminal: %d\n", get_pcb_pid(4).parent_pcb_pid, get_pcb_pid(4).ctx.esp, get_pcb_pid(4).ctx.cr3, get_pcb_pid(4).terminal_idx);
     
     printf("PCB %d: \n", 5);
-    printf("Parent: %d, ESP: %x, EBP: %x, Terminal: %d\n", get_pcb_pid(5).parent_pcb_pid, get_pcb_pid(5).esp, get_pcb_pid(5).ebp, get_pcb_pid(5).terminal_idx);
+    printf("Parent: %d, ESP: %x, CR3: %x, Terminal: %d\n", get_pcb_pid(5).parent_pcb_pid, get_pcb_pid(5).ctx.esp, get_pcb_pid(5).ctx.cr3, get_pcb_pid(5).terminal_idx);
     
     printf("Terminal Array: %d %d %d \n", get_terminal_array_entry(0), get_terminal_array_entry(1), get_terminal_array_entry(2));
     while(1);
@@ -236,6 +236,21 @@ void ex_c_handler_40(){
     rtc_handler();
 }
 
+/* Local APIC Timer Handler (CPUs other than the boot CPU) */
+void ex_c_handler_240(){
+    lapic_timer_handler();
+}
+
+/* Reschedule IPI Handler */
+void ex_c_handler_241(){
+    resched_ipi_handler();
+}
+
+/* TLB Flush IPI Handler */
+void ex_c_handler_242(){
+    tlb_flush_ipi_handler();
+}
+
 // extern void ex_c_handler_128(void); // System Call
 // void ex_c_handler_128(){
 //     clear();
@@ -10,6 +10,8 @@
 #include "scheduling.h"
 #include "pcb.h"
 #include "multiple_terminals.h"
+#include "apic.h"
+#include "smp.h"
 
 extern void ex_c_handler_0(void); // Divide by zero
 extern void ex_c_handler_1(void); // Debug
@@ -42,5 +44,9 @@ extern void ex_c_handler_32(void); // PIT Interrupt
 extern void ex_c_handler_33(void); // Keyboard Interrupt
 extern void ex_c_handler_40(void); // RTC Interrupt
 
+extern void ex_c_handler_240(void); // Local APIC Timer Interrupt
+extern void ex_c_handler_241(void); // Reschedule IPI
+extern void ex_c_handler_242(void); // TLB Flush IPI
+
 extern void ex_c_handler_128(void); // System Call
 #endif
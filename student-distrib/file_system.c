@@ -6,6 +6,7 @@
  * 
  */
 #include "file_system.h"
+#include "scheduling.h"
 
 
 /** Local variables to this file, need them saved so we used static keyword */
@@ -102,6 +103,19 @@ int32_t read_dentry_by_index (uint32_t index, struct dentry_t* dentry) {
     return 0;       // return 0 if successful
 }
 
+/** 
+ * file_length
+ * DESCRIPTION: Gets the size of a file
+ * INPUTS: inode - inode number
+ * OUTPUTS: none
+ * RETURN VALUE: returns the length of the file in bytes
+ * SIDE EFFECTS: none
+ */
+uint32_t file_length (uint32_t inode) {
+    struct inode_t* inode_address = (inode_t*)starting_mem_ptr + (inode + 1);   // inodes start after the boot block
+    return inode_address->length_in_bytes;
+}
+
 /** 
  * read_data
  * DESCRIPTION: Reads the data
@@ -111,7 +125,7 @@ int32_t read_dentry_by_index (uint32_t index, struct dentry_t* dentry) {
  *         length - length of the data
  * OUTPUTS: none
  * RETURN VALUE: returns the number of bytes read
- * SIDE EFFECTS: none
+ * SIDE EFFECTS: preemption point between data blocks
  */
 int32_t read_data (uint32_t inode, uint32_t offset, char* buf, uint32_t length) {
 
@@ -145,6 +159,11 @@ int32_t read_data (uint32_t inode, uint32_t offset, char* buf, uint32_t length)
     for (i = offset; i < bytes_up_to; i++) {    // loop through the bytes up to the offset
         inode_data_block_num = i / 4096; // finds the data block number
         inode_data_block_offset = i % 4096;  // finds the offset in the data block
+
+        /* Large reads (program loads) let a waiting task in between blocks */
+        if (inode_data_block_offset == 0 && i != offset) {
+            preempt_point();
+        }
         data_block_num = curr_inode.data_blocks[inode_data_block_num];  // finds the data block number
 
         uint8_t* block_add_address = (uint8_t *)(starting_mem_ptr + (1 + num_n + data_block_num));  // finds the address of the data block
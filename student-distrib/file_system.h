@@ -42,6 +42,9 @@ int32_t read_dentry_by_name (const uint8_t* fname, struct dentry_t* dentry);
 
 int32_t read_dentry_by_index (uint32_t index, struct dentry_t* dentry);
 
+// size of the file behind an inode, in bytes
+uint32_t file_length (uint32_t inode);
+
 // how many bytes it read
 // writes data into buf
 int32_t read_data (uint32_t inode, uint32_t offset, char* buf, uint32_t length);
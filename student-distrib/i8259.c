@@ -4,6 +4,19 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "spinlock.h"
+
+/* Mask registers are read-modify-written */
+static spinlock_t i8259_lock = SPIN_LOCK_INIT("i8259");
+
+/* Backend used until irq_init finds an I/O APIC */
+irq_chip i8259_chip = {
+    .name = "8259",
+    .enable = i8259_enable_irq,
+    .disable = i8259_disable_irq,
+    .eoi = i8259_send_eoi,
+    .set_affinity = NULL
+};
 
 /*
  * i8259_init
@@ -17,8 +30,8 @@
 void i8259_init(void) {
  
     /* Block external interrupts */
-    unsigned long flag;
-    cli_and_save(flag);
+    uint32_t flag;
+    spin_lock_irqsave(&i8259_lock, flag);
 
     /* Mask all PIC interrupts */
     outb(0xFF, MASTER_8259_PORT_DATA);
@@ -41,23 +54,24 @@ void i8259_init(void) {
     outb(0xFF, SLAVE_8259_PORT_DATA);
 
     /* Enable interrupts */
-    restore_flags(flag);
+    spin_unlock_irqrestore(&i8259_lock, flag);
     printf("Initialized PIC\n");
 }
 
 /*
- * enable_irq
+ * i8259_enable_irq
  *   DESCRIPTION: Enable (unmaks) a specific IRQ
  *   INPUTS: irq_num - Pin number to enable
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Enables a PIC IRQ
  */  
-void enable_irq(uint32_t irq_num) {
+void i8259_enable_irq(uint32_t irq_num) {
 
     /* Function variables */
     uint16_t port;  // PIC address
     uint8_t value;  // Mask value
+    uint32_t flags; // Caller's interrupt state
  
     /* Ensure irq_num is inbounds */
     if((irq_num < MIN_IRQ) | (irq_num > MAX_IRQ)){
@@ -75,23 +89,26 @@ void enable_irq(uint32_t irq_num) {
     }
     
     /* Load mask into PIC */
+    spin_lock_irqsave(&i8259_lock, flags);
     value = inb(port)  & ~(1 << irq_num);
     outb(value, port);  
+    spin_unlock_irqrestore(&i8259_lock, flags);
 }
 
 /*
- * disable_irq
+ * i8259_disable_irq
  *   DESCRIPTION: Disable (maks) a specific IRQ
  *   INPUTS: irq_num - Pin number to disable
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Disables a PIC IRQ
  */  
-void disable_irq(uint32_t irq_num) {
+void i8259_disable_irq(uint32_t irq_num) {
 
     /* Function variables */
     uint16_t port;  // PIC address
     uint8_t value;  // Mask value
+    uint32_t flags; // Caller's interrupt state
  
     /* Ensure irq_num is inbounds */
     if((irq_num < MIN_IRQ) | (irq_num > MAX_IRQ)){
@@ -109,12 +126,14 @@ void disable_irq(uint32_t irq_num) {
     }
 
     /* Load mask into PIC */
+    spin_lock_irqsave(&i8259_lock, flags);
     value = inb(port) | (1 << irq_num);
     outb(value, port);    
+    spin_unlock_irqrestore(&i8259_lock, flags);
 }
 
 /*
- * send_eoi
+ * i8259_send_eoi
  *   DESCRIPTION: Send end-of-interrupt signal
  *                to reset PIC interrupt pin
  *   INPUTS: irq_num - Pin number to reset
@@ -122,7 +141,7 @@ void disable_irq(uint32_t irq_num) {
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Resets a PIC IRQ state
  */  
-void send_eoi(uint32_t irq_num) {
+void i8259_send_eoi(uint32_t irq_num) {
 
     /* Ensure irq_num is inbounds */
     if((irq_num < MIN_IRQ) | (irq_num > MAX_IRQ)){
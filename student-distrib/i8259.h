@@ -7,6 +7,7 @@
 #define _I8259_H
 
 #include "types.h"
+#include "irq.h"
 
 /* Ports that each PIC sits on */
 #define MASTER_8259_PORT_CMD    0x20
@@ -38,14 +39,16 @@
 /* Initialize both PICs */
 void i8259_init(void);
 
+extern irq_chip i8259_chip;
+
 /* Enable (unmask) the specified IRQ */
-void enable_irq(uint32_t irq_num);
+void i8259_enable_irq(uint32_t irq_num);
 
 /* Disable (mask) the specified IRQ */
-void disable_irq(uint32_t irq_num);
+void i8259_disable_irq(uint32_t irq_num);
 
 /* Send end-of-interrupt signal for the specified IRQ */
-void send_eoi(uint32_t irq_num);
+void i8259_send_eoi(uint32_t irq_num);
 
 #endif /* _I8259_H */
 
@@ -0,0 +1,215 @@
+/* io_ring.c - Runs the entries a program queued on its shared rings and
+ * posts their completions
+ * vim:ts=4 noexpandtab
+ */
+
+#include "io_ring.h"
+#include "lib.h"
+#include "pcb.h"
+#include "rtc.h"
+#include "terminal.h"
+#include "system_calls.h"
+#include "x86_desc.h"
+
+#define IORING_MASK         (IORING_ENTRIES - 1)
+#define IORING_NAME_LEN     32          // file names compared by read_dentry_by_name
+
+/*
+ * io_ring_op
+ *   DESCRIPTION: Runs one submission entry through the system call it
+ *                names, as the calling program
+ *   INPUTS: sqe -- kernel copy of the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: the system call's return value, -1 for unknown
+ *                 operations and buffers outside the program page
+ *   SIDE EFFECTS: may sleep (terminal and RTC reads)
+ */
+static int32_t io_ring_op(const io_sqe_t* sqe) {
+    switch (sqe->opcode) {
+        case IORING_OP_NOP:
+            return 0;
+        case IORING_OP_READ:
+            if (sqe->len < 0 || !user_range_ok((void*) sqe->addr, sqe->len)) {
+                return -1;
+            }
+            return sys_call_read(sqe->fd, (void*) sqe->addr, sqe->len);
+        case IORING_OP_WRITE:
+            if (sqe->len < 0 || !user_range_ok((void*) sqe->addr, sqe->len)) {
+                return -1;
+            }
+            return sys_call_write(sqe->fd, (const void*) sqe->addr, sqe->len);
+        case IORING_OP_OPEN:
+            if (!user_range_ok((void*) sqe->addr, IORING_NAME_LEN)) {
+                return -1;
+            }
+            return sys_call_open((const uint8_t*) sqe->addr);
+        case IORING_OP_CLOSE:
+            return sys_call_close(sqe->fd);
+        default:
+            return -1;
+    }
+}
+
+/*
+ * io_ring_may_block
+ *   DESCRIPTION: Tells whether an entry could sleep: reads of the terminal
+ *                and of the RTC. Everything else finishes right away
+ *   INPUTS: sqe -- kernel copy of the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it may sleep, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int io_ring_may_block(const io_sqe_t* sqe) {
+    int32_t (*read)(int32_t fd, void* buf, int32_t nbytes);
+
+    if (sqe->opcode != IORING_OP_READ) {
+        return 0;
+    }
+    if (sqe->fd == 0) {
+        return 1;
+    }
+    if (sqe->fd < 0 || sqe->fd >= 8) {  // 8 elements in the fd_array
+        return 0;
+    }
+    read = pcb_array[get_global_pid()].fd_array[sqe->fd].ops.read;
+    return read == &terminal_read || read == &rtc_read;
+}
+
+/*
+ * io_ring_run
+ *   DESCRIPTION: Takes entries off the submission ring in order, runs them
+ *                and appends their completions
+ *   INPUTS: ring -- the program's rings, count -- most entries to take,
+ *           nonblock -- 1 to stop at the first entry that may sleep
+ *   OUTPUTS: the completion ring and the kernel's indices
+ *   RETURN VALUE: entries taken, -1 if the program left more than
+ *                 IORING_ENTRIES queued (broken indices)
+ *   SIDE EFFECTS: stops early when the completion ring is full, the rest
+ *                 stays queued. Entries run one after the other, so a
+ *                 read may use the fd an earlier open of the batch returned
+ */
+static int32_t io_ring_run(io_ring_t* ring, uint32_t count, int nonblock) {
+    uint32_t head = ring->sq_head;
+    uint32_t tail, cq_tail;
+    io_sqe_t sqe;
+    io_cqe_t* cqe;
+    int32_t res;
+    uint32_t done = 0;
+
+    while (done < count) {
+        tail = ring->sq_tail;
+        if (tail == head) {
+            break;
+        }
+        if (tail - head > IORING_ENTRIES) {
+            return -1;
+        }
+        cq_tail = ring->cq_tail;
+        if (cq_tail - ring->cq_head >= IORING_ENTRIES) {
+            break;
+        }
+
+        /* Copy first, the program may rewrite the slot meanwhile */
+        sqe = ring->sq[head & IORING_MASK];
+        if (nonblock && io_ring_may_block(&sqe)) {
+            break;
+        }
+        res = io_ring_op(&sqe);
+
+        cqe = &ring->cq[cq_tail & IORING_MASK];
+        cqe->user_data = sqe.user_data;
+        cqe->res = res;
+
+        /* Publish the completion before the index that makes it visible */
+        asm volatile ("" : : : "memory");
+        ring->cq_tail = cq_tail + 1;
+        ring->sq_head = ++head;
+        ring->submitted++;
+        done++;
+    }
+    return done;
+}
+
+/*
+ * io_ring_setup
+ *   DESCRIPTION: Registers the calling program's rings and empties them
+ *   INPUTS: ring -- rings inside the program page, NULL to drop them,
+ *           flags -- 0 or IORING_SQPOLL
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 for unknown flags or a ring outside
+ *                 the program page
+ *   SIDE EFFECTS: replaces a ring registered before
+ */
+int32_t io_ring_setup(io_ring_t* ring, uint32_t flags) {
+    int pid = get_global_pid();
+
+    if (ring == NULL) {
+        pcb_array[pid].io_ring = NULL;
+        pcb_array[pid].io_ring_flags = 0;
+        return 0;
+    }
+    if ((flags & ~IORING_SQPOLL) != 0) {
+        return -1;
+    }
+    if (((uint32_t) ring & 0x3) != 0 || !user_range_ok(ring, sizeof(io_ring_t))) {
+        return -1;
+    }
+
+    ring->sq_head = 0;
+    ring->sq_tail = 0;
+    ring->cq_head = 0;
+    ring->cq_tail = 0;
+    ring->flags = flags;
+    ring->submitted = 0;
+    pcb_array[pid].io_ring = ring;
+    pcb_array[pid].io_ring_flags = flags;
+    return 0;
+}
+
+/*
+ * io_ring_enter
+ *   DESCRIPTION: Runs up to to_submit entries the calling program queued
+ *   INPUTS: to_submit -- most entries to take
+ *   OUTPUTS: completions on the program's ring
+ *   RETURN VALUE: entries taken, -1 without a registered ring
+ *   SIDE EFFECTS: see io_ring_run
+ */
+int32_t io_ring_enter(uint32_t to_submit) {
+    io_ring_t* ring = pcb_array[get_global_pid()].io_ring;
+
+    if (ring == NULL) {
+        return -1;
+    }
+    return io_ring_run(ring, to_submit, 0);
+}
+
+/*
+ * io_ring_poll
+ *   DESCRIPTION: Drains the ring of an IORING_SQPOLL program the timer
+ *                interrupted in user mode, so it never has to call
+ *                io_enter for entries that finish right away. Called by
+ *                both timer linkages after irq_exit
+ *   INPUTS: none
+ *   OUTPUTS: completions on the program's ring
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts off, returns with them off. Stops
+ *                 at the first terminal or RTC read, which must not sleep
+ *                 on an interrupt frame; it and the entries behind it
+ *                 wait for io_enter
+ */
+void io_ring_poll(void) {
+    int pid = get_global_pid();
+    io_ring_t* ring;
+
+    if (pid < 0 || is_idle_pid(pid) || !(pcb_array[pid].io_ring_flags & IORING_SQPOLL)) {
+        return;
+    }
+    ring = pcb_array[pid].io_ring;
+    if (ring->sq_head == ring->sq_tail) {
+        return;
+    }
+
+    sti();
+    io_ring_run(ring, IORING_ENTRIES, 1);
+    cli();
+}
@@ -0,0 +1,63 @@
+/* io_ring.h - Submission / completion rings shared with a program, so a
+ * batch of reads, writes, opens and closes costs one system call
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _IO_RING_H
+#define _IO_RING_H
+
+#include "types.h"
+
+/* Entries per ring, a power of two. The ring layout below is copied in
+ * syscalls/ece391syscall.h and fish/ece391syscall.h, change all three */
+#define IORING_ENTRIES      64
+
+/* io_setup flags */
+#define IORING_SQPOLL       0x1         // drain on timer ticks up to a blocking read
+
+/* Operations of a submission entry */
+#define IORING_OP_NOP       0
+#define IORING_OP_READ      1
+#define IORING_OP_WRITE     2
+#define IORING_OP_OPEN      3
+#define IORING_OP_CLOSE     4
+
+/* Submission entry, filled by the program */
+typedef struct io_sqe {
+    uint32_t opcode;                    // IORING_OP_*
+    int32_t fd;                         // READ, WRITE, CLOSE
+    uint32_t addr;                      // buffer, file name for OPEN
+    int32_t len;                        // bytes to transfer
+    uint32_t user_data;                 // copied to the completion
+} io_sqe_t;
+
+/* Completion entry, filled by the kernel */
+typedef struct io_cqe {
+    uint32_t user_data;
+    int32_t res;                        // what the system call would return
+} io_cqe_t;
+
+/* The shared rings, in the program's own page. Indices run freely and
+ * are taken modulo IORING_ENTRIES. The program owns sq_tail and cq_head,
+ * the kernel sq_head and cq_tail */
+typedef struct io_ring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t flags;                     // set by io_setup
+    uint32_t submitted;                 // entries the kernel took so far
+    io_sqe_t sq[IORING_ENTRIES];
+    io_cqe_t cq[IORING_ENTRIES];
+} io_ring_t;
+
+/* Registers the calling program's ring, NULL drops it */
+int32_t io_ring_setup(io_ring_t* ring, uint32_t flags);
+
+/* Runs up to to_submit queued entries of the calling program's ring */
+int32_t io_ring_enter(uint32_t to_submit);
+
+/* Drains an IORING_SQPOLL ring before a timer tick returns to user mode */
+void io_ring_poll(void);
+
+#endif /* _IO_RING_H */
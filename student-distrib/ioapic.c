@@ -0,0 +1,304 @@
+/* ioapic.c - Functions to interact with the I/O APIC, the interrupt
+ * router of SMP machines
+ * vim:ts=4 noexpandtab
+ */
+
+#include "ioapic.h"
+#include "apic.h"
+#include "lib.h"
+#include "paging.h"
+#include "smp.h"
+
+/* I/O APICs listed in the MP table */
+typedef struct ioapic_info {
+    int apic_id;
+    volatile uint32_t* regs;            // physical address until ioapic_init maps it
+} ioapic_info;
+
+static ioapic_info ioapics[MAX_IOAPICS];
+static int num_ioapics = 0;
+
+/* Set when the MP table says the BIOS left the PICs wired straight to the
+ * CPU (PIC mode), the IMCR then has to be switched to the APIC */
+static int imcr_present = 0;
+
+/* ISA IRQ -> I/O APIC pin, filled in from the MP interrupt entries */
+static irq_route irq_routes[NUM_ISA_IRQS];
+static int routes_ready = 0;
+
+/* Register window (select, then access) and the redirection entries */
+static spinlock_t ioapic_lock = SPIN_LOCK_INIT("ioapic");
+
+static void ioapic_enable_irq(uint32_t irq_num);
+static void ioapic_disable_irq(uint32_t irq_num);
+static void ioapic_send_eoi(uint32_t irq_num);
+static int ioapic_set_affinity(uint32_t irq_num, int cpu);
+
+irq_chip ioapic_chip = {
+    .name = "IO-APIC",
+    .enable = ioapic_enable_irq,
+    .disable = ioapic_disable_irq,
+    .eoi = ioapic_send_eoi,
+    .set_affinity = ioapic_set_affinity
+};
+
+/*
+ * ioapic_read / ioapic_write
+ *   DESCRIPTION: Access an I/O APIC register through the index/data window
+ *   INPUTS: io -- I/O APIC
+ *           reg -- register index (IOAPIC_*)
+ *           val -- value to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: register value (ioapic_read)
+ *   SIDE EFFECTS: callers hold ioapic_lock between select and access
+ */
+static inline uint32_t ioapic_read(ioapic_info* io, uint32_t reg) {
+    io->regs[IOAPIC_REGSEL >> 2] = reg;
+    return io->regs[IOAPIC_WIN >> 2];
+}
+
+static inline void ioapic_write(ioapic_info* io, uint32_t reg, uint32_t val) {
+    io->regs[IOAPIC_REGSEL >> 2] = reg;
+    io->regs[IOAPIC_WIN >> 2] = val;
+}
+
+/*
+ * routes_init
+ *   DESCRIPTION: Default ISA wiring: IRQ n on pin n of the first I/O
+ *                APIC, edge triggered, active high. IRQ 2 is the cascade
+ *                input of the 8259s and has no device behind it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: MP interrupt entries override single IRQs afterwards
+ */
+static void routes_init(void) {
+    int i;
+
+    for (i = 0; i < NUM_ISA_IRQS; i++) {
+        irq_routes[i].ioapic = (i == 2) ? -1 : 0;
+        irq_routes[i].pin = i;
+        irq_routes[i].flags = 0;
+    }
+    routes_ready = 1;
+}
+
+/*
+ * ioapic_add
+ *   DESCRIPTION: Records an I/O APIC entry of the MP table
+ *   INPUTS: apic_id -- its ID, used by the interrupt entries
+ *           address -- physical address of its registers
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ignores I/O APICs beyond MAX_IOAPICS
+ */
+void ioapic_add(int apic_id, uint32_t address) {
+    if (!routes_ready) {
+        routes_init();
+    }
+    if (num_ioapics >= MAX_IOAPICS) {
+        return;
+    }
+    ioapics[num_ioapics].apic_id = apic_id;
+    ioapics[num_ioapics].regs = (volatile uint32_t*) address;
+    num_ioapics++;
+}
+
+/*
+ * ioapic_add_route
+ *   DESCRIPTION: Records an ISA interrupt entry of the MP table, e.g. the
+ *                PIT on pin 2 instead of pin 0
+ *   INPUTS: irq -- ISA IRQ (source bus IRQ)
+ *           apic_id -- destination I/O APIC ID, 0xFF = all of them
+ *           pin -- destination input pin
+ *           mp_flags -- MP_IRQ_* polarity and trigger mode
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after the I/O APIC entries (MP table order)
+ */
+void ioapic_add_route(uint32_t irq, int apic_id, int pin, uint32_t mp_flags) {
+    int i;
+
+    if (irq >= NUM_ISA_IRQS) {
+        return;
+    }
+    if (!routes_ready) {
+        routes_init();
+    }
+
+    irq_routes[irq].ioapic = -1;
+    for (i = 0; i < num_ioapics; i++) {
+        if (apic_id == 0xFF || ioapics[i].apic_id == apic_id) {
+            irq_routes[irq].ioapic = i;
+            break;
+        }
+    }
+    irq_routes[irq].pin = pin;
+
+    /* ISA defaults are active high, edge triggered */
+    irq_routes[irq].flags = 0;
+    if ((mp_flags & MP_IRQ_POLARITY) == MP_IRQ_LOW) {
+        irq_routes[irq].flags |= IOAPIC_POLARITY_LOW;
+    }
+    if ((mp_flags & MP_IRQ_TRIGGER) == MP_IRQ_LEVEL) {
+        irq_routes[irq].flags |= IOAPIC_TRIGGER_LEVEL;
+    }
+}
+
+/*
+ * ioapic_set_imcr
+ *   DESCRIPTION: Notes that the board boots in PIC mode
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ioapic_init reroutes the IMCR
+ */
+void ioapic_set_imcr(void) {
+    imcr_present = 1;
+}
+
+/*
+ * ioapic_redirect
+ *   DESCRIPTION: Writes the redirection entry of an ISA IRQ
+ *   INPUTS: irq_num -- ISA IRQ
+ *           masked -- IOAPIC_MASKED or 0
+ *           apic_id -- local APIC the interrupt is delivered to
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none for IRQs that are not wired, caller holds ioapic_lock
+ */
+static void ioapic_redirect(uint32_t irq_num, uint32_t masked, int apic_id) {
+    irq_route* route = &irq_routes[irq_num];
+    ioapic_info* io;
+
+    if (route->ioapic < 0) {
+        return;
+    }
+    io = &ioapics[route->ioapic];
+
+    /* Fixed delivery, physical destination, same vector as with the 8259s */
+    ioapic_write(io, IOAPIC_REDTBL + 2 * route->pin + 1, apic_id << 24);    // destination, bits 56-63
+    ioapic_write(io, IOAPIC_REDTBL + 2 * route->pin,
+            masked | route->flags | (IRQ_VECTOR_BASE + irq_num));
+}
+
+/*
+ * ioapic_init
+ *   DESCRIPTION: Maps the I/O APICs, masks all their inputs and points
+ *                every routed ISA IRQ at the boot CPU. Hands the
+ *                interrupt lines from the PICs to the APICs if the board
+ *                has an IMCR
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 without an I/O APIC
+ *   SIDE EFFECTS: the local APIC must be mapped already
+ */
+int ioapic_init(void) {
+    ioapic_info* io;
+    uint32_t flags;
+    int i, pin, pins;
+
+    if (num_ioapics == 0) {
+        return -1;
+    }
+
+    spin_lock_irqsave(&ioapic_lock, flags);
+    if (imcr_present) {
+        outb(0x70, 0x22);               // select the IMCR
+        outb(0x01, 0x23);               // INTR and NMI through the APIC
+    }
+
+    for (i = 0; i < num_ioapics; i++) {
+        io = &ioapics[i];
+        io->regs = (volatile uint32_t*) map_mmio_4mb((uint32_t) io->regs);
+        pins = ((ioapic_read(io, IOAPIC_VER) >> 16) & 0xFF) + 1;
+        for (pin = 0; pin < pins; pin++) {
+            ioapic_write(io, IOAPIC_REDTBL + 2 * pin, IOAPIC_MASKED);
+        }
+    }
+
+    for (i = 0; i < NUM_ISA_IRQS; i++) {
+        ioapic_redirect(i, IOAPIC_MASKED, cpus[0].apic_id);
+    }
+    spin_unlock_irqrestore(&ioapic_lock, flags);
+    return 0;
+}
+
+/*
+ * ioapic_enable_irq / ioapic_disable_irq
+ *   DESCRIPTION: Unmask / mask an ISA IRQ, no port I/O
+ *   INPUTS: irq_num - ISA IRQ
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: keeps the IRQ on the CPU it was routed to
+ */
+static void ioapic_enable_irq(uint32_t irq_num) {
+    irq_route* route = &irq_routes[irq_num];
+    ioapic_info* io;
+    uint32_t flags, reg;
+
+    if (route->ioapic < 0) {
+        return;
+    }
+    io = &ioapics[route->ioapic];
+    reg = IOAPIC_REDTBL + 2 * route->pin;
+
+    spin_lock_irqsave(&ioapic_lock, flags);
+    ioapic_write(io, reg, ioapic_read(io, reg) & ~IOAPIC_MASKED);
+    spin_unlock_irqrestore(&ioapic_lock, flags);
+}
+
+static void ioapic_disable_irq(uint32_t irq_num) {
+    irq_route* route = &irq_routes[irq_num];
+    ioapic_info* io;
+    uint32_t flags, reg;
+
+    if (route->ioapic < 0) {
+        return;
+    }
+    io = &ioapics[route->ioapic];
+    reg = IOAPIC_REDTBL + 2 * route->pin;
+
+    spin_lock_irqsave(&ioapic_lock, flags);
+    ioapic_write(io, reg, ioapic_read(io, reg) | IOAPIC_MASKED);
+    spin_unlock_irqrestore(&ioapic_lock, flags);
+}
+
+/*
+ * ioapic_send_eoi
+ *   DESCRIPTION: Ends an I/O APIC interrupt. The local APIC that took it
+ *                forwards the EOI (edge and level triggered alike)
+ *   INPUTS: irq_num - unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void ioapic_send_eoi(uint32_t irq_num) {
+    lapic_eoi();
+}
+
+/*
+ * ioapic_set_affinity
+ *   DESCRIPTION: Sends an ISA IRQ to another CPU's local APIC
+ *   INPUTS: irq_num - ISA IRQ
+ *           cpu - online CPU
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 for an offline CPU or unwired IRQ
+ *   SIDE EFFECTS: keeps the mask state
+ */
+static int ioapic_set_affinity(uint32_t irq_num, int cpu) {
+    irq_route* route = &irq_routes[irq_num];
+    ioapic_info* io;
+    uint32_t flags, masked;
+
+    if (cpu < 0 || cpu >= num_cpus || !cpus[cpu].online || route->ioapic < 0) {
+        return -1;
+    }
+    io = &ioapics[route->ioapic];
+
+    spin_lock_irqsave(&ioapic_lock, flags);
+    masked = ioapic_read(io, IOAPIC_REDTBL + 2 * route->pin) & IOAPIC_MASKED;
+    ioapic_redirect(irq_num, masked, cpus[cpu].apic_id);
+    spin_unlock_irqrestore(&ioapic_lock, flags);
+    return 0;
+}
@@ -0,0 +1,60 @@
+/* ioapic.h - Defines used in interactions with the I/O APIC, which
+ * replaces the 8259 PICs for routing device interrupts to the CPUs
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _IOAPIC_H
+#define _IOAPIC_H
+
+#include "types.h"
+#include "irq.h"
+
+/* Route device interrupts through the I/O APIC when the MP table lists
+ * one. Comment out to always use the 8259 PICs */
+#define IOAPIC
+
+#define MAX_IOAPICS         2
+
+/* Register window, offsets from the I/O APIC base */
+#define IOAPIC_REGSEL       0x00        // register index
+#define IOAPIC_WIN          0x10        // data of the selected register
+
+/* Registers */
+#define IOAPIC_ID           0x00
+#define IOAPIC_VER          0x01        // bits 16-23: highest redirection entry
+#define IOAPIC_REDTBL       0x10        // 2 registers per input pin
+
+/* Redirection entry bits (low word) */
+#define IOAPIC_POLARITY_LOW 0x2000
+#define IOAPIC_TRIGGER_LEVEL 0x8000
+#define IOAPIC_MASKED       0x10000
+
+/* First IDT vector of the ISA IRQs, same as the 8259 setup */
+#define IRQ_VECTOR_BASE     0x20
+
+/* MP table interrupt entry flags (Intel MP spec 1.4, 4.3.4) */
+#define MP_IRQ_POLARITY     0x03        // 00 = bus default, 01 = high, 11 = low
+#define MP_IRQ_TRIGGER      0x0C        // 00 = bus default, 01 = edge, 11 = level
+#define MP_IRQ_LOW          0x03
+#define MP_IRQ_LEVEL        0x0C
+
+/* Where an ISA IRQ enters the I/O APIC */
+typedef struct irq_route {
+    int ioapic;                         // index into the I/O APICs found, -1 = not wired
+    int pin;                            // input pin of that I/O APIC
+    uint32_t flags;                     // IOAPIC_POLARITY_LOW / IOAPIC_TRIGGER_LEVEL
+} irq_route;
+
+extern irq_chip ioapic_chip;
+
+/* Called while parsing the MP table */
+void ioapic_add(int apic_id, uint32_t address);
+
+void ioapic_add_route(uint32_t irq, int apic_id, int pin, uint32_t mp_flags);
+
+void ioapic_set_imcr(void);
+
+/* Programs every routed IRQ masked, returns -1 without an I/O APIC */
+int ioapic_init(void);
+
+#endif /* _IOAPIC_H */
@@ -0,0 +1,115 @@
+/* irq.c - Routes enable/disable/EOI requests of the device drivers to the
+ * interrupt controller picked at boot
+ * vim:ts=4 noexpandtab
+ */
+
+#include "irq.h"
+#include "i8259.h"
+#include "ioapic.h"
+#include "apic.h"
+#include "lib.h"
+
+/* The PICs work everywhere, the I/O APIC replaces them in irq_init */
+static irq_chip* chip = &i8259_chip;
+
+/*
+ * irq_init
+ *   DESCRIPTION: Switches interrupt delivery to the I/O APIC and the
+ *                local APICs when the MP table listed an I/O APIC. The
+ *                8259s stay masked from then on
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: every IRQ starts masked on the new backend
+ */
+void irq_init(void) {
+#ifdef IOAPIC
+    if (ioapic_init() != 0) {
+        return;
+    }
+
+    /* The PICs are fully masked after i8259_init, keep even their
+     * spurious IRQ7/15 away from LINT0 */
+    lapic_mask_extint();
+    chip = &ioapic_chip;
+#endif
+}
+
+/*
+ * irq_uses_apic
+ *   DESCRIPTION: Whether device interrupts come through the I/O APIC,
+ *                in which case EOIs go to the local APIC
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 for the I/O APIC, 0 for the 8259s
+ *   SIDE EFFECTS: none
+ */
+int irq_uses_apic(void) {
+    return chip != &i8259_chip;
+}
+
+/*
+ * irq_chip_name
+ *   DESCRIPTION: Name of the backend in use, for boot messages
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: "8259" or "IO-APIC"
+ *   SIDE EFFECTS: none
+ */
+const char* irq_chip_name(void) {
+    return chip->name;
+}
+
+/*
+ * enable_irq / disable_irq
+ *   DESCRIPTION: Unmask / mask a specific IRQ
+ *   INPUTS: irq_num - ISA IRQ number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none for IRQs outside [0:15]
+ */
+void enable_irq(uint32_t irq_num) {
+    if (irq_num >= NUM_ISA_IRQS) {
+        return;
+    }
+    chip->enable(irq_num);
+}
+
+void disable_irq(uint32_t irq_num) {
+    if (irq_num >= NUM_ISA_IRQS) {
+        return;
+    }
+    chip->disable(irq_num);
+}
+
+/*
+ * send_eoi
+ *   DESCRIPTION: Send end-of-interrupt signal, two port writes on the
+ *                8259s, one uncached store to the local APIC otherwise
+ *   INPUTS: irq_num - IRQ being serviced
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the controller may deliver the next interrupt
+ */
+void send_eoi(uint32_t irq_num) {
+    if (irq_num >= NUM_ISA_IRQS) {
+        return;
+    }
+    chip->eoi(irq_num);
+}
+
+/*
+ * irq_set_affinity
+ *   DESCRIPTION: Delivers an IRQ to another CPU from now on
+ *   INPUTS: irq_num - ISA IRQ number
+ *           cpu - index into cpus[]
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the backend only reaches CPU 0
+ *   SIDE EFFECTS: none
+ */
+int irq_set_affinity(uint32_t irq_num, int cpu) {
+    if (irq_num >= NUM_ISA_IRQS || chip->set_affinity == NULL) {
+        return -1;
+    }
+    return chip->set_affinity(irq_num, cpu);
+}
@@ -0,0 +1,42 @@
+/* irq.h - Interrupt controller independent IRQ interface, the backend
+ * (8259 PICs or I/O APIC) is chosen once at boot
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _IRQ_H
+#define _IRQ_H
+
+#include "types.h"
+
+#define NUM_ISA_IRQS        16
+
+/* Operations of one interrupt controller backend */
+typedef struct irq_chip {
+    const char* name;
+    void (*enable)(uint32_t irq_num);
+    void (*disable)(uint32_t irq_num);
+    void (*eoi)(uint32_t irq_num);
+    int (*set_affinity)(uint32_t irq_num, int cpu);   // NULL: CPU 0 only
+} irq_chip;
+
+/* Picks the I/O APIC when present, call after i8259_init and mp_init */
+void irq_init(void);
+
+/* 1 when interrupts arrive through the local APICs */
+int irq_uses_apic(void);
+
+const char* irq_chip_name(void);
+
+/* Enable (unmask) the specified IRQ */
+void enable_irq(uint32_t irq_num);
+
+/* Disable (mask) the specified IRQ */
+void disable_irq(uint32_t irq_num);
+
+/* Send end-of-interrupt signal for the specified IRQ */
+void send_eoi(uint32_t irq_num);
+
+/* Delivers an IRQ to another CPU, -1 if the backend cannot */
+int irq_set_affinity(uint32_t irq_num, int cpu);
+
+#endif /* _IRQ_H */
@@ -0,0 +1,221 @@
+/* irqsoff.c - Measures how long each call site keeps interrupts off
+ * vim:ts=4 noexpandtab
+ */
+
+#include "irqsoff.h"
+#include "lib.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "tsc.h"
+
+/* Windows that started on kernel entry rather than at a cli */
+irqsoff_site irqsoff_entry_site = { "entry", 0 };
+
+/* Sites that had a window so far, in order of the first one */
+static irqsoff_site* irqsoff_sites[MAX_IRQSOFF_SITES];
+static int num_irqsoff_sites = 0;
+static volatile uint32_t irqsoff_sites_lock = 0;
+
+/* Bucket labels for irqsoff_read, cycles */
+static const char* irqsoff_buckets[IRQSOFF_BUCKETS] = {
+    "<1K", "<4K", "<16K", "<64K", "<256K", "<1M", "<4M", ">=4M"
+};
+
+/*
+ * irqsoff_list
+ *   DESCRIPTION: Adds a site to the table on its first window
+ *   INPUTS: site -- call site
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sites beyond MAX_IRQSOFF_SITES are not reported
+ */
+static void irqsoff_list(irqsoff_site* site) {
+    while (xchg(&irqsoff_sites_lock, 1) != 0) {
+        asm volatile ("pause" : : : "memory");
+    }
+    if (!site->listed && num_irqsoff_sites < MAX_IRQSOFF_SITES) {
+        irqsoff_sites[num_irqsoff_sites++] = site;
+    }
+    site->listed = 1;
+    asm volatile ("" : : : "memory");
+    irqsoff_sites_lock = 0;
+}
+
+/*
+ * irqsoff_bucket
+ *   DESCRIPTION: Histogram bucket of a window length
+ *   INPUTS: cycles -- TSC cycles interrupts were off
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 below 1024 cycles, then one bucket per factor of 4
+ *   SIDE EFFECTS: none
+ */
+static int irqsoff_bucket(uint32_t cycles) {
+    uint32_t msb;
+    int bucket;
+
+    if (cycles < 1024) {
+        return 0;
+    }
+    asm ("bsrl %1, %0" : "=r" (msb) : "rm" (cycles));
+    bucket = (msb - 10) / 2 + 1;        // 2^10 = 1024
+    return (bucket < IRQSOFF_BUCKETS) ? bucket : IRQSOFF_BUCKETS - 1;
+}
+
+/*
+ * irqsoff_off
+ *   DESCRIPTION: Interrupts just went off on this CPU, starts the clock
+ *   INPUTS: site -- who turned them off
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called with interrupts off, must not use cli/sti itself
+ */
+void irqsoff_off(irqsoff_site* site) {
+    cpu_info* cpu = this_cpu();
+
+    cpu->irqsoff_site = site;
+    cpu->irqsoff_start = rdtsc();
+}
+
+/*
+ * irqsoff_on
+ *   DESCRIPTION: Interrupts are about to go back on, charges the window
+ *                to the site that opened it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: counters of one site are not atomic, two CPUs closing
+ *                 windows of the same site at once may lose an update
+ */
+void irqsoff_on(void) {
+    cpu_info* cpu = this_cpu();
+    irqsoff_site* site = cpu->irqsoff_site;
+    uint64_t cycles;
+    uint32_t len;
+
+    if (site == NULL) {
+        return;
+    }
+    cycles = rdtsc() - cpu->irqsoff_start;
+    cpu->irqsoff_site = NULL;
+
+    len = (cycles >> 32) ? 0xFFFFFFFF : (uint32_t) cycles;
+    site->count++;
+    site->hist[irqsoff_bucket(len)]++;
+    if (len > site->max_cycles) {
+        site->max_cycles = len;
+    }
+    if (!site->listed) {
+        irqsoff_list(site);
+    }
+}
+
+/*
+ * irqsoff_entry
+ *   DESCRIPTION: An interrupt gate turned interrupts off. Any window
+ *                still open on this CPU was closed by an iret nobody
+ *                saw, drop it and time the new one
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none if interrupts are on (boot path)
+ */
+void irqsoff_entry(void) {
+#ifdef IRQSOFF_PROFILE
+    if (read_eflags() & EFLAGS_IF) {
+        return;
+    }
+    irqsoff_off(&irqsoff_entry_site);
+#endif
+}
+
+/*
+ * irqsoff_exit
+ *   DESCRIPTION: About to iret, which turns interrupts back on
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none if interrupts are on
+ */
+void irqsoff_exit(void) {
+#ifdef IRQSOFF_PROFILE
+    if (read_eflags() & EFLAGS_IF) {
+        return;
+    }
+    irqsoff_on();
+#endif
+}
+
+/*
+ * irqsoff_field
+ *   DESCRIPTION: Appends a number and a separator to a line
+ *   INPUTS: line -- line being built, value -- number to print,
+ *           sep -- character after it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: line must have room for 11 more characters
+ */
+static void irqsoff_field(int8_t* line, uint32_t value, int8_t sep) {
+    int8_t* end = line + strlen(line);
+
+    itoa(value, end, 10);
+    end += strlen(end);
+    end[0] = sep;
+    end[1] = '\0';
+}
+
+/*
+ * irqsoff_read
+ *   DESCRIPTION: Writes a header naming the buckets, then
+ *                "file:line count max b0 ... b7" for every site, in TSC
+ *                cycles
+ *   INPUTS: buf -- destination, nbytes -- its size
+ *   OUTPUTS: the text, not NUL terminated
+ *   RETURN VALUE: bytes written, lines that do not fit are left out
+ *   SIDE EFFECTS: none
+ */
+int32_t irqsoff_read(uint8_t* buf, int32_t nbytes) {
+    int8_t line[IRQSOFF_LINE];
+    int32_t len, written = 0;
+    irqsoff_site* site;
+    const int8_t* file;
+    int i, j;
+
+    for (i = -1; i < num_irqsoff_sites; i++) {
+        if (i < 0) {
+            strcpy(line, (int8_t*) "site count max");
+            for (j = 0; j < IRQSOFF_BUCKETS; j++) {
+                len = strlen(line);
+                line[len] = ' ';
+                strcpy(line + len + 1, (int8_t*) irqsoff_buckets[j]);
+            }
+            len = strlen(line);
+            line[len] = '\n';
+            line[len + 1] = '\0';
+        } else {
+            site = irqsoff_sites[i];
+            file = (const int8_t*) site->file;
+            len = strlen(file);
+            if (len > IRQSOFF_LINE / 4) {
+                file += len - IRQSOFF_LINE / 4;     // keep the end of long paths
+            }
+            strcpy(line, file);
+            len = strlen(line);
+            line[len] = ':';
+            line[len + 1] = '\0';
+            irqsoff_field(line, site->line, ' ');
+            irqsoff_field(line, site->count, ' ');
+            irqsoff_field(line, site->max_cycles, ' ');
+            for (j = 0; j < IRQSOFF_BUCKETS; j++) {
+                irqsoff_field(line, site->hist[j], (j == IRQSOFF_BUCKETS - 1) ? '\n' : ' ');
+            }
+        }
+
+        len = strlen(line);
+        if (written + len > nbytes) {
+            break;
+        }
+        memcpy(buf + written, line, len);
+        written += len;
+    }
+    return written;
+}
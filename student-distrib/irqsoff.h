@@ -0,0 +1,69 @@
+/* irqsoff.h - Profiler of the time interrupts stay disabled, per call
+ * site of cli/cli_and_save
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _IRQSOFF_H
+#define _IRQSOFF_H
+
+#include "types.h"
+
+/* Time every interrupts-off window with the TSC. Off by default: the hooks
+ * add a pushfl, an rdtsc and a site update to every cli/sti/cli_and_save/
+ * restore_flags, which lengthens the windows they time. Uncomment (or build
+ * with -DIRQSOFF_PROFILE) to profile */
+/* #define IRQSOFF_PROFILE */
+
+#define MAX_IRQSOFF_SITES   64
+#define IRQSOFF_BUCKETS     8           // < 1K, < 4K, ... < 4M, >= 4M cycles
+#define IRQSOFF_LINE        160         // file:line, count, max and the buckets
+
+/* One place that turns interrupts off. Declared static by the macros in
+ * lib.h, listed on its first window */
+typedef struct irqsoff_site {
+    const char* file;
+    int line;
+    uint32_t count;                     // windows started here
+    uint32_t max_cycles;                // longest one
+    uint32_t hist[IRQSOFF_BUCKETS];     // power of 4 buckets from 1024 cycles
+    int listed;
+} irqsoff_site;
+
+/* Pseudo site of windows opened by an interrupt gate (IRQ, exception or
+ * system call entry) */
+extern irqsoff_site irqsoff_entry_site;
+
+#ifdef IRQSOFF_PROFILE
+
+/* A site for the current file and line, one static per expansion */
+#define IRQSOFF_SITE()                                                  \
+({                                                                      \
+    static irqsoff_site __irqsoff_site = { __FILE__, __LINE__ };        \
+    &__irqsoff_site;                                                    \
+})
+
+#define irqsoff_hook_off()      irqsoff_off(IRQSOFF_SITE())
+#define irqsoff_hook_on()       irqsoff_on()
+
+#else
+
+#define irqsoff_hook_off()      do { } while (0)
+#define irqsoff_hook_on()       do { } while (0)
+
+#endif /* IRQSOFF_PROFILE */
+
+/* Interrupts were on and are going off here */
+void irqsoff_off(irqsoff_site* site);
+
+/* Interrupts were off and are going on */
+void irqsoff_on(void);
+
+/* Kernel entry / exit through an interrupt gate, see lock_kernel */
+void irqsoff_entry(void);
+
+void irqsoff_exit(void);
+
+/* Formats the per-site table as text, one site per line */
+int32_t irqsoff_read(uint8_t* buf, int32_t nbytes);
+
+#endif /* _IRQSOFF_H */
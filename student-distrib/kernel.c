@@ -22,6 +22,14 @@
 #include "system_calls.h"
 #include "pcb.h"
 #include "scheduling.h"
+#include "apic.h"
+#include "smp.h"
+#include "workqueue.h"
+#include "sysenter.h"
+#include "vdso.h"
+#include "clock.h"
+#include "timer.h"
+#include "serial.h"
 
 
 // #define RUN_TESTS
@@ -303,18 +311,55 @@ void entry(unsigned long magic, unsigned long addr) {
         SET_IDT_ENTRY(idt[128], &ex_asm_handler_128);
     }
 
+    // Creating IDT entries for the local APIC timer and inter-processor interrupts
+    {
+        idt_desc_t the_idt_desc;
+        the_idt_desc.present        = 0x1; // the interrupt exists
+        the_idt_desc.dpl            = 0x0; // run in highest privilage level (level 0)
+        the_idt_desc.reserved0      = 0x0; // must stay 0
+        the_idt_desc.size           = 0x1; // type of interrupt here we use 0xF for a task
+        the_idt_desc.reserved1      = 0x1; // It is over the next 4 bits with size being 
+        the_idt_desc.reserved2      = 0x1; // being the high bit
+        the_idt_desc.reserved3      = 0x0; // If 0, this is classified as an interrupt, if 1 is classified as a exception
+        // reserved 4 is actually reserved - no need to modify
+        the_idt_desc.seg_selector   = KERNEL_CS; 
+        // place struct into the idt table
+        idt[LAPIC_TIMER_VECTOR] = the_idt_desc;
+        idt[RESCHED_VECTOR] = the_idt_desc;
+        idt[TLB_FLUSH_VECTOR] = the_idt_desc;
+        idt[SPURIOUS_VECTOR] = the_idt_desc;
+        // set the given IDT entry (first arg) to run the function (second arg)
+        SET_IDT_ENTRY(idt[LAPIC_TIMER_VECTOR], &ex_asm_handler_240);
+        SET_IDT_ENTRY(idt[RESCHED_VECTOR], &ex_asm_handler_241);
+        SET_IDT_ENTRY(idt[TLB_FLUSH_VECTOR], &ex_asm_handler_242);
+        SET_IDT_ENTRY(idt[SPURIOUS_VECTOR], &ex_asm_handler_255);
+    }
+
     /** Tell computer where the IDT is */
     lidt(idt_desc_ptr);
 
     /** Setup Paging functionality */
     setup_paging();
 
+    /* Find the local and I/O APICs in the BIOS tables */
+    mp_init();
+
+    /* Fast system call entry next to int 0x80 */
+    sysenter_init();
+
     /* Enable Devices */
     i8259_init();       // enable the PIC
+    irq_init();         // switch to the I/O APIC if there is one
     keyboard_init();    // enable the keyboard
     rtc_init();         // enable the RTC
+    serial_init();      // COM1 output for profiles and traces
     setup_pit();
 
+    /* TSC clock, then the time and PID pages of every program */
+    clock_init();
+    vdso_init();
+    timer_init();
+
     clear();
     /* Memory, filesystem, any other initialization stuff... */
     file_system_init(start_filesys);
@@ -330,7 +375,14 @@ void entry(unsigned long magic, unsigned long addr) {
     // clear(); // clearing page for clarity
 
     
-    execute((const uint8_t*)"shell");
+    sched_idle_init();
+
+    /* The boot path holds the kernel lock until it becomes the idle task,
+     * the other CPUs wait for it */
+    lock_kernel();
+    smp_init();
+    spawn_shell(0);
+    workqueue_init();
 
     #ifdef RUN_TESTS
         /* Run tests */
@@ -338,6 +390,7 @@ void entry(unsigned long magic, unsigned long addr) {
     #endif
         /* Execute the first program ("shell") ... */
 
-        /* Spin (nicely, so we don't chew up cycles) */
-        asm volatile (".1: hlt; jmp .1;");
+        /* Become the idle task, runs only when nothing else is runnable */
+        unlock_kernel();
+        cpu_idle();
 }
@@ -2,6 +2,9 @@
 #include "i8259.h"
 #include "terminal.h"
 #include "multiple_terminals.h"
+#include "scheduling.h"
+#include "softirq.h"
+#include "workqueue.h"
 
 #define CTRL_IDX                        0
 #define ALT_IDX                         1
@@ -40,6 +43,26 @@ static int num_t1 = 1;
 static int num_t2 = 0;
 static int num_t3 = 0;
 
+/* Scancodes read by the interrupt, not yet processed by keyboard_tasklet.
+ * One producer (the IRQ) and one consumer (the tasklet), head and tail are
+ * each written by one side only */
+static volatile uint8_t scan_queue[SCAN_QUEUE_SIZE];
+static volatile uint32_t scan_head = 0;        // next one to process
+static volatile uint32_t scan_tail = 0;        // next free slot
+static uint32_t scans_dropped = 0;
+
+static void keyboard_tasklet_fn(uint32_t data);
+static void keyboard_process(uint8_t scan);
+static tasklet_t keyboard_tasklet = TASKLET_INIT(keyboard_tasklet_fn, 0);
+
+/* Loading a terminal's first shell reads the file system, the worker pool
+ * does it instead of the tasklet */
+static void spawn_shell_work(uint32_t term_idx);
+static work_t shell_work[2] = {
+    WORK_INIT(spawn_shell_work, 1),     // terminal 2
+    WORK_INIT(spawn_shell_work, 2)      // terminal 3
+};
+
 /* Unused */
 void enable_scanning(void){
     outb(CMD_SCAN, KEYBOARD_PORT);
@@ -64,22 +87,57 @@ void keyboard_init(void){
 
 /* void keyboard_handler(void)
  * DESCRIPTION: keyboard interrupt handler that is called whenever a key is pressed on the keyboard.
- *              Reads from keyboard port (0x60), and converts packet (Scan code) into character to be echoed to screen. 
- *              Processes only alphanumeric characters and function keys (shift, alt, caps lock, backspace, tab).    
- *              
+ *              Only reads the scan code from the keyboard port (0x60) and queues it, keyboard_tasklet
+ *              echoes it once the interrupt is acknowledged and interrupts are back on.
  * INPUTS: None
  * OUTPUTS: None
- * SIDE EFFECTS: Echoes a character to the screen, sets and resets flags in flag array.
+ * SIDE EFFECTS: Scan codes arriving while SCAN_QUEUE_SIZE are waiting are dropped.
  * 
 */
 void keyboard_handler(void){
 
-    /*Save flags and disable interrupts*/
-    //unsigned int flag;
-    //cli_and_save(flag);
-
     /*read from keyboard port*/
-    uint32_t scan = inb(KEYBOARD_PORT);
+    uint8_t scan = inb(KEYBOARD_PORT);
+
+    if (scan_tail - scan_head < SCAN_QUEUE_SIZE) {
+        scan_queue[scan_tail % SCAN_QUEUE_SIZE] = scan;
+        scan_tail++;
+    } else {
+        scans_dropped++;
+    }
+
+    /*signal to the pic that the interrupt is over*/
+    send_eoi(1);
+
+    tasklet_schedule(&keyboard_tasklet);
+}
+
+/* void keyboard_tasklet_fn(uint32_t data)
+ * DESCRIPTION: bottom half of the keyboard interrupt, processes every queued scan code.
+ * INPUTS: data, unused
+ * OUTPUTS: None
+ * SIDE EFFECTS: see keyboard_process. A reader woken by enter runs when the bottom halves are done.
+*/
+static void keyboard_tasklet_fn(uint32_t data){
+    while (scan_head != scan_tail) {
+        keyboard_process(scan_queue[scan_head % SCAN_QUEUE_SIZE]);
+        scan_head++;
+    }
+
+    /*a reader woken by enter runs now instead of after the current slice*/
+    preempt_wakeup();
+}
+
+/* void keyboard_process(uint8_t scan)
+ * DESCRIPTION: converts packet (Scan code) into character to be echoed to screen. 
+ *              Processes only alphanumeric characters and function keys (shift, alt, caps lock, backspace, tab).    
+ *              
+ * INPUTS: scan, scan code read by keyboard_handler
+ * OUTPUTS: None
+ * SIDE EFFECTS: Echoes a character to the screen, sets and resets flags in flag array.
+ * 
+*/
+static void keyboard_process(uint8_t scan){
 
     /*variable to store character to print*/
     unsigned int display_character;
@@ -131,9 +189,8 @@ void keyboard_handler(void){
         switch_terminals(2);
         // setup_4kb_page(0xba000, 0xb8000, 1);
         if (num_t2 == 1) {
-            send_eoi(1);
             // cli();
-            execute((uint8_t*)"shell");
+            queue_work(&shell_work[0]);
         }
     }
     else if(special_flags[ALT_IDX] && scan == SCAN_F3){
@@ -143,9 +200,8 @@ void keyboard_handler(void){
         switch_terminals(3);
         // setup_4kb_page(0xbb000, 0xb8000, 1);
         if (num_t3 == 1) {
-            send_eoi(1);
             // cli();
-            execute((uint8_t*)"shell");
+            queue_work(&shell_work[1]);
         }
     }
     /*run through cases of all other characters to print*/
@@ -286,13 +342,16 @@ void keyboard_handler(void){
 
     /*only print if scancode is within bounds (temporary)*/
     // uint32_t key = inb(0x60);   //read scan code from keyboard
+}
 
-    /*enable interrupts*/
-    //restore_flags(flag);
-
-    /*signal to the pic that the interrupt is over*/
-    send_eoi(1);
-    
+/* void spawn_shell_work(uint32_t term_idx)
+ * DESCRIPTION: work item that starts the base shell of a terminal opened for the first time.
+ * INPUTS: term_idx, 0-based terminal
+ * OUTPUTS: None
+ * SIDE EFFECTS: see spawn_shell, runs in a kworker thread.
+*/
+static void spawn_shell_work(uint32_t term_idx){
+    spawn_shell(term_idx);
 }
 
 int get_num_t2() {
@@ -13,6 +13,9 @@
 #define RESEND          0xFE
 #define CMD_SCAN        0xF4
 
+/* Scan codes the interrupt can queue before keyboard_tasklet runs, power of 2 */
+#define SCAN_QUEUE_SIZE 32
+
 
 /*send command to keyboard to enable scanning*/
 void enable_scanning(void);
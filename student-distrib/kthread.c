@@ -0,0 +1,112 @@
+/* kthread.c - Kernel threads: tasks with a kernel stack, the kernel page
+ * directory and no terminal files, scheduled like processes
+ * vim:ts=4 noexpandtab
+ */
+
+#include "kthread.h"
+#include "lib.h"
+#include "pcb.h"
+#include "paging.h"
+#include "scheduling.h"
+
+/*
+ * kthread_main
+ *   DESCRIPTION: First code of every kernel thread, switch_to returns
+ *                here with the arguments kthread_create left on the stack
+ *   INPUTS: fn -- thread body, data -- its argument
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: enables interrupts. Keeps the kernel lock it was
+ *                 switched to with, kernel threads never leave the kernel
+ */
+static void kthread_main(kthread_fn fn, uint32_t data) {
+    sti();
+    fn(data);
+    kthread_exit();
+}
+
+/*
+ * kthread_create
+ *   DESCRIPTION: Takes the lowest free process slot and makes fn(data)
+ *                runnable in it at DEFAULT_PRIO
+ *   INPUTS: fn -- thread body, data -- its argument
+ *           name -- shown by sched_stat, cut to TASK_COMM_LEN - 1
+ *   OUTPUTS: none
+ *   RETURN VALUE: PID of the thread, -1 if the process table is full
+ *   SIDE EFFECTS: queues the thread on the calling CPU
+ */
+int32_t kthread_create(kthread_fn fn, uint32_t data, const int8_t* name) {
+    uint32_t flags;
+    uint32_t* sp;
+    int pid = -1;
+    int i;
+
+    cli_and_save(flags);
+    for (i = 0; i < MAX_PROCESSES; i++) {
+        if (pcb_array[i].state == TASK_UNUSED) {
+            pid = i;
+            break;
+        }
+    }
+    if (pid < 0) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    /* No parent, no files, prints go to terminal 1 like the idle task */
+    pcb_array[pid].parent_pcb_pid = -1;
+    pcb_array[pid].terminal_idx = 0;
+    pcb_array[pid].waiting_child = -1;
+    pcb_array[pid].exit_status = 0;
+    for (i = 0; i < 8; i++) {           // 8 elements in the fd_array
+        pcb_array[pid].fd_array[i].flags = 0;
+    }
+    pcb_array[pid].kthread = 1;
+    strncpy(pcb_array[pid].comm, name, TASK_COMM_LEN - 1);
+    pcb_array[pid].comm[TASK_COMM_LEN - 1] = '\0';
+    sched_task_init(pid);
+
+    /* switch_to pops the registers and returns into kthread_main(fn, data) */
+    sp = (uint32_t*) KERNEL_STACK_TOP(pid);
+    *--sp = data;
+    *--sp = (uint32_t) fn;
+    *--sp = 0;                          // return address of kthread_main, never used
+    *--sp = (uint32_t) kthread_main;
+    *--sp = 0;                          // ebp
+    *--sp = 0;                          // ebx
+    *--sp = 0;                          // esi
+    *--sp = 0;                          // edi
+
+    pcb_array[pid].ctx.esp = (uint32_t) sp;
+    pcb_array[pid].ctx.esp0 = KERNEL_STACK_TOP(pid);
+    pcb_array[pid].ctx.cr3 = (uint32_t) page_directory;     // kernel only mappings
+
+    /* Runs inside the kernel from the start, with the lock of whoever switches to it */
+    pcb_array[pid].lock_depth = 1;
+
+    enqueue_task(pid);
+    restore_flags(flags);
+    return pid;
+}
+
+/*
+ * kthread_exit
+ *   DESCRIPTION: Frees the calling kernel thread's slot and switches away
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: the slot (and this kernel stack) is only reused after
+ *                 the switch, interrupts stay off until then
+ */
+void kthread_exit(void) {
+    int pid = get_global_pid();
+
+    cli();
+    preempt_disable();
+
+    dequeue_task(pid);
+    pcb_array[pid].kthread = 0;
+    pcb_array[pid].state = TASK_UNUSED;
+
+    scheduling_context_switch(schedule());
+}
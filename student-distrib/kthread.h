@@ -0,0 +1,20 @@
+/* kthread.h - Kernel threads: scheduled tasks that only have a kernel
+ * stack and run kernel code
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _KTHREAD_H
+#define _KTHREAD_H
+
+#include "types.h"
+
+/* Body of a kernel thread, the thread exits when it returns */
+typedef void (*kthread_fn)(uint32_t data);
+
+/* Starts fn(data) as a runnable task named name, takes a process slot */
+int32_t kthread_create(kthread_fn fn, uint32_t data, const int8_t* name);
+
+/* Ends the calling kernel thread */
+void kthread_exit(void);
+
+#endif /* _KTHREAD_H */
@@ -36,10 +36,8 @@ static char* video_mem = (char *)VIDEO;
 //static int terminal_number = 1; // current terminal being displayed
 
 
-//char video_mem_t1[4096];
-static char* video_mem_t1 = (char *)VIDEO_T1;
-static char* video_mem_t2 = (char *)VIDEO_T2;
-static char* video_mem_t3 = (char *)VIDEO_T3;
+/* Terminal text is drawn through get_term_video(), which picks VGA memory
+ * for the displayed terminal and the VIDEO_T* backing page otherwise */
 
 /* void clear(void);
  * Inputs: void
@@ -51,22 +49,22 @@ void clear(void) {
     int32_t i;
     char* clear_mem_loc;
     int tid = get_term_num();
-    clear_mem_loc = video_mem_t1;
+    clear_mem_loc = get_term_video(1);
     switch(tid){
         case 1:
-            clear_mem_loc = video_mem_t1;
+            clear_mem_loc = get_term_video(1);
             screen_x_t1 = 0;
             screen_y_t1 = 0;
             ATTRIB = ATTRIB_1;
             break;
         case 2:
-            clear_mem_loc = video_mem_t2;
+            clear_mem_loc = get_term_video(2);
             screen_x_t2 = 0;
             screen_y_t2 = 0;
             ATTRIB = ATTRIB_2;
             break;
         case 3:
-            clear_mem_loc = video_mem_t3;
+            clear_mem_loc = get_term_video(3);
             screen_x_t3 = 0;
             screen_y_t3 = 0;
             ATTRIB = ATTRIB_3;
@@ -78,9 +76,6 @@ void clear(void) {
         *(uint8_t *)(clear_mem_loc + (i << 1)) = ' ';
         *(uint8_t *)(clear_mem_loc + (i << 1) + 1) = ATTRIB;
     }
-    // cli();
-    memcpy(video_mem, clear_mem_loc,  NUM_ROWS * NUM_COLS * 2);
-    // sti();
 
     //memcpy(video_mem, video_mem_t1, NUM_ROWS*NUM_COLS*2);
     //!set to specific terminal?
@@ -239,22 +234,22 @@ int32_t puts(int8_t* s) {
 void put_display_text(uint8_t c) {
     char* cur_term_loc;
     int tid = get_pcb_pid(get_global_pid()).terminal_idx + 1; // get_term_num();
-    cur_term_loc = video_mem_t1;
+    cur_term_loc = get_term_video(1);
     switch(tid){
         case 1:
-            cur_term_loc = video_mem_t1;
+            cur_term_loc = get_term_video(1);
             screen_x = screen_x_t1;
             screen_y = screen_y_t1;
             ATTRIB = ATTRIB_1;
             break;
         case 2:
-            cur_term_loc = video_mem_t2;
+            cur_term_loc = get_term_video(2);
             screen_x = screen_x_t2;
             screen_y = screen_y_t2;
             ATTRIB = ATTRIB_2;
             break;
         case 3:
-            cur_term_loc = video_mem_t3;
+            cur_term_loc = get_term_video(3);
             screen_x = screen_x_t3;
             screen_y = screen_y_t3;
             ATTRIB = ATTRIB_3;
@@ -316,9 +311,6 @@ void put_display_text(uint8_t c) {
         default:
             break;
     }
-    // cli();
-    memcpy(video_mem, cur_term_loc,  NUM_ROWS * NUM_COLS * 2);
-    // sti();
     update_cursor();
     // sti();
 }
@@ -339,23 +331,23 @@ void putc_term(uint8_t c, int loc) {
     char* cur_term_loc;
     int tid;
     tid = loc + 1;
-    cur_term_loc = video_mem_t1;
+    cur_term_loc = get_term_video(1);
     /* Get current terminal position */
     switch(tid){
         case 1:
-            cur_term_loc = video_mem_t1;
+            cur_term_loc = get_term_video(1);
             screen_x = screen_x_t1;
             screen_y = screen_y_t1;
             ATTRIB = ATTRIB_1;
             break;
         case 2:
-            cur_term_loc = video_mem_t2;
+            cur_term_loc = get_term_video(2);
             screen_x = screen_x_t2;
             screen_y = screen_y_t2;
             ATTRIB = ATTRIB_2;
             break;
         case 3:
-            cur_term_loc = video_mem_t3;
+            cur_term_loc = get_term_video(3);
             screen_x = screen_x_t3;
             screen_y = screen_y_t3;
             ATTRIB = ATTRIB_3;
@@ -457,23 +449,23 @@ void putc(uint8_t c) {
     char* cur_term_loc;
     int tid;
     tid = get_term_num();
-    cur_term_loc = video_mem_t1;
+    cur_term_loc = get_term_video(1);
     /* Get current terminal position */
     switch(tid){
         case 1:
-            cur_term_loc = video_mem_t1;
+            cur_term_loc = get_term_video(1);
             screen_x = screen_x_t1;
             screen_y = screen_y_t1;
             ATTRIB = ATTRIB_1;
             break;
         case 2:
-            cur_term_loc = video_mem_t2;
+            cur_term_loc = get_term_video(2);
             screen_x = screen_x_t2;
             screen_y = screen_y_t2;
             ATTRIB = ATTRIB_2;
             break;
         case 3:
-            cur_term_loc = video_mem_t3;
+            cur_term_loc = get_term_video(3);
             screen_x = screen_x_t3;
             screen_y = screen_y_t3;
             ATTRIB = ATTRIB_3;
@@ -549,8 +541,6 @@ void putc(uint8_t c) {
         default:
             break;
     }
-    // cli();
-    memcpy(video_mem, cur_term_loc,  NUM_ROWS * NUM_COLS * 2);
     update_cursor();
     // sti();
 }
@@ -6,6 +6,7 @@
 #define _LIB_H
 
 #include "types.h"
+#include "irqsoff.h"
 #include "terminal.h"
 #include "pcb.h"
 #include "system_calls.h"
@@ -116,15 +117,46 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* Reads EFLAGS, IF (EFLAGS_IF) tells whether interrupts are on */
+static inline uint32_t read_eflags(void) {
+    uint32_t flags;
+    asm volatile ("                   \n\
+            pushfl                    \n\
+            popl %0                   \n\
+            "
+            : "=r"(flags)
+            :
+            : "memory"
+    );
+    return flags;
+}
+
+/* With IRQSOFF_PROFILE the macros below also tell irqsoff.c when
+ * interrupts actually change state, nested uses cost one flag test */
+
 /* Clear interrupt flag - disables interrupts on this processor */
+#ifdef IRQSOFF_PROFILE
 #define cli()                           \
 do {                                    \
+    uint32_t __was = read_eflags();     \
     asm volatile ("cli"                 \
             :                           \
             :                           \
             : "memory", "cc"            \
     );                                  \
+    if (__was & EFLAGS_IF)              \
+        irqsoff_hook_off();             \
 } while (0)
+#else
+#define cli()                           \
+do {                                    \
+    asm volatile ("cli"                 \
+            :                           \
+            :                           \
+            : "memory", "cc"            \
+    );                                  \
+} while (0)
+#endif
 
 /* Save flags and then clear interrupt flag
  * Saves the EFLAGS register into the variable "flags", and then
@@ -140,9 +172,23 @@ do {                                    \
             :                           \
             : "memory", "cc"            \
     );                                  \
+    if ((flags) & EFLAGS_IF)            \
+        irqsoff_hook_off();             \
 } while (0)
 
 /* Set interrupt flag - enable interrupts on this processor */
+#ifdef IRQSOFF_PROFILE
+#define sti()                           \
+do {                                    \
+    if (!(read_eflags() & EFLAGS_IF))   \
+        irqsoff_hook_on();              \
+    asm volatile ("sti"                 \
+            :                           \
+            :                           \
+            : "memory", "cc"            \
+    );                                  \
+} while (0)
+#else
 #define sti()                           \
 do {                                    \
     asm volatile ("sti"                 \
@@ -151,10 +197,29 @@ do {                                    \
             : "memory", "cc"            \
     );                                  \
 } while (0)
+#endif
 
 /* Restore flags
  * Puts the value in "flags" into the EFLAGS register.  Most often used
  * after a cli_and_save_flags(flags) */
+#ifdef IRQSOFF_PROFILE
+#define restore_flags(flags)            \
+do {                                    \
+    uint32_t __now = read_eflags();     \
+    if (((flags) & ~__now) & EFLAGS_IF) \
+        irqsoff_hook_on();              \
+    asm volatile ("                   \n\
+            pushl %0                  \n\
+            popfl                     \n\
+            "                           \
+            :                           \
+            : "r"(flags)                \
+            : "memory", "cc"            \
+    );                                  \
+    if ((__now & ~(flags)) & EFLAGS_IF) \
+        irqsoff_hook_off();             \
+} while (0)
+#else
 #define restore_flags(flags)            \
 do {                                    \
     asm volatile ("                   \n\
@@ -166,5 +231,6 @@ do {                                    \
             : "memory", "cc"            \
     );                                  \
 } while (0)
+#endif
 
 #endif /* _LIB_H */
@@ -1,4 +1,6 @@
 #include "multiple_terminals.h"
+#include "scheduling.h"
+#include "smp.h"
 
 #define VIDEO       0xB8000
 #define VIDEO_T1     0xB9000
@@ -17,6 +19,101 @@ static char* video_mem_t3 = (char *)VIDEO_T3;
 
 static int terminal_array[3] = {-1, -1, -1};
 
+static char* get_term_backing(int term_num);
+
+/* User virtual address of each terminal's vidmap page, and whether it is mapped */
+static uint32_t vidmap_va[3] = {0xF0000000, 0xEFFFE000, 0xEFFFC000};
+static int vidmap_mapped[3] = {0, 0, 0};
+
+/*
+ * get_term_video
+ *   DESCRIPTION: Where a terminal's text lives right now. The displayed
+ *                terminal draws straight into VGA memory, the others into
+ *                their backing page, so nothing is copied per tick
+ *   INPUTS: term_num -- terminal (1-3)
+ *   OUTPUTS: none
+ *   RETURN VALUE: video memory pointer for the terminal
+ *   SIDE EFFECTS: none
+ */
+char* get_term_video(int term_num) {
+    if (term_num == terminal_number) {
+        return video_mem;
+    }
+    return get_term_backing(term_num);
+}
+
+/*
+ * get_term_backing
+ *   DESCRIPTION: Backing page holding a terminal's text while hidden
+ *   INPUTS: term_num -- terminal (1-3)
+ *   OUTPUTS: none
+ *   RETURN VALUE: backing page pointer
+ *   SIDE EFFECTS: none
+ */
+static char* get_term_backing(int term_num) {
+    switch (term_num) {
+        case 2:
+            return video_mem_t2;
+        case 3:
+            return video_mem_t3;
+        default:
+            return video_mem_t1;
+    }
+}
+
+/*
+ * remap_term_vidmap
+ *   DESCRIPTION: Points a terminal's vidmap page at get_term_video()
+ *   INPUTS: term_num -- terminal (1-3)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: flushes the page's TLB entry on every CPU (vidmap pages are global)
+ */
+static void remap_term_vidmap(int term_num) {
+    uint32_t va = vidmap_va[term_num - 1];
+
+    if (!vidmap_mapped[term_num - 1]) {
+        return;
+    }
+    setup_4kb_page((uint32_t) get_term_video(term_num), va, 1);
+    asm volatile ("invlpg (%0)" : : "r" (va) : "memory");
+    smp_flush_tlb_others();     // the program may be running on another CPU
+}
+
+/*
+ * map_term_vidmap
+ *   DESCRIPTION: Maps a terminal's video memory for user programs (vidmap)
+ *   INPUTS: term_num -- terminal (1-3)
+ *   OUTPUTS: none
+ *   RETURN VALUE: user virtual address of the page
+ *   SIDE EFFECTS: page follows the terminal across terminal switches
+ */
+uint32_t map_term_vidmap(int term_num) {
+    vidmap_mapped[term_num - 1] = 1;
+    remap_term_vidmap(term_num);
+    return vidmap_va[term_num - 1];
+}
+
+/*
+ * unmap_term_vidmap
+ *   DESCRIPTION: Removes a terminal's vidmap page when its program halts
+ *   INPUTS: term_num -- terminal (1-3)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: flushes the page's TLB entry on every CPU
+ */
+void unmap_term_vidmap(int term_num) {
+    uint32_t va = vidmap_va[term_num - 1];
+
+    if (!vidmap_mapped[term_num - 1]) {
+        return;
+    }
+    vidmap_mapped[term_num - 1] = 0;
+    vid_mem_page_table[(va >> 12) & 0x3FF].present = 0;     // 0x3FF: page table index bits
+    asm volatile ("invlpg (%0)" : : "r" (va) : "memory");
+    smp_flush_tlb_others();
+}
+
 // if any initialization needs to be done, it can be done here
 void terminal_init() {
     return;
@@ -28,6 +125,15 @@ int switch_terminals (int term_num) {
     if (term_num < 1 || term_num > 3) {
         return -1;
     }
+    if (term_num == terminal_number) {
+        return 0;
+    }
+
+    /* Only the displayed terminal lives in VGA memory, save it to its backing page */
+    int old_term = terminal_number;
+    uint32_t flags;
+    spin_lock_irqsave(&tty_lock, flags);
+    memcpy(get_term_backing(old_term), video_mem, NUM_ROWS * NUM_COLS * 2);
     
     // call paging function that points video memory to repective terminal address
     if (term_num == 1) {
@@ -57,6 +163,15 @@ int switch_terminals (int term_num) {
         //!need to restore cursor position and screen x y
         // term_3_display();
     }
+
+    /* User programs drawing through vidmap follow their terminal */
+    remap_term_vidmap(old_term);
+    remap_term_vidmap(term_num);
+
+    /* The foreground boost moves with the display */
+    sched_fg_changed();
+    spin_unlock_irqrestore(&tty_lock, flags);
+
     // update_cursor();
     return 0;
 }
@@ -20,6 +20,12 @@ int term_3_display(void);
 
 int get_term_num(void);
 
+char* get_term_video(int term_num);
+
+uint32_t map_term_vidmap(int term_num);
+
+void unmap_term_vidmap(int term_num);
+
 void set_term_num(int term_num);
 
 // buffer that holds the value of terminal 1 data
@@ -1,7 +1,13 @@
 #include "paging.h"
+#include "pcb.h"
+#include "vdso.h"
 #define page_directory_size 1024
 #define page_table_size 1024
 
+/* One page directory per task: kernel mappings copied from page_directory,
+ * plus the task's own 4 MB program page at 128 MB */
+static struct pd_entry process_page_directory[NUM_TASKS][page_directory_size] __attribute__((aligned(4096)));
+
 /*
     the contents of page_directory and the page table need to be specific values
     depending on the flags https://wiki.osdev.org/Setting_Up_Paging read the
@@ -205,6 +211,41 @@ uint32_t execute_page_setup(int phys_address_mb){
     return 1;   // success
 }
 
+/* uint32_t process_page_setup(int pid, int phys_address_mb)
+ * DESCRIPTION: Builds the page directory of a task from the kernel template (page_directory)
+ *              and maps its 4 MB program page at 128 MB to phys_address_mb, and the vdso pages.
+ * INPUTS: int pid, task owning the directory
+ *         int phys_address_mb, physical address of the program page (MB)
+ * OUTPUTS: None
+ * SIDE EFFECTS: overwrites the task's page directory, does not load it
+ * RETURN: value to load into CR3, 0 if failure from incorrect input.
+*/
+uint32_t process_page_setup(int pid, int phys_address_mb){
+
+    //input validation
+    if(pid < 0 || pid >= NUM_TASKS){
+        return 0;
+    }
+    if((phys_address_mb % 4) != 0 || phys_address_mb < 8){
+        return 0;
+    }
+
+    struct pd_entry* dir = process_page_directory[pid];
+    memcpy(dir, page_directory, sizeof(page_directory));
+
+    // program page at 128 MB (directory index 32)
+    dir[32] = dir[1];
+    dir[32].pd_entry_union.MB.present = 1;
+    dir[32].pd_entry_union.MB.user_supervisor = 1; // should be set high for privilege level
+    dir[32].pd_entry_union.MB.global_page = 0;
+    dir[32].pd_entry_union.MB.page_base_address = phys_address_mb/4;
+
+    // time and PID pages at VDSO_VA, read only
+    vdso_map(pid, dir);
+
+    return (uint32_t) dir;
+}
+
 /* uint32_t setup_4kb_page(uint32_t phys_address, uint32_t va, uint32_t present_status)
  * DESCRIPTION: sets up a 4kb page in virtual memory to point to physical video memory.
  * INPUTS: uint32_t phys_address, the physical address of video memory, 
@@ -239,6 +280,12 @@ uint32_t setup_4kb_page(uint32_t phys_address, uint32_t va, uint32_t present_sta
     /*shift out bottom 12 bits to get 20 msb of physical address of page table.*/
     page_directory[page_directory_index].pd_entry_union.kB.pt_base_address = ((uint32_t)vid_mem_page_table) >> 12;
 
+    /*the page table is shared, every task's directory gets the same entry*/
+    int i;
+    for(i = 0; i < NUM_TASKS; i++){
+        process_page_directory[i][page_directory_index] = page_directory[page_directory_index];
+    }
+
     // Set up a page table entry
     /*12, 0x3FF: isolate middle 10 bits to get index into page table*/
     uint32_t page_table_index = (va >> 12) & 0x3FF;
@@ -259,3 +306,51 @@ uint32_t setup_4kb_page(uint32_t phys_address, uint32_t va, uint32_t present_sta
     return 0;
 }
 
+
+/* uint32_t map_mmio_4mb(uint32_t phys_address)
+ * DESCRIPTION: identity maps the 4 MB page holding a device's registers (local APIC),
+ *              uncached, for the kernel in the template and every task's directory
+ * INPUTS: uint32_t phys_address, physical address of the registers
+ * OUTPUTS: None
+ * SIDE EFFECTS: flushes the TLB
+ * RETURN: phys_address, usable as a kernel pointer from now on
+*/
+uint32_t map_mmio_4mb(uint32_t phys_address){
+    /*22 = isolate the 10 MSB of the address to get index into pd*/
+    uint32_t page_directory_index = phys_address >> 22;
+    int i;
+
+    // same flags as the kernel page, but device registers must not be cached
+    page_directory[page_directory_index] = page_directory[1];
+    page_directory[page_directory_index].pd_entry_union.MB.write_through = 1;
+    page_directory[page_directory_index].pd_entry_union.MB.cache_disabled = 1;
+    page_directory[page_directory_index].pd_entry_union.MB.page_base_address = page_directory_index;
+
+    for(i = 0; i < NUM_TASKS; i++){
+        process_page_directory[i][page_directory_index] = page_directory[page_directory_index];
+    }
+    flush_tlbs();
+
+    return phys_address;
+}
+
+/* void map_low_memory(uint32_t present_status)
+ * DESCRIPTION: maps or unmaps the first 4 MB page by page, so the kernel can read the
+ *              BIOS tables and place the AP trampoline at boot. Video memory stays mapped.
+ * INPUTS: uint32_t present_status, 1 to map, 0 to go back to video memory only
+ * OUTPUTS: None
+ * SIDE EFFECTS: NULL pointers do not fault while mapped. Flushes the TLB
+ * RETURN: None
+*/
+void map_low_memory(uint32_t present_status){
+    int j;
+
+    for(j = 0; j < page_table_size; j++){
+        // 184 - 187: video memory and the terminal buffers, see setup_paging
+        if (j >= 184 && j <= 187) {
+            continue;
+        }
+        page_table[j].present = present_status;
+    }
+    flush_tlbs();
+}
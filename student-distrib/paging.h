@@ -69,7 +69,10 @@ typedef struct __attribute__((packed)) pt_entry {
 // function which sets up paging, including 4 kB and 4 MB pages at correct locations
 extern void setup_paging(); 
 extern uint32_t execute_page_setup(int phys_address_mb);
+extern uint32_t process_page_setup(int pid, int phys_address_mb);
 extern uint32_t setup_4kb_page(uint32_t phys_address, uint32_t va, uint32_t present_status);
+extern uint32_t map_mmio_4mb(uint32_t phys_address);
+extern void map_low_memory(uint32_t present_status);
 
 // array of page directory entries. length is 1024 because there are 10 bits for the page directory number
 // and 2^10 = 1024. Aligned to 4096 so that 12 LSBs are all 0.  
@@ -10,18 +10,11 @@
  * RETURN: 0 if pcb is initialized properly
 */
 // int pid = 0;
-struct pcb pcb_array[6];
+struct pcb pcb_array[NUM_TASKS];
 uint32_t init_pcb(int term_num, int parent_pcb_val, int global_pcb_val){
  
-    /* Set parent pcb */
-    // int a = pid;
-    // pid = a;
-    if(global_pcb_val == 0){
-        pcb_array[global_pcb_val].parent_pcb_pid = -1;
-    }
-    else{
-        pcb_array[global_pcb_val].parent_pcb_pid = parent_pcb_val;
-    }
+    /* Set parent pcb, -1 for a terminal's base shell */
+    pcb_array[global_pcb_val].parent_pcb_pid = parent_pcb_val;
     // printf("\nfinished parent node\n\n\n");
     // printf("pid: %d\n", pid);
     /* ================================= */
@@ -39,6 +32,7 @@ uint32_t init_pcb(int term_num, int parent_pcb_val, int global_pcb_val){
     pcb_array[global_pcb_val].fd_array[0].inode = 0;
     pcb_array[global_pcb_val].fd_array[0].file_position = 0;
     pcb_array[global_pcb_val].fd_array[0].flags = 1;
+    pcb_array[global_pcb_val].fd_array[0].read_timeout = 0;
 
     /* Set STDOUT */
     pcb_array[global_pcb_val].fd_array[1].ops.open = NULL;
@@ -48,6 +42,7 @@ uint32_t init_pcb(int term_num, int parent_pcb_val, int global_pcb_val){
     pcb_array[global_pcb_val].fd_array[1].inode = 0;
     pcb_array[global_pcb_val].fd_array[1].file_position = 0;
     pcb_array[global_pcb_val].fd_array[1].flags = 1;
+    pcb_array[global_pcb_val].fd_array[1].read_timeout = 0;
 
     // printf("\nfinished 0 and 1 node");
     // while(1);
@@ -58,6 +53,13 @@ uint32_t init_pcb(int term_num, int parent_pcb_val, int global_pcb_val){
         pcb_array[global_pcb_val].fd_array[i].flags = 0;
     }
     pcb_array[global_pcb_val].terminal_idx = term_num;
+    pcb_array[global_pcb_val].kthread = 0;
+    pcb_array[global_pcb_val].io_ring = NULL;
+    pcb_array[global_pcb_val].io_ring_flags = 0;
+
+    /* Not waiting on a child */
+    pcb_array[global_pcb_val].waiting_child = -1;
+    pcb_array[global_pcb_val].exit_status = 0;
 
     /* PCB intialized */
     return 0;
@@ -110,6 +112,9 @@ uint32_t clear_pcb(int pid_in){
         pcb_array[pid_in].fd_array[i].flags = 0;
     }
 
+    /* Files are not closed one by one, drop the task's virtual RTCs */
+    rtc_release(pid_in);
+
     /* PCB intialized */
     return 0;
 }
@@ -129,44 +134,47 @@ uint32_t pcb_valid(int pid_in, int32_t fd) {
     return -1;
 }
 
+/* uint32_t fd_read_timeout()
+ * DESCRIPTION: how long a read on one of the calling task's files may wait,
+ *              set by the read_timeout system call
+ * INPUTS: file descriptor
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: ticks, 0 to wait forever (also for bad fds or no task)
+*/
+uint32_t fd_read_timeout(int32_t fd) {
+    int pid = get_global_pid();
+
+    if (pid < 0 || pid >= MAX_PROCESSES || fd < 0 || fd >= 8) { // 8 elements in the fd_array
+        return 0;
+    }
+    return pcb_array[pid].fd_array[fd].read_timeout;
+}
+
 /* uint32_t user_level_program_loader(const uint8_t * filename)
  * DESCRIPTION: loads an executable into memory
  * INPUTS: file name of executable
  * OUTPUTS: copies bytes of program into memory
  * SIDE EFFECTS: writes to memory of where program begins execution
- * RETURN: 0 
+ * RETURN: 0 on success, -1 if the file does not exist
 */
 uint32_t user_level_program_loader(const uint8_t * filename){
 
     // create a dentry
     struct dentry_t program_to_load;
     
-    read_dentry_by_name(filename, &program_to_load);
-    // while(1);
-    uint32_t program_inode;
-    uint32_t length;
-    program_inode = program_to_load.inode_num;
-    length = 200000;
-    char buf[length]; // if this doesnt work just change length to be a very large number
-    uint32_t bytes_read;
-    //buf contains all program bytes
-    bytes_read = read_data(program_inode, 0, buf, length);
-    /*Copy program into 0x08000000*/
-    //!correct offset? Is this 0x08000000 or 0x08048000?
-    /*0x800000 + 0x48000;*/
-    uint32_t * dest = (uint32_t *) 0x08048000; // start of the program image
-    int i;
-    memcpy(dest,buf,bytes_read);
-    
-    uint32_t* file_address;
-    file_address = dest;
-    uint8_t char_at_address;  
-    for (i = 0; i < 28; i++) { // prints first 28 bytes
-        char_at_address = *file_address;
-        //printf("%x ", char_at_address);
-        file_address++;
+    if (read_dentry_by_name(filename, &program_to_load) == -1) {
+        return -1;
     }
 
+    /* Read the image straight into 0x08048000, the program page is already mapped
+     * by process_page_setup. Copying through a stack buffer would overrun the
+     * 8 kB kernel stack into the neighbouring tasks' stacks. */
+    uint32_t length = file_length(program_to_load.inode_num);
+    char * dest = (char *) 0x08048000; // start of the program image
+
+    read_data(program_to_load.inode_num, 0, dest, length);
+
     return 0;
 }
 
@@ -225,14 +233,12 @@ void set_pcb_flags(int pid_in, int file_num, int32_t flags_val) {
     pcb_array[pid_in].fd_array[file_num].flags = flags_val;
 }
 
+void set_pcb_read_timeout(int pid_in, int file_num, uint32_t ticks) {
+    pcb_array[pid_in].fd_array[file_num].read_timeout = ticks;
+}
+
 
 
-void set_pcb_esp(int in_pid, uint32_t esp_val) {
-    pcb_array[in_pid].esp = esp_val;
-}
-void set_pcb_ebp(int in_pid, uint32_t ebp_val) {
-    pcb_array[in_pid].ebp = ebp_val;
-}
 void set_pcb_eflags(int in_pid, uint32_t eflags_val) {
     pcb_array[in_pid].eflags = eflags_val;
 }
@@ -255,55 +261,6 @@ void set_pcb_cmd(int in_pid, uint8_t* cmd) {
     // }
 }
 
-/*
- * set_ebpesp
- * Description: set the esp and ebp fields of the pcb to values passed in
- * Inputs: ebp, esp passed in by caller
- * Outputs: none
- * Side Effects: writes to esp and ebp fields of current pcb
- */
-
-void set_ebpesp(int pid_in, uint32_t ebp, uint32_t esp){
-    pcb_array[pid_in].esp = esp;
-    pcb_array[pid_in].ebp = ebp;
-}
-
-void set_ebpesp_halt(int pid_in, uint32_t ebp, uint32_t esp){
-    pcb_array[pid_in].esp_halt = esp;
-    pcb_array[pid_in].ebp_halt = ebp;
-}
-
-/*
- * get_ebp
- * Description: returns the base pointer of the current process
- * Inputs: nothing
- * Outputs: base pointer of current process
- * Side Effects: none
- */
-uint32_t get_ebp(int pid_in){
-    return pcb_array[pid_in].ebp;
-}
-
-/*
- * get_esp
- * Description: returns the stack pointer of the current process
- * Inputs: nothing
- * Outputs: stack pointer of current process
- * Side Effects: none
- */
-uint32_t get_esp(int pid_in){
-    return pcb_array[pid_in].esp;
-}
-
-
-uint32_t get_ebp_halt(int pid_in){
-    return pcb_array[pid_in].ebp_halt;
-}
-
-uint32_t get_esp_halt(int pid_in){
-    return pcb_array[pid_in].esp_halt;
-}
-
 /*
  * get_pcb
  * Description: returns the pcb for the current process
@@ -6,6 +6,39 @@
 #include "terminal.h"
 #include "lib.h"
 #include "system_calls.h"
+#include "smp.h"
+
+/* Process table layout */
+#define MAX_PROCESSES       24          // process slots, each owns a 4 MB user page above 8 MB
+#define KERNEL_STACK_BASE   0x800000    // 8 MB, task kernel stacks grow down from here
+#define KERNEL_STACK_SIZE   0x2000      // 8 kB kernel stack per task
+#define KERNEL_STACK_TOP(pid)   (KERNEL_STACK_BASE - ((pid) * KERNEL_STACK_SIZE) - 4)
+#define USER_PAGE_MB(pid)       (8 + (4 * (pid)))
+#define USER_STACK_TOP      (0x8400000 - 4)     // top of the 128 MB program page
+
+/* Initial EFLAGS of a process */
+#define MAX_ARG_LEN         128         // command line arguments kept per process
+#define TASK_COMM_LEN       16          // program / kernel thread name, with the NUL
+#define EFLAGS_IF           0x200
+#define EFLAGS_RESERVED     0x2         // bit 1 always reads as 1
+
+/* Each CPU has an idle task in the slots after the last process, CPU 0's
+ * runs on the boot stack. IDLE_PID is the running CPU's */
+#define IDLE_PID            (MAX_PROCESSES + smp_processor_id())
+#define is_idle_pid(pid)    ((pid) >= MAX_PROCESSES)
+#define NUM_TASKS           (MAX_PROCESSES + MAX_CPUS)
+
+/* Scheduler run states */
+#define TASK_UNUSED         0           // slot is free
+#define TASK_RUNNABLE       1           // on the run queue
+#define TASK_BLOCKED        2           // waiting (parent waiting on a child, or on wait_chan)
+
+/* Kernel context saved by switch_to, offsets are CTX_* in x86_desc.h */
+typedef struct thread_ctx{
+    uint32_t esp;                       // kernel ESP while switched out
+    uint32_t esp0;                      // kernel stack top, goes into tss.esp0
+    uint32_t cr3;                       // page directory
+}thread_ctx;
 
 /* Function pointers for file system */
 typedef struct file_operations{
@@ -21,6 +54,7 @@ typedef struct fd_array_entry{
     uint32_t inode;                 // Index of inode
     uint32_t file_position;         // File read offset
     uint32_t flags;                 // Active/Inactive entry
+    uint32_t read_timeout;          // Longest read wait in ticks (0 = forever)
 }fd_array_entry; 
 
 /* Process Control Block */
@@ -30,22 +64,49 @@ typedef struct pcb{
     int parent_pcb_pid;
     int terminal_idx;
     uint8_t active;                     // if the current process is actively running or not
-    uint32_t esp;
-    uint32_t esp_halt;
-    uint32_t ebp;
-    uint32_t ebp_halt;
+    struct thread_ctx ctx;              // switch_to state
+    int waiting_child;                  // child PID execute is waiting on (-1 = none)
+    int32_t exit_status;                // status the child passed to halt
     uint32_t eflags;
     uint32_t user_ds;
     uint32_t eip;
     uint32_t cs;
     uint32_t image_start;
     uint8_t* cmd; 
+    int8_t args[MAX_ARG_LEN];           // arguments returned by getargs
+
+    /* Scheduler bookkeeping, owned by scheduling.c */
+    int state;                          // TASK_* run state
+    int priority;                       // static priority, 0 = highest
+    int timeslice;                      // PIT ticks left in the current slice
+    int slice_ticks;                    // timeslice override in PIT ticks (0 = priority default)
+    int policy;                         // SCHED_* class
+    int rt_priority;                    // SCHED_RR level, 0 = highest
+    uint32_t rt_rel_deadline;           // SCHED_EDF deadline in RTC ticks (0 = RTC period)
+    uint32_t rt_period;                 // RTC ticks per job
+    uint32_t rt_deadline;               // absolute deadline in RTC ticks
+    int rt_released;                    // a job is running (woken, not back in rtc_read)
+    uint32_t deadline_misses;
+    int run_array;                      // priority array holding the task (-1 = not queued)
+    int run_level;                      // list within run_array the task is linked on
+    int kbd_boost;                      // woken by keyboard input, until it sleeps or uses up a slice
+    int run_prev;                       // run queue links (PIDs, -1 = end of list)
+    int run_next;
+    uint32_t sched_ticks;               // PIT ticks spent running
+    void* wait_chan;                    // what a sleeping task waits on (NULL = not sleeping)
+    int preempt_count;                  // > 0 = inside a critical section, switches are deferred
+    int cpu;                            // CPU whose run queue holds the task
+    int lock_depth;                     // kernel lock nesting, see lock_kernel
+    int kthread;                        // kernel thread: kernel stack only, no user page or files
+    int8_t comm[TASK_COMM_LEN];         // name shown by sched_stat
+    struct io_ring* io_ring;            // rings registered by io_setup (NULL = none)
+    uint32_t io_ring_flags;             // IORING_* flags they were registered with
 }pcb;
 
 /* Current global process ID */
 extern int pid;
 
-extern struct pcb pcb_array[6];
+extern struct pcb pcb_array[NUM_TASKS];
 
 /* Gets the value of PID for functions outside of pcb.c */
 // int get_pid(void);
@@ -57,8 +118,6 @@ extern struct pcb pcb_array[6];
 
 struct pcb get_pcb_pid(int input_pid);
 
-void set_ebpesp(int pid_in, uint32_t ebp, uint32_t esp);
-void set_ebpesp_halt(int pid_in, uint32_t ebp, uint32_t esp);
 
 void set_pcb_open(int pid_in, int file_num, int32_t * addr);
 void set_pcb_read(int pid_in, int file_num, int32_t * addr);
@@ -67,9 +126,8 @@ void set_pcb_close(int pid_in, int file_num, int32_t * addr);
 void set_pcb_inode(int pid_in, int file_num, int32_t inode_val);
 void set_pcb_file_position(int pid_in, int file_num, int32_t file_position_val);
 void set_pcb_flags(int pid_in, int file_num, int32_t flags_val);
+void set_pcb_read_timeout(int pid_in, int file_num, uint32_t ticks);
 
-void set_pcb_esp(int in_pid, uint32_t esp_val);
-void set_pcb_ebp(int in_pid, uint32_t ebp_val);
 void set_pcb_eflags(int in_pid, uint32_t eflags_val);
 void set_pcb_user_ds(int in_pid, uint32_t user_ds_val);
 void set_pcb_eip(int in_pid, uint32_t eip_val);
@@ -77,14 +135,6 @@ void set_pcb_cs(int in_pid, uint32_t cs_val);
 void set_pcb_image_start(int in_pid, uint32_t image_start_val);
 void set_pcb_cmd(int in_pid, uint8_t* cmd);
 
-uint32_t get_esp(int pid_in);
-
-uint32_t get_ebp(int pid_in);
-
-uint32_t get_ebp_halt(int pid_in);
-
-uint32_t get_esp_halt(int pid_in);
-
 /* Initialize a PCB entry for a program */
 uint32_t init_pcb(int term_num, int parent_pcb_val, int global_pcb_val);
 
@@ -101,6 +151,9 @@ uint32_t user_level_program_loader(const uint8_t * filename);
 /* Check if pcb enabled */
 uint32_t pcb_valid(int pid_in, int32_t fd);
 
+/* Read timeout of the calling task's fd in ticks, 0 = wait forever */
+uint32_t fd_read_timeout(int32_t fd);
+
 /* Depreciated Function */
 char* read_file_noFD(const uint8_t* filename, uint32_t offset, uint32_t bytes_to_read);
 
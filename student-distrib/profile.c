@@ -0,0 +1,231 @@
+/* profile.c - Sampling profiler. Each CPU's timer interrupt is the only
+ * writer of that CPU's ring and the reader the only one moving its tail,
+ * so neither side takes a lock
+ * vim:ts=4 noexpandtab
+ */
+
+#include "profile.h"
+#include "lib.h"
+#include "clock.h"
+#include "pcb.h"
+#include "scheduling.h"
+#include "serial.h"
+#include "smp.h"
+#include "tsc.h"
+
+#define PROF_MASK           (PROF_ENTRIES - 1)
+
+/* Samples one CPU took and the reader has not moved out yet */
+typedef struct prof_ring {
+    volatile uint32_t head;             // next slot, advanced by the CPU's timer interrupt
+    volatile uint32_t tail;             // oldest sample, advanced by prof_read
+    uint32_t dropped;                   // samples lost to a full ring
+    uint64_t next_tsc;                  // when the CPU takes its next sample
+    prof_sample_t samples[PROF_ENTRIES];
+} prof_ring_t;
+
+volatile uint32_t prof_hz = 0;
+
+static uint64_t prof_cycles = 0;        // TSC cycles between samples
+static prof_ring_t prof_rings[MAX_CPUS];
+
+/*
+ * prof_start
+ *   DESCRIPTION: Starts or stops sampling. Starting empties the rings
+ *   INPUTS: hz -- samples per second and CPU, 1 to PIT_HZ, 0 stops
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 for a bad rate or without SAMPLE_PROFILE
+ *   SIDE EFFECTS: the tickless CPU 0 wakes up for every sample while on
+ */
+int32_t prof_start(uint32_t hz) {
+#ifdef SAMPLE_PROFILE
+    uint64_t cycles;
+    int cpu;
+
+    if (hz > PIT_HZ) {
+        return -1;
+    }
+
+    /* Off first, the timer linkages stop touching the rings */
+    prof_hz = 0;
+    if (hz == 0) {
+        return 0;
+    }
+
+    cycles = (uint64_t) tsc_khz * 1000;
+    div64_32(&cycles, hz);
+    prof_cycles = cycles;
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        prof_rings[cpu].head = 0;
+        prof_rings[cpu].tail = 0;
+        prof_rings[cpu].dropped = 0;
+        prof_rings[cpu].next_tsc = 0;
+    }
+    prof_hz = hz;
+    tick_rearm();
+    return 0;
+#else
+    return (hz == 0) ? 0 : -1;
+#endif
+}
+
+/*
+ * prof_tick
+ *   DESCRIPTION: Timer interrupt hook, records the interrupted EIP, CS and
+ *                task when this CPU's next sample is due
+ *   INPUTS: frame -- the interrupt's return frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: a full ring drops the sample and counts it
+ */
+void prof_tick(const prof_frame_t* frame) {
+#ifdef SAMPLE_PROFILE
+    prof_ring_t* ring = &prof_rings[smp_processor_id()];
+    prof_sample_t* sample;
+    uint64_t now = rdtsc();
+    uint32_t head = ring->head;
+    int pid = get_global_pid();
+
+    if (prof_hz == 0 || now < ring->next_tsc) {
+        return;
+    }
+    ring->next_tsc = now + prof_cycles;
+
+    if (head - ring->tail >= PROF_ENTRIES) {
+        ring->dropped++;
+        return;
+    }
+
+    sample = &ring->samples[head & PROF_MASK];
+    sample->eip = frame->eip;
+    sample->cs = (uint16_t) frame->cs;
+    sample->pid = (int16_t) pid;
+    if (pid >= 0 && pid < NUM_TASKS) {
+        strncpy(sample->comm, pcb_array[pid].comm, PROF_COMM_LEN - 1);
+        sample->comm[PROF_COMM_LEN - 1] = '\0';
+    } else {
+        strcpy(sample->comm, (int8_t*) "boot");
+    }
+
+    /* Stores stay in order on x86, only the compiler must not move the
+     * sample past the head */
+    asm volatile ("" : : : "memory");
+    ring->head = head + 1;
+#endif
+}
+
+/*
+ * prof_pit_interval
+ *   DESCRIPTION: Longest time CPU 0 may go without a timer interrupt and
+ *                still sample at prof_hz, for next_deadline
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PIT cycles, 0 while stopped
+ *   SIDE EFFECTS: none
+ */
+uint32_t prof_pit_interval(void) {
+    uint32_t hz = prof_hz;
+
+    return (hz == 0) ? 0 : MAX_PIT_SPEED / hz;
+}
+
+/*
+ * prof_field
+ *   DESCRIPTION: Appends a number or string and a separator to a line
+ *   INPUTS: line -- line being built, str -- text to add,
+ *           sep -- character after it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: line must have room for str and 2 more characters
+ */
+static void prof_field(int8_t* line, const int8_t* str, int8_t sep) {
+    int8_t* end = line + strlen(line);
+
+    strcpy(end, str);
+    end += strlen(end);
+    end[0] = sep;
+    end[1] = '\0';
+}
+
+/*
+ * prof_read
+ *   DESCRIPTION: Moves samples out of the rings as "cpu pid cs eip name"
+ *                lines, CS and EIP in hex, after a "# cpu N dropped M"
+ *                line for every CPU that lost samples
+ *   INPUTS: buf -- destination, nbytes -- its size
+ *   OUTPUTS: the text, not NUL terminated
+ *   RETURN VALUE: bytes written, 0 once the rings are empty. Lines that
+ *                 do not fit stay for the next call
+ *   SIDE EFFECTS: frees ring slots for the timer interrupts
+ */
+int32_t prof_read(uint8_t* buf, int32_t nbytes) {
+    int8_t line[PROF_LINE + PROF_COMM_LEN];
+    int8_t num[12];
+    prof_sample_t* sample;
+    int32_t written = 0, len;
+    uint32_t tail;
+    int cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        prof_ring_t* ring = &prof_rings[cpu];
+
+        if (ring->dropped != 0) {
+            line[0] = '\0';
+            prof_field(line, (int8_t*) "# cpu", ' ');
+            prof_field(line, itoa(cpu, num, 10), ' ');
+            prof_field(line, (int8_t*) "dropped", ' ');
+            prof_field(line, itoa(ring->dropped, num, 10), '\n');
+            len = strlen(line);
+            if (written + len > nbytes) {
+                return written;
+            }
+            memcpy(buf + written, line, len);
+            written += len;
+            ring->dropped = 0;
+        }
+
+        for (tail = ring->tail; tail != ring->head; tail++) {
+            sample = &ring->samples[tail & PROF_MASK];
+            line[0] = '\0';
+            prof_field(line, itoa(cpu, num, 10), ' ');
+            if (sample->pid < 0) {
+                prof_field(line, (int8_t*) "-1", ' ');
+            } else {
+                prof_field(line, itoa(sample->pid, num, 10), ' ');
+            }
+            prof_field(line, itoa(sample->cs, num, 16), ' ');
+            prof_field(line, itoa(sample->eip, num, 16), ' ');
+            prof_field(line, sample->comm, '\n');
+
+            len = strlen(line);
+            if (written + len > nbytes) {
+                ring->tail = tail;
+                return written;
+            }
+            memcpy(buf + written, line, len);
+            written += len;
+        }
+        ring->tail = tail;
+    }
+    return written;
+}
+
+/*
+ * prof_dump_serial
+ *   DESCRIPTION: prof_read until the rings are empty, to COM1
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes sent
+ *   SIDE EFFECTS: busy waits on the UART, samples taken meanwhile are
+ *                 sent too
+ */
+int32_t prof_dump_serial(void) {
+    uint8_t buf[512];
+    int32_t len, total = 0;
+
+    while ((len = prof_read(buf, sizeof(buf))) > 0) {
+        serial_write(buf, len);
+        total += len;
+    }
+    return total;
+}
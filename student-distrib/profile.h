@@ -0,0 +1,54 @@
+/* profile.h - Sampling profiler: the timer interrupts record where every
+ * CPU was, profsym.py turns the samples into a flat profile on the host
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "types.h"
+
+/* Take samples in the timer interrupts. Comment out to leave only a test
+ * of prof_hz in the timer linkages, prof_start then always fails */
+#define SAMPLE_PROFILE
+
+#define PROF_ENTRIES        512         // samples per CPU ring, a power of 2
+#define PROF_COMM_LEN       16          // TASK_COMM_LEN
+#define PROF_LINE           64          // "cpu pid cs eip name" text line
+
+/* What the timer linkages find above their pushal frame */
+typedef struct prof_frame {
+    uint32_t eip;
+    uint32_t cs;
+    uint32_t eflags;
+} prof_frame_t;
+
+/* One sample. The name tells the host which program's symbols a user
+ * EIP belongs to, PIDs are reused */
+typedef struct prof_sample {
+    uint32_t eip;
+    uint16_t cs;
+    int16_t pid;
+    int8_t comm[PROF_COMM_LEN];
+} prof_sample_t;
+
+/* Samples per second and CPU, 0 while stopped. Tested by the timer
+ * linkages before they call prof_tick */
+extern volatile uint32_t prof_hz;
+
+/* Starts sampling at hz (1 to PIT_HZ) on empty rings, 0 stops */
+int32_t prof_start(uint32_t hz);
+
+/* Records the interrupted state if this CPU's next sample is due */
+void prof_tick(const prof_frame_t* frame);
+
+/* PIT cycles between samples for the tickless deadline, 0 when stopped */
+uint32_t prof_pit_interval(void);
+
+/* Moves samples out of the rings as text lines */
+int32_t prof_read(uint8_t* buf, int32_t nbytes);
+
+/* Moves every sample out of the rings to COM1 */
+int32_t prof_dump_serial(void);
+
+#endif /* _PROFILE_H */
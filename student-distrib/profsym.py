@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""profsym.py - Flat profile from the sampling profiler's output
+
+Reads the "cpu pid cs eip name" lines of `prof dump` (copied off the
+screen) or `prof serial` (e.g. QEMU -serial file:prof.txt), and maps
+every EIP to a function:
+  - kernel samples (CS ring 0) against bootimg,
+  - user samples against the program's ELF, found as <name>.exe or
+    ece391<name>.exe in the given directories (syscalls/, fish/).
+Symbols come from `nm -n`, so the ELF files must keep their symbols.
+
+usage: profsym.py [-k bootimg] [-d dir]... [-n top] samples.txt...
+"""
+
+import argparse
+import bisect
+import collections
+import os
+import subprocess
+import sys
+
+
+def load_symbols(path):
+    """Sorted (address, name) of the text symbols of an ELF file"""
+    out = subprocess.run(["nm", "-n", "--defined-only", path],
+                         check=True, capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            syms.append((int(parts[0], 16), parts[2]))
+    return syms
+
+
+def lookup(syms, addr):
+    """Name of the function containing addr, None before the first one"""
+    i = bisect.bisect_right(syms, (addr, "\xff")) - 1
+    return syms[i][1] if i >= 0 else None
+
+
+def find_program(name, dirs):
+    for d in dirs:
+        for candidate in (name + ".exe", "ece391" + name + ".exe"):
+            path = os.path.join(d, candidate)
+            if os.path.isfile(path):
+                return path
+    return None
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description="Flat profile of prof samples")
+    parser.add_argument("samples", nargs="+", help="prof dump / serial output")
+    parser.add_argument("-k", "--kernel", default=os.path.join(here, "bootimg"),
+                        help="kernel ELF (default: bootimg next to this script)")
+    parser.add_argument("-d", "--dir", action="append", dest="dirs",
+                        help="where to look for program ELFs (default: syscalls, fish)")
+    parser.add_argument("-n", "--top", type=int, default=40,
+                        help="functions to list (default 40, 0 = all)")
+    args = parser.parse_args()
+    dirs = args.dirs or [os.path.join(here, "..", "syscalls"),
+                         os.path.join(here, "..", "fish")]
+
+    kernel = load_symbols(args.kernel)
+    programs = {}
+    counts = collections.Counter()
+    per_task = collections.Counter()
+    total = dropped = 0
+
+    for path in args.samples:
+        with open(path, errors="replace") as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) == 5 and parts[0] == "#" and parts[3] == "dropped":
+                    dropped += int(parts[4])
+                    continue
+                if len(parts) != 5 or not parts[0].isdigit():
+                    continue
+                cs, eip, name = int(parts[2], 16), int(parts[3], 16), parts[4]
+                total += 1
+                if cs & 3 == 0:
+                    where, binary = "kernel", kernel
+                else:
+                    where = name
+                    if name not in programs:
+                        elf = find_program(name, dirs)
+                        programs[name] = load_symbols(elf) if elf else []
+                    binary = programs[name]
+                func = lookup(binary, eip) or "0x%x" % eip
+                counts[(func, where)] += 1
+                per_task[(name, "kernel" if cs & 3 == 0 else "user")] += 1
+
+    if total == 0:
+        sys.exit("no samples")
+
+    print("%d samples, %d dropped" % (total, dropped))
+    print()
+    print("     %    samples  function [binary]")
+    for (func, where), n in counts.most_common(args.top or None):
+        print("%6.2f %10d  %s [%s]" % (100.0 * n / total, n, func, where))
+    print()
+    print("     %    samples  task mode")
+    for (name, mode), n in per_task.most_common():
+        print("%6.2f %10d  %s %s" % (100.0 * n / total, n, name, mode))
+
+
+if __name__ == "__main__":
+    main()
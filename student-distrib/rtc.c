@@ -6,11 +6,48 @@
 #include "rtc.h"
 #include "lib.h"
 #include "i8259.h"
-
-/* RTC interrupt flag used to broadcast RTC interrupts */
-//! May need to be volitile
-static uint8_t rtc_tick[4];
-static uint32_t rtc_count[4];
+#include "scheduling.h"
+#include "softirq.h"
+#include "timer.h"
+#include "pcb.h"
+#include "system_calls.h"
+
+/* Virtual RTCs: one per fd slot of every task, plus a row for code
+ * running without a task (boot, tests). The extra slot of a row is where
+ * rtc_wait sleeps */
+#define RTC_FDS         8                   // fd_array entries per task
+#define RTC_WAIT_SLOT   RTC_FDS
+#define RTC_SLOTS       (RTC_FDS + 1)
+#define RTC_NO_TASK     MAX_PROCESSES
+#define RTC_DEFAULT     2                   // Hz of a freshly opened fd
+
+typedef struct rtc_file {
+    uint32_t period;        // rtc_ticks per virtual tick, 0 = not in use
+    uint32_t next_tick;     // rtc_ticks of the next virtual tick
+    uint32_t wake_tick;     // rtc_ticks a sleeping reader waits for
+    uint32_t waiting;       // a reader sleeps on this file
+    uint32_t coalesce;      // reads return the ticks since the last read
+} rtc_file_t;
+
+static rtc_file_t rtc_files[RTC_NO_TASK + 1][RTC_SLOTS];
+
+/* RTC_MAX Hz ticks since boot, the time base of real-time deadlines.
+ * Every interrupt adds rtc_step, the hardware runs only as fast as the
+ * fastest virtual RTC in use and is masked with none in use */
+static volatile uint32_t rtc_ticks = 0;
+static uint32_t rtc_step = 1;
+static uint8_t rtc_irq_on = 0;
+
+/* Sleeping readers and the earliest tick one of them waits for, the
+ * interrupt only schedules the bottom half once that tick comes */
+static uint32_t rtc_waiters = 0;
+static uint32_t rtc_next_wake = 0;
+
+/* CMOS index/data port pairs and the virtual RTCs */
+static spinlock_t rtc_lock = SPIN_LOCK_INIT("rtc");
+
+static void rtc_tasklet_fn(uint32_t data);
+static tasklet_t rtc_tasklet = TASKLET_INIT(rtc_tasklet_fn, 0);
 
 /*
  * rtc_init
@@ -18,13 +55,14 @@ static uint32_t rtc_count[4];
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Enables IRQ8 and RTC
+ *   SIDE EFFECTS: Enables the RTC, IRQ8 stays masked until
+ *                 a virtual RTC is in use
  */  
 void rtc_init(void) {
 
     /* Block external interrupts */
-    unsigned long flag;
-    cli_and_save(flag);
+    uint32_t flag;
+    spin_lock_irqsave(&rtc_lock, flag);
 
     /* Disable NMI */
     outb((NMI_OFF | REG_B), RTC_PORT_CMD);
@@ -39,11 +77,10 @@ void rtc_init(void) {
     outb((prev | BIT_6TH_MASK), RTC_PORT_DATA);
    
     /* Enable interrupts */
-    restore_flags(flag);
+    spin_unlock_irqrestore(&rtc_lock, flag);
 
-    /* Enable system IRQs */
+    /* Enable system IRQs, rtc_update_rate unmasks the RTC */
     enable_irq(0x02);   // Master PIC passthrough
-    enable_irq(0x08);   // Slave PIC with RTC
 
     /* RTC initialized */
     printf("Initialized RTC\n");
@@ -58,27 +95,95 @@ void rtc_init(void) {
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Read and reset RTC register C
- *                 Sets rtc_tick flag high
+ *                 Advances rtc_ticks, wakes readers that are due
  */  
 void rtc_handler(void){
 
     /* Block external interrupts */
-    unsigned long flag;
-    cli_and_save(flag);
+    uint32_t flag;
+    int wake;
+    spin_lock_irqsave(&rtc_lock, flag);
 
-    /* Reset RTC tick flag */
-    rtc_tick[get_term_num()] = 0x01;
+    /* One tick for every virtual RTC, only a due reader needs waking */
+    rtc_ticks += rtc_step;
+    wake = (rtc_waiters != 0) && time_after_eq(rtc_ticks, rtc_next_wake);
 
     /* Select reg C and read contents to reset */
     outb(REG_C, RTC_PORT_CMD);
     inb(RTC_PORT_DATA);
 
     /* Enable interrupts */
-    restore_flags(flag);
+    spin_unlock_irqrestore(&rtc_lock, flag);
 
     /* Clear system interrupt */
     send_eoi(0x08);
 
+    /* Waking the readers scans the virtual RTCs, leave it to the bottom half */
+    if(wake){
+        tasklet_hi_schedule(&rtc_tasklet);
+    }
+}
+
+/*
+ * rtc_tasklet_fn
+ *   DESCRIPTION: Bottom half of the RTC interrupt
+ *   INPUTS: data -- unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes the readers whose tick came, and only those
+ */
+static void rtc_tasklet_fn(uint32_t data) {
+    uint32_t flag;
+    int row, slot, first = 1;
+
+    spin_lock_irqsave(&rtc_lock, flag);
+    for(row = 0; row <= RTC_NO_TASK; row++){
+        for(slot = 0; slot < RTC_SLOTS; slot++){
+            rtc_file_t* file = &rtc_files[row][slot];
+            if(!file->waiting){
+                continue;
+            }
+            if(time_after_eq(rtc_ticks, file->wake_tick)){
+                wake_up(file);
+            }
+            else if(first || !time_after_eq(file->wake_tick, rtc_next_wake)){
+                rtc_next_wake = file->wake_tick;
+                first = 0;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&rtc_lock, flag);
+
+    /* A real-time reader preempts best effort */
+    preempt_wakeup();
+}
+
+/*
+ * rtc_write_rate
+ *   DESCRIPTION: Writes the divider to register A
+ *   INPUTS: rate - Value to divide clock by, [3:15]
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes the interrupt rate of the RTC and
+ *                 rtc_step, call with rtc_lock held
+ */  
+static void rtc_write_rate(uint8_t rate){
+
+    /* Select reg A, Disable NMI */
+    outb((REG_A | NMI_OFF), RTC_PORT_CMD);
+
+    /* Read previous A data */
+    char prev = inb(RTC_PORT_DATA);
+
+    /* Select reg A, inb resets to reg D */
+    outb((REG_A | NMI_OFF), RTC_PORT_CMD);
+
+    /* Write new rate to reg A */
+    outb(((prev & 0xF0) | rate), RTC_PORT_DATA);
+
+    /* Each rate step halves the frequency, faster than RTC_MAX
+     * (tests only) still counts one tick per interrupt */
+    rtc_step = (rate > RTC_MAX_RATE) ? (1 << (rate - RTC_MAX_RATE)) : 1;
 }
 
 /*
@@ -103,23 +208,138 @@ void rtc_divide_freq(uint8_t rate){
     rate &= 0x0F;
 
     /* Block external interrupts */
-    unsigned long flag;
-    cli_and_save(flag);
+    uint32_t flag;
+    spin_lock_irqsave(&rtc_lock, flag);
 
-    /* Select reg A, Disable NMI */
-    outb((REG_A | NMI_OFF), RTC_PORT_CMD);
+    rtc_write_rate(rate);
 
-    /* Read previous A data */
-    char prev = inb(RTC_PORT_DATA);
+    /* Enable interrupts */
+    spin_unlock_irqrestore(&rtc_lock, flag);
+}
 
-    /* Select reg A, inb resets to reg D */
-    outb((REG_A | NMI_OFF), RTC_PORT_CMD);
+/*
+ * rtc_update_rate
+ *   DESCRIPTION: Runs the hardware at the rate of the fastest
+ *                virtual RTC in use, masks IRQ8 with none in use
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May reprogram register A and (un)mask IRQ8,
+ *                 call with rtc_lock held after changing a period
+ */  
+static void rtc_update_rate(void){
+    uint32_t period = 0;
+    uint8_t rate = RTC_MAX_RATE;
+    int row, slot;
+
+    /* Shortest period in use, all are powers of 2 */
+    for(row = 0; row <= RTC_NO_TASK; row++){
+        for(slot = 0; slot < RTC_SLOTS; slot++){
+            if(rtc_files[row][slot].period != 0 &&
+               (period == 0 || rtc_files[row][slot].period < period)){
+                period = rtc_files[row][slot].period;
+            }
+        }
+    }
 
-    /* Write new rate to reg A */
-    outb(((prev & 0xF0) | rate), RTC_PORT_DATA);
+    /* Nobody listens, no interrupts at all */
+    if(period == 0){
+        if(rtc_irq_on){
+            disable_irq(0x08);
+            rtc_irq_on = 0;
+        }
+        return;
+    }
 
-    /* Enable interrupts */
-    restore_flags(flag);
+    if(period != rtc_step){
+        while((1U << (rate - RTC_MAX_RATE)) < period){
+            rate++;
+        }
+        rtc_write_rate(rate);
+    }
+
+    if(!rtc_irq_on){
+        /* A flag raised while masked holds the line, read reg C to drop it */
+        outb(REG_C, RTC_PORT_CMD);
+        inb(RTC_PORT_DATA);
+        enable_irq(0x08);
+        rtc_irq_on = 1;
+    }
+}
+
+/*
+ * rtc_row
+ *   DESCRIPTION: Row of rtc_files belonging to the caller
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the calling task's PID, RTC_NO_TASK without one
+ *   SIDE EFFECTS: none
+ */
+static int rtc_row(void){
+    int pid = get_global_pid();
+
+    if(pid < 0 || is_idle_pid(pid)){
+        return RTC_NO_TASK;
+    }
+    return pid;
+}
+
+/*
+ * rtc_file
+ *   DESCRIPTION: Virtual RTC of one of the calling task's fds
+ *   INPUTS: fd - file descriptor index
+ *   OUTPUTS: none
+ *   RETURN VALUE: the virtual RTC, NULL for a bad fd
+ *   SIDE EFFECTS: none
+ */
+static rtc_file_t* rtc_file(int32_t fd){
+    if(fd < 0 || fd >= RTC_FDS){
+        return NULL;
+    }
+    return &rtc_files[rtc_row()][fd];
+}
+
+/*
+ * rtc_sleep_until
+ *   DESCRIPTION: Sleep until rtc_ticks reaches a tick. The bottom half
+ *                wakes the caller at that tick, not on every interrupt
+ *   INPUTS: file - the caller's virtual RTC, target - rtc_ticks to wait for,
+ *           deadline - jiffies to give up at, 0 = never
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 - Tick reached, -1 - Deadline passed
+ *   SIDE EFFECTS: sleeps the caller
+ */
+static int32_t rtc_sleep_until(rtc_file_t* file, uint32_t target, uint32_t deadline){
+    uint32_t flag;
+    int32_t ret = 0;
+
+    /* Interrupts stay off while the lock is dropped to sleep, so the tick cannot be lost */
+    spin_lock_irqsave(&rtc_lock, flag);
+    file->wake_tick = target;
+    file->waiting = 1;
+    if(rtc_waiters++ == 0 || time_after_eq(rtc_next_wake, target)){
+        rtc_next_wake = target;
+    }
+
+    while(!time_after_eq(rtc_ticks, target)){
+        if(deadline != 0 && time_after_eq(get_jiffies(), deadline)){
+            ret = -1;
+            break;
+        }
+        spin_unlock(&rtc_lock);
+        if(deadline == 0){
+            sleep_on(file);
+        }
+        else{
+            sleep_on_timeout(file, deadline - get_jiffies());
+        }
+        spin_lock(&rtc_lock);
+    }
+
+    file->waiting = 0;
+    rtc_waiters--;
+    spin_unlock_irqrestore(&rtc_lock, flag);
+    return ret;
 }
 
 /*
@@ -128,33 +348,59 @@ void rtc_divide_freq(uint8_t rate){
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Temporarily sets rtc_tick low
+ *   SIDE EFFECTS: sleeps the caller, unmasks IRQ8 meanwhile
  */  
 void rtc_wait(void){
+    rtc_file_t* file = &rtc_files[rtc_row()][RTC_WAIT_SLOT];
+    uint32_t flag;
+
+    /* Keep the IRQ on at whatever rate it runs for the wait */
+    spin_lock_irqsave(&rtc_lock, flag);
+    file->period = rtc_step;
+    rtc_update_rate();
+    spin_unlock_irqrestore(&rtc_lock, flag);
 
-    /* Reset RTC tick flag set high by RTC handler */
-    rtc_tick[get_term_num()] = 0x00;
+    rtc_sleep_until(file, rtc_ticks + 1, 0);
 
-    /* Wait for an RTC tick */
-    while(rtc_tick[get_term_num()] == 0x00);
+    spin_lock_irqsave(&rtc_lock, flag);
+    file->period = 0;
+    rtc_update_rate();
+    spin_unlock_irqrestore(&rtc_lock, flag);
 }
 
 /*
- * rtc_change
- *   DESCRIPTION: Change freq of virtualized RTC
- *   INPUTS: filename - Unused string to open file
+ * get_rtc_ticks
+ *   DESCRIPTION: RTC interrupts since boot
+ *   INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE: 0 - Success
+ *   RETURN VALUE: tick count, RTC_MAX per second
  *   SIDE EFFECTS: none
- *   NOTE: RTC will always be on
  */
-int32_t rtc_change(int32_t freq){
+uint32_t get_rtc_ticks(void){
+    return rtc_ticks;
+}
+
+/*
+ * rtc_change
+ *   DESCRIPTION: Change freq of one fd's virtualized RTC, the
+ *                next virtual tick is a full period from now
+ *   INPUTS: fd - file descriptor index, freq - power of 2 Hz,
+ *           | RTC_COALESCE to make reads count ticks
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 - Success, -1 - Bad fd or frequency
+ *   SIDE EFFECTS: Adapts the hardware rate
+ */
+int32_t rtc_change(int32_t fd, int32_t freq){
 
     /* Local Variables */
-    int freq_mult = 0;      // Number of interrrupts needed for desired frequency
+    rtc_file_t* file = rtc_file(fd);
+    uint32_t coalesce = (freq & RTC_COALESCE) ? 1 : 0;
+
+    /* Mode flag aside, the rest is the frequency */
+    freq &= ~RTC_COALESCE;
 
     /* Check if freq within bounds */
-    if((freq > RTC_MAX) || (freq < RTC_MIN)){
+    if((freq > RTC_MAX) || (freq < RTC_MIN) || (file == NULL)){
         return -1;
     }
 
@@ -168,39 +414,101 @@ int32_t rtc_change(int32_t freq){
         return -1;
     }
 
-    /* Calculate frequency iterations */
-    freq_mult = RTC_MAX / freq;
-
     /* Block external interrupts */
-    unsigned long flag;
-    cli_and_save(flag);
+    uint32_t flag;
+    spin_lock_irqsave(&rtc_lock, flag);
 
-    /* Update RTC Counter */
-    rtc_count[get_term_num()] = freq_mult;
+    /* Interrupts needed for desired frequency */
+    file->period = RTC_MAX / freq;
+    file->next_tick = rtc_ticks + file->period;
+    file->coalesce = coalesce;
+    rtc_update_rate();
 
     /* Enable interrupts */
-    restore_flags(flag);
+    spin_unlock_irqrestore(&rtc_lock, flag);
 
     return 0;
 }
 
 /*
  * rtc_read
- *   DESCRIPTION: Wait for an RTC interrupt
- *                at a specific frequency
- *   INPUTS: none
- *   OUTPUTS: none
- *   RETURN VALUE: 0 - Success, -1 - Fail
- *   SIDE EFFECTS: Temporarily sets rtc_tick low
+ *   DESCRIPTION: Wait for the fd's next virtual RTC tick. Ticks
+ *                missed while the caller was not reading are skipped,
+ *                the fd keeps its phase. In RTC_COALESCE mode missed
+ *                ticks are not skipped but counted: the read returns
+ *                at once if any passed and reports how many
+ *   INPUTS: fd - file descriptor index, buf - where RTC_COALESCE
+ *           mode puts the count, inside the program page,
+ *           nbytes - size of buf
+ *   OUTPUTS: RTC_COALESCE mode: virtual ticks since the last read
+ *            as a uint32_t in buf
+ *   RETURN VALUE: 0 - Success, 4 - Success in RTC_COALESCE mode,
+ *                 -1 - Fail or the fd's read timeout passed
+ *   SIDE EFFECTS: Sleeps the caller, closes the caller's
+ *                 real-time job and releases the next one
  */  
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes){
 
     /* Local vars */
-    int count;
-    
-    /* Loop until desired frequency of RTC interrupts */
-    for(count = 0; count < rtc_count[get_term_num()]; count++){
-        rtc_wait();
+    rtc_file_t* file = rtc_file(fd);
+    uint32_t timeout = fd_read_timeout(fd);
+    uint32_t deadline = 0;
+    uint32_t target, ticks, flag;
+
+    if(file == NULL){
+        return -1;
+    }
+    if(file->coalesce && (nbytes < (int32_t) sizeof(uint32_t) || !user_range_ok(buf, sizeof(uint32_t)))){
+        return -1;
+    }
+
+    /* A read timeout on the fd bounds the whole wait, 0 means none */
+    if(timeout != 0){
+        deadline = get_jiffies() + timeout;
+        if(deadline == 0){
+            deadline = 1;
+        }
+    }
+
+    /* A real-time caller is done with its current period */
+    sched_rt_complete();
+
+    /* First use of the fd, start at the default rate */
+    spin_lock_irqsave(&rtc_lock, flag);
+    if(file->period == 0){
+        file->period = RTC_MAX / RTC_DEFAULT;
+        file->next_tick = rtc_ticks + file->period;
+        file->coalesce = 0;
+        rtc_update_rate();
+    }
+
+    /* Next virtual tick still to come, or the ones already missed */
+    target = file->next_tick;
+    ticks = 0;
+    if(time_after_eq(rtc_ticks, target)){
+        ticks = (rtc_ticks - target) / file->period + 1;
+        target += ticks * file->period;
+    }
+    spin_unlock_irqrestore(&rtc_lock, flag);
+
+    /* Sleep until the tick, unless there are missed ones to report */
+    if(!file->coalesce || ticks == 0){
+        if(rtc_sleep_until(file, target, deadline) == -1){
+            return -1;
+        }
+        file->next_tick = target + file->period;
+        ticks = 1;
+    }
+    else{
+        file->next_tick = target;
+    }
+
+    /* Next period starts now, due by the next read */
+    sched_rt_release(file->period);
+
+    if(file->coalesce){
+        *(uint32_t*) buf = ticks;
+        return sizeof(uint32_t);
     }
 
     /* Return 0, RTC waiting over */
@@ -213,17 +521,14 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes){
  *   INPUTS: fd - file descriptor index, buf - buffer, nbytes - size to write
  *   OUTPUTS: none
  *   RETURN VALUE: 0 - Success
- *   SIDE EFFECTS: none
- *   NOTE: RTC will always be on
+ *   SIDE EFFECTS: Adapts the hardware rate
  */
 int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
-    //! TO DO
-    //!set virtual frequency
-    //!buffer sends in frequency
+    /* buffer sends in frequency */
     int32_t * buffer = (int32_t *)buf;
     if(buffer == 0) return -1;
     int32_t freq = *buffer;
-    if(rtc_change(freq) == -1) return -1;
+    if(rtc_change(fd, freq) == -1) return -1;
     return 0;
 }
 
@@ -234,18 +539,11 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
  *   OUTPUTS: none
  *   RETURN VALUE: 0 - Success, -1 - Fail
  *   SIDE EFFECTS: none
- *   NOTE: RTC will always be on
+ *   NOTE: open does not learn the fd, a closed fd's virtual RTC
+ *         starts at 2 Hz on its first read or write
  */
 int32_t rtc_open(const uint8_t* filename){
 
-    /* Reset RTC frequency to 2 Hz */
-    int i = rtc_change(2);
-    
-    /* Check if bad write */
-    if(i != 0){
-        return -1;
-    }
-
     /* Succesfully opened */
     return 0;
 }
@@ -253,19 +551,50 @@ int32_t rtc_open(const uint8_t* filename){
 /*
  * rtc_close
  *   DESCRIPTION: Close virtualized RTC
- *   INPUTS: file directory - Unused path to close file
+ *   INPUTS: fd - file descriptor index
  *   OUTPUTS: none
- *   RETURN VALUE: 0 - Success
- *   SIDE EFFECTS: none
- *   NOTE: RTC will always be on -> close nothing
+ *   RETURN VALUE: 0 - Success, -1 - Bad fd
+ *   SIDE EFFECTS: Resets the fd's virtual RTC, may slow down
+ *                 or mask the hardware
  */
 int32_t rtc_close(int32_t fd){
 
     /* Check for valid file directory */
-    if (fd <= 1 || fd >= 8) {
+    if (fd <= 1 || fd >= RTC_FDS) {
         return -1;
     }
 
-    /* Fake closed RTC */
+    /* The next open starts from the default rate */
+    uint32_t flag;
+    spin_lock_irqsave(&rtc_lock, flag);
+    rtc_file(fd)->period = 0;
+    rtc_file(fd)->coalesce = 0;
+    rtc_update_rate();
+    spin_unlock_irqrestore(&rtc_lock, flag);
     return 0;
 }
+
+/*
+ * rtc_release
+ *   DESCRIPTION: Closes every virtual RTC of a task that goes away,
+ *                halt does not close files one by one
+ *   INPUTS: pid - task
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may slow down or mask the hardware
+ */
+void rtc_release(int pid){
+    uint32_t flag;
+    int slot;
+
+    if(pid < 0 || pid >= RTC_NO_TASK){
+        return;
+    }
+    spin_lock_irqsave(&rtc_lock, flag);
+    for(slot = 0; slot < RTC_SLOTS; slot++){
+        rtc_files[pid][slot].period = 0;
+        rtc_files[pid][slot].coalesce = 0;
+    }
+    rtc_update_rate();
+    spin_unlock_irqrestore(&rtc_lock, flag);
+}
@@ -29,6 +29,14 @@
 #define RTC_MAX         1024
 #define RTC_MIN         2
 
+/* OR'ed into a frequency written to an RTC fd: reads return at once
+ * with the count of virtual ticks missed since the last read, or wait
+ * for the next one and return a count of 1 */
+#define RTC_COALESCE    0x10000
+
+/* Register A divider giving RTC_MAX, each step above halves it */
+#define RTC_MAX_RATE    6
+
 /* Initialize the RTC */
 void rtc_init(void);
 
@@ -41,10 +49,13 @@ void rtc_divide_freq(uint8_t rate);
 /* Wait for an RTC interrupt */
 void rtc_wait(void);
 
-/* Set RTC virtualized frequency */
-int32_t rtc_change(int32_t freq);
+/* RTC interrupts since boot */
+uint32_t get_rtc_ticks(void);
 
-/* Read the RTC at the current virtualized frequency */
+/* Set the virtualized frequency of an RTC fd */
+int32_t rtc_change(int32_t fd, int32_t freq);
+
+/* Wait for the fd's next virtual RTC tick */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
 
 /* Write to the RTC to change it's virtual frequency */
@@ -56,6 +67,9 @@ int32_t rtc_open(const uint8_t* filename);
 /* Close virtual RTC */
 int32_t rtc_close(int32_t fd);
 
+/* Close every virtual RTC of a task */
+void rtc_release(int pid);
+
 #endif /* _RTC_H */
 
 /*****************************************************
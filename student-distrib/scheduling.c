@@ -4,21 +4,229 @@
  *********************************************/
 
 #include "scheduling.h"
-#define MAX_PIT_SPEED 1193182
-
-/* Variables */
-int curr_scheduled = 0; // Terminal index of current program running (1 of 3)
-uint32_t esp_val = 0;   // ESP Register
-uint32_t ebp_val = 0;   // EBP Register
+#include "rtc.h"
+#include "smp.h"
+#include "apic.h"
+#include "softirq.h"
+#include "vdso.h"
+#include "timer.h"
+#include "profile.h"
+#include "trace.h"
+#include "io_ring.h"
+
+/* Priority array: one FIFO list of PIDs per priority level */
+typedef struct prio_array {
+    uint32_t bitmap;                // bit n set = list n non-empty
+    int nr_queued;                  // tasks queued in this array
+    int head[NUM_PRIO];             // first PID per priority (-1 = empty)
+    int tail[NUM_PRIO];             // last PID per priority (-1 = empty)
+} prio_array;
+
+/* Run queue: best-effort tasks with slice left sit in active, used up ones
+ * in expired. Real-time tasks have arrays of their own that always win */
+#define RT_ARRAY        2           // SCHED_RR, one list per rt_priority
+#define EDF_ARRAY       3           // SCHED_EDF, single list sorted by deadline
+#define NUM_ARRAYS      4
+
+typedef struct runqueue {
+    prio_array arrays[NUM_ARRAYS];
+    int active;                     // index of the active best-effort array
+    int nr_running;                 // runnable tasks in all arrays
+    int rt_period_ticks;            // ticks into the real-time bandwidth period
+    int rt_time;                    // ticks real-time tasks ran this period
+    int rt_throttled;               // RT_RUNTIME_TICKS used up, best effort goes first
+} runqueue;
+
+/* Slice length in PIT ticks for each priority level. Every runnable task
+ * gets one slice per array swap, so the table is the CPU share weight */
+static const int prio_to_slice[NUM_PRIO] = {8, 6, 4, 3, 2, 2, 1, 1};
+
+/* One run queue per CPU, a task sits on the queue of pcb.cpu. Idle CPUs
+ * steal from the busiest queue. The kernel lock covers all of them */
+static runqueue rqs[MAX_CPUS];
+static int rq_initialized = 0;
+
+#define this_rq()       (&rqs[smp_processor_id()])
+#define task_rq(pid)    (&rqs[pcb_array[(pid)].cpu])
+
+/* Scheduler ticks since boot. In TICKLESS mode several can pass per interrupt */
+static volatile uint32_t jiffies = 0;
+
+#ifdef TICKLESS
+static uint32_t tick_cycles = 0;    // PIT cycles not yet turned into a tick
+static uint32_t shot_cycles = 0;    // length of the one-shot currently armed
+#endif
+
+/* CPU 0 ticks from its local APIC timer instead of the PIT (I/O APIC
+ * backend), counts are still kept in PIT cycles */
+static int lapic_clock = 0;
+
+/* Scheduler ticks spent in an idle task vs. in a process, all CPUs */
+static uint32_t idle_ticks = 0;
+static uint32_t busy_ticks = 0;
 
 /* Debug variables */
 int pid_arr_idx = 0;
 int num_pit_interrupts = 0;
 int page_fault_line_number = 0;
 
-/* Global active program */
-int global_pid = 0;
-uint8_t* cmd_name;
+#ifdef TICKLESS
+/*
+ * pit_arm
+ *   DESCRIPTION: Programs a single PIT (or local APIC timer) interrupt
+ *                cycles from now
+ *   INPUTS: cycles -- delay in PIT input clocks, clamped to the counter
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: replaces any shot already armed
+ */
+static void pit_arm(uint32_t cycles) {
+
+    if (cycles < PIT_MIN_SHOT) cycles = PIT_MIN_SHOT;
+    if (cycles > PIT_MAX_SHOT) cycles = PIT_MAX_SHOT;
+    shot_cycles = cycles;
+
+    if (lapic_clock) {
+        lapic_timer_oneshot(cycles);
+        return;
+    }
+
+    outb(0x30, 0x43);                   // 0x00 = mode 0 (Interrupt on terminal count) | 0x30 = two byte config
+    outb(cycles & 0xFF, 0x40);          // 1st Byte: Low byte of the count
+    outb((cycles & 0xFF00) >> 8, 0x40); // 2nd Byte: High byte of the count, starts counting
+}
+
+/*
+ * pit_read_count
+ *   DESCRIPTION: Latches and reads the channel 0 down counter
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: cycles left in the armed shot (wraps past 0 once expired)
+ *   SIDE EFFECTS: none
+ */
+static uint32_t pit_read_count(void) {
+    uint32_t lo, hi;
+
+    if (lapic_clock) {
+        return lapic_timer_remaining();
+    }
+
+    outb(0x00, 0x43);                   // counter latch command, channel 0
+    lo = inb(0x40);
+    hi = inb(0x40);
+    return lo | (hi << 8);
+}
+
+/*
+ * tick_account
+ *   DESCRIPTION: Turns elapsed PIT cycles into scheduler ticks
+ *   INPUTS: cycles -- PIT input clocks since the last call
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: advances jiffies and charges the running task per tick
+ */
+static void tick_account(uint32_t cycles) {
+    tick_cycles += cycles;
+    while (tick_cycles >= PIT_TICK_CYCLES) {
+        tick_cycles -= PIT_TICK_CYCLES;
+        jiffies++;
+        timer_tick(jiffies);
+        scheduler_tick();
+    }
+}
+
+/*
+ * next_deadline
+ *   DESCRIPTION: PIT cycles until the next event the scheduler cares
+ *                about while pid runs: slice expiry, a kernel timer, an
+ *                IORING_SQPOLL drain or the next profiler sample. Without any of them the
+ *                deadline is the counter limit, which keeps jiffies going
+ *   INPUTS: pid -- task about to run
+ *   OUTPUTS: none
+ *   RETURN VALUE: cycles until the deadline
+ *   SIDE EFFECTS: none
+ */
+static uint32_t next_deadline(int pid) {
+    uint32_t deadline = PIT_MAX_SHOT;
+    uint32_t timer_ticks, prof_interval;
+
+    /* Somebody woke up while idle, leave it as soon as possible */
+    if (pid < 0 || is_idle_pid(pid)) {
+        if (get_nr_running() > 0) {
+            return PIT_MIN_SHOT;
+        }
+    }
+    /* Slice expiry only matters with somebody else to run */
+    else if (get_nr_running() > 1) {
+        deadline = (pcb_array[pid].timeslice * PIT_TICK_CYCLES) - tick_cycles;
+    }
+
+    /* The tick the next kernel timer is due on */
+    timer_ticks = timer_next_event(PIT_MAX_SHOT / PIT_TICK_CYCLES + 1);
+    if (timer_ticks * PIT_TICK_CYCLES <= tick_cycles + PIT_MIN_SHOT) {
+        return PIT_MIN_SHOT;
+    }
+    if (timer_ticks * PIT_TICK_CYCLES - tick_cycles < deadline) {
+        deadline = timer_ticks * PIT_TICK_CYCLES - tick_cycles;
+    }
+
+    /* An IORING_SQPOLL program is only drained on ticks, keep them at
+     * the regular rate while it runs */
+    if (pid >= 0 && !is_idle_pid(pid) && (pcb_array[pid].io_ring_flags & IORING_SQPOLL)
+        && PIT_TICK_CYCLES < deadline) {
+        deadline = PIT_TICK_CYCLES;
+    }
+
+    /* The sampling profiler needs an interrupt at its rate */
+    prof_interval = prof_pit_interval();
+    if (prof_interval != 0 && prof_interval < deadline) {
+        deadline = prof_interval;
+    }
+    return deadline;
+}
+#endif
+
+/*
+ * tick_rearm
+ *   DESCRIPTION: Moves the armed one-shot to the current deadline after
+ *                the run queue changed (wakeup, fork, exit). The PIT only
+ *                interrupts CPU 0, elsewhere this does nothing
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: accounts the part of the old shot that already passed
+ */
+void tick_rearm(void) {
+#ifdef TICKLESS
+    uint32_t flags, remaining;
+
+    if (smp_processor_id() != 0) {
+        return;
+    }
+
+    cli_and_save(flags);
+    remaining = pit_read_count();
+
+    /* Already expired, the pending interrupt rearms */
+    if (shot_cycles != 0 && remaining != 0 && remaining <= shot_cycles) {
+        tick_account(shot_cycles - remaining);
+        pit_arm(next_deadline(get_global_pid()));
+    }
+    restore_flags(flags);
+#endif
+}
+
+/*
+ * get_jiffies
+ *   DESCRIPTION: Scheduler ticks (10 ms) since the PIT was set up
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: tick count
+ *   SIDE EFFECTS: none
+ */
+uint32_t get_jiffies(void) {
+    return jiffies;
+}
 
 /*
  * setup_pit
@@ -26,28 +234,119 @@ uint8_t* cmd_name;
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Enables IRQ0 and PIT
+ *   SIDE EFFECTS: Enables IRQ0 and PIT, or CPU 0's local APIC timer
+ *                 when interrupts go through the I/O APIC
  *   NOTE: PIT = Programmable Interrupt Timer
  */  
 int setup_pit() {
 
-    /* Calculate round robbin switching freq */
-    int freq = MAX_PIT_SPEED / 50;       // 100 Hz
+    /* Calculate scheduler tick divisor */
+    int freq = PIT_TICK_CYCLES;         // 100 Hz
+
+    /* Saves the port I/O of every PIT access and the I/O APIC round trip,
+     * IRQ0 stays masked */
+    if (irq_uses_apic()) {
+        lapic_clock = 1;
+#ifdef TICKLESS
+        pit_arm(freq);
+#else
+        lapic_timer_start();
+#endif
+        return 0;
+    }
 
+#ifdef TICKLESS
+    /* First shot one tick out, pit_handler picks the next deadline */
+    pit_arm(freq);
+#else
     /* Configure PIT */
     outb(0x36, 0x43);                   // 0x06 = mode 3 (Square Wave) | 0x30 = two byte config
     outb(freq & 0xFF, 0x40);            // 1st Byte: Low byte of the frequency
     outb((freq & 0xFF00) >> 8, 0x40);   // 2nd Byte: High byte of the frequency
+#endif
 
     /* Turn on PIC port */
     enable_irq(0);
     return 0;
 }
 
+/*
+ * pit_delay_cycles
+ *   DESCRIPTION: Busy waits on PIT channel 2, which leaves the scheduler
+ *                tick on channel 0 alone. For timing hardware at boot
+ *   INPUTS: cycles -- PIT input clocks, 1 to PIT_MAX_SHOT (16-bit counter)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: speaker stays off
+ */
+void pit_delay_cycles(uint32_t cycles) {
+    if (cycles > PIT_MAX_SHOT) cycles = PIT_MAX_SHOT;
+    if (cycles == 0) cycles = 1;
+
+    outb((inb(0x61) & ~0x02) | 0x01, 0x61);    // 0x61 bit 0 = channel 2 gate on, bit 1 = speaker off
+    outb(0xB0, 0x43);                           // 0x80 = channel 2 | 0x30 = two byte config | mode 0
+    outb(cycles & 0xFF, 0x42);
+    outb((cycles & 0xFF00) >> 8, 0x42);         // starts counting
+    while (!(inb(0x61) & 0x20)) {               // bit 5 = channel 2 output, high at terminal count
+        asm volatile ("pause" : : : "memory");
+    }
+}
+
+/*
+ * pit_delay_us
+ *   DESCRIPTION: pit_delay_cycles in microseconds
+ *   INPUTS: us -- microseconds, at most ~54 ms
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see pit_delay_cycles
+ */
+void pit_delay_us(uint32_t us) {
+    pit_delay_cycles((MAX_PIT_SPEED / 1000) * us / 1000);  // 1000 us per ms, 1000 ms per second
+}
+
+/*
+ * preemptible
+ *   DESCRIPTION: Whether an interrupt may switch away from a task
+ *   INPUTS: pid -- running task
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if its preempt count is zero, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+static int preemptible(int pid) {
+    return pcb_array[pid].preempt_count == 0;
+}
+
+/*
+ * tick_switch
+ *   DESCRIPTION: Switches to the task a timer tick picked, or defers the
+ *                switch until the running task leaves its critical section
+ *   INPUTS: curr_pid -- running task
+ *           next_pid -- pick of schedule()
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Updates global PID and changes stacks
+ */
+static void tick_switch(int curr_pid, int next_pid) {
+
+    if (next_pid < 0 || next_pid == curr_pid) {
+        return;
+    }
+
+    /* Inside a critical section, switch once it ends */
+    if (!preemptible(curr_pid)) {
+        this_cpu()->need_resched = 1;
+        return;
+    }
+
+    /* Task switch with next program found from schedule() */
+    scheduling_context_switch(next_pid);
+}
+
 /*
  * pit_handler
- *   DESCRIPTION: Switch to next scheduled task every time
- *                the PIT generates an interrrupt
+ *   DESCRIPTION: Charges the running task for the elapsed tick(s) and
+ *                switches to the next task picked from the run queue.
+ *                In TICKLESS mode also arms the next one-shot
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -55,159 +354,1389 @@ int setup_pit() {
  */  
 void pit_handler() {
 
+    int curr_pid, next_pid;
+
     send_eoi(0);
-    memcpy((char *) 0xB8000, (char*) 0xB8000 + get_term_num() * 0x1000, 4096);
-    // return;
     num_pit_interrupts += 1;
-    if (num_pit_interrupts == 1) {
-        execute((const uint8_t*)"shell");
+
+    /* Charge the elapsed tick(s) to the running task */
+#ifdef TICKLESS
+    tick_account(shot_cycles);
+#else
+    jiffies++;
+    timer_tick(jiffies);
+    scheduler_tick();
+#endif
+    vdso_tick(jiffies);
+
+    /* Nothing to preempt until the first shell is running */
+    curr_pid = get_global_pid();
+    if (curr_pid < 0) {
+#ifdef TICKLESS
+        pit_arm(PIT_TICK_CYCLES);
+#endif
+        return;
     }
 
-    /* Find next program to schedule and check if valid */
-    if (schedule() < 0) {
+    /* Find next program to schedule */
+    next_pid = schedule();
+
+#ifdef TICKLESS
+    /* Sleep until whatever next_pid has to be interrupted for */
+    pit_arm(next_deadline(next_pid));
+#endif
+
+    tick_switch(curr_pid, next_pid);
+}
+
+/*
+ * sched_ap_tick
+ *   DESCRIPTION: pit_handler for the other CPUs, driven by their local
+ *                APIC timer at PIT_HZ. Also where an idle CPU notices
+ *                work it can steal
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may switch tasks
+ */
+void sched_ap_tick(void) {
+    int curr_pid = get_global_pid();
 
-        /* No program to schedule, return */
-        send_eoi(0);
+    scheduler_tick();
+    if (curr_pid < 0) {
         return;
     }
-    
-    /* Task switch with next program found from schedule() */
-    // cli();
-    scheduling_context_switch();
+    tick_switch(curr_pid, schedule());
+}
 
+/*
+ * preempt_schedule
+ *   DESCRIPTION: Takes a switch that an interrupt had to defer
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none, returns once the caller runs again
+ *   SIDE EFFECTS: none if interrupts are off, the caller still relies on it
+ */
+static void preempt_schedule(void) {
+    uint32_t flags;
+    int curr_pid = get_global_pid();
+    int next_pid;
+
+    cli_and_save(flags);
+    if (!(flags & EFLAGS_IF) || curr_pid < 0) {
+        restore_flags(flags);
+        return;
+    }
+    this_cpu()->need_resched = 0;
+    next_pid = schedule();
+    if (next_pid != curr_pid) {
+        scheduling_context_switch(next_pid);
+    }
+    restore_flags(flags);
 }
 
 /*
- * schedule()
- *   DESCRIPTION: Searches active program list to find next
- *                program via round robin search
+ * preempt_disable
+ *   DESCRIPTION: Opens a critical section, interrupts still arrive but
+ *                cannot switch away from the task. Sections nest
  *   INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE: 0 = Success, -1 = Failure
- *   SIDE EFFECTS: none
- * 
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: raises the running task's preempt count
  */
-int schedule() {
-    
-    /* Next active program to schedule */
-    int loopstart = (curr_scheduled + 1) % 3;
-    int i;
+void preempt_disable(void) {
+    int curr_pid = get_global_pid();
 
-    /* Scan terminal array for next program to schedule */
-    for (i = loopstart; i < (loopstart + 3); i++) {
+    if (curr_pid >= 0) {
+        pcb_array[curr_pid].preempt_count++;
+    }
+}
 
-        /* Confirm non-NULL entry */
-        if (get_terminal_array_entry((i % 3)) >= 0) {
+/*
+ * preempt_enable
+ *   DESCRIPTION: Closes a critical section and takes the switch deferred
+ *                meanwhile once the outermost one ends
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may switch to another task
+ */
+void preempt_enable(void) {
+    int curr_pid = get_global_pid();
 
-            /* Set next scheduled program */
-            curr_scheduled = (i % 3);
-            return 0;
-        }
+    if (curr_pid < 0) {
+        return;
+    }
+    if (--pcb_array[curr_pid].preempt_count == 0 && this_cpu()->need_resched) {
+        preempt_schedule();
     }
-
-    /* No programs running, No scheduling */
-    return -1;
 }
 
 /*
- * scheduling_context_switch()
- *   DESCRIPTION: Updated global PID and task switches to
- *                run next program
+ * preempt_point
+ *   DESCRIPTION: Marks a spot in a long kernel path (file reads, program
+ *                loads) where the caller's state is consistent, so a
+ *                pending switch is taken without waiting for the next tick
  *   INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE:
- *   SIDE EFFECTS: Edits ss0, esp0, ebp, and esp
- * 
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may switch to another task, never inside a section
+ *                 (bottom halves included), preempt_enable takes it there
  */
-void scheduling_context_switch() {
-    
-    /********** Get current program PID **********/
-    global_pid = get_global_pid();
+void preempt_point(void) {
+    int curr_pid = get_global_pid();
 
-    int past_pid = global_pid;
+    if (curr_pid < 0 || !preemptible(curr_pid)) {
+        return;
+    }
+    if (this_cpu()->need_resched) {
+        preempt_schedule();
+    }
+}
 
-    /********** Save EBP and ESP  **********/
-    //? Vid map maybe?
+/*
+ * find_first_bit
+ *   DESCRIPTION: Index of the lowest set bit
+ *   INPUTS: word -- non-zero bitmap
+ *   OUTPUTS: none
+ *   RETURN VALUE: bit index (0-31)
+ *   SIDE EFFECTS: none
+ */
+static inline int find_first_bit(uint32_t word) {
+    int bit;
+    asm volatile ("bsfl %1, %0" : "=r" (bit) : "rm" (word) : "cc");
+    return bit;
+}
 
-   
+/*
+ * rq_init
+ *   DESCRIPTION: Empties all priority arrays of every CPU, done lazily on
+ *                first use
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: resets the run queues
+ */
+static void rq_init(void) {
+    int cpu, i, j;
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        for (i = 0; i < NUM_ARRAYS; i++) {
+            rqs[cpu].arrays[i].bitmap = 0;
+            rqs[cpu].arrays[i].nr_queued = 0;
+            for (j = 0; j < NUM_PRIO; j++) {
+                rqs[cpu].arrays[i].head[j] = -1;
+                rqs[cpu].arrays[i].tail[j] = -1;
+            }
+        }
+        rqs[cpu].active = 0;
+        rqs[cpu].nr_running = 0;
+        rqs[cpu].rt_period_ticks = 0;
+        rqs[cpu].rt_time = 0;
+        rqs[cpu].rt_throttled = 0;
+    }
+    rq_initialized = 1;
+}
 
-    /*************** Update to next Global PID  ***************/
-    set_global_pid(get_terminal_array_entry(curr_scheduled));
-    global_pid = get_global_pid();
-    //TODO: Video Map?
+/*
+ * effective_prio
+ *   DESCRIPTION: Static priority of a best-effort task raised by its
+ *                interactive boosts: running on the displayed terminal
+ *                (kernel threads have none) and having just been woken
+ *                by the keyboard
+ *   INPUTS: pid -- task
+ *   OUTPUTS: none
+ *   RETURN VALUE: priority level, 0 = highest
+ *   SIDE EFFECTS: none
+ */
+static int effective_prio(int pid) {
+    int prio = pcb_array[pid].priority;
 
-    /* Ensure not a terminal */
-    // if(get_pcb_pid(global_pid).parent_pcb_pid != -1){
+    if (!pcb_array[pid].kthread && pcb_array[pid].terminal_idx + 1 == get_term_num()) {
+        prio -= FG_BOOST;
+    }
+    if (pcb_array[pid].kbd_boost) {
+        prio -= KBD_BOOST;
+    }
+    return (prio < 0) ? 0 : prio;
+}
 
-        /*************** Setup New Paging  ***************/
-        execute_page_setup((uint32_t) (4 * global_pid + 8)); // sets up the page + VA and PA mapping
-        // flush_tlbs();
+/*
+ * task_level
+ *   DESCRIPTION: List a task is queued on within its priority array
+ *   INPUTS: pid -- task
+ *   OUTPUTS: none
+ *   RETURN VALUE: rt_priority for SCHED_RR, 0 for SCHED_EDF, the boosted
+ *                 priority otherwise
+ *   SIDE EFFECTS: none
+ */
+static int task_level(int pid) {
+    switch (pcb_array[pid].policy) {
+        case SCHED_RR:
+            return pcb_array[pid].rt_priority;
+        case SCHED_EDF:
+            return 0;
+        default:
+            return effective_prio(pid);
+    }
+}
 
-        // cmd_name = (uint8_t*) get_pcb_pid(global_pid).cmd;
-        // user_level_program_loader(cmd_name);
+/*
+ * deadline_before
+ *   DESCRIPTION: Compares two RTC tick deadlines, correct across wrap
+ *   INPUTS: a, b -- absolute deadlines
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if a is earlier than b, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+static inline int deadline_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
 
-        /*************** Set TSS ***************/
-            set_tss_ss0(0x00000018);                            //0x800000: 8MB, virtual adress of bottom of kernel page
-            set_tss_esp0(0x800000 - (global_pid * 0x2000)-4); //0x2000: 8 kb, the amount of space per task kernel stack*/
+/*
+ * array_enqueue
+ *   DESCRIPTION: Appends a task to the tail of its priority list
+ *   INPUTS: idx -- priority array index (0, 1 or RT_ARRAY)
+ *           pid -- task to queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links the task into arrays[idx] of its CPU's run queue
+ */
+static void array_enqueue(int idx, int pid) {
+    prio_array* array = &task_rq(pid)->arrays[idx];
+    int prio = task_level(pid);
+
+    pcb_array[pid].run_array = idx;
+    pcb_array[pid].run_level = prio;
+    pcb_array[pid].run_next = -1;
+    pcb_array[pid].run_prev = array->tail[prio];
+
+    if (array->tail[prio] >= 0) {
+        pcb_array[array->tail[prio]].run_next = pid;
+    } else {
+        array->head[prio] = pid;
+    }
+    array->tail[prio] = pid;
+    array->bitmap |= (1 << prio);
+    array->nr_queued++;
+}
 
-        // printf("pid: %d\n", global_pid);
+/*
+ * array_dequeue
+ *   DESCRIPTION: Unlinks a task from whichever priority array holds it.
+ *                Uses the level it was linked on, boosts may have changed
+ *   INPUTS: pid -- queued task
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: clears the list bit once a priority level empties
+ */
+static void array_dequeue(int pid) {
+    prio_array* array = &task_rq(pid)->arrays[pcb_array[pid].run_array];
+    int prio = pcb_array[pid].run_level;
+    int prev = pcb_array[pid].run_prev;
+    int next = pcb_array[pid].run_next;
+
+    if (prev >= 0) {
+        pcb_array[prev].run_next = next;
+    } else {
+        array->head[prio] = next;
+    }
+    if (next >= 0) {
+        pcb_array[next].run_prev = prev;
+    } else {
+        array->tail[prio] = prev;
+    }
+    if (array->head[prio] < 0) {
+        array->bitmap &= ~(1 << prio);
+    }
+    array->nr_queued--;
 
-            
-            
-            /********** Reset interrrupt **********/
-            send_eoi(0);
-            
+    pcb_array[pid].run_array = -1;
+    pcb_array[pid].run_prev = -1;
+    pcb_array[pid].run_next = -1;
+}
 
+/*
+ * edf_enqueue
+ *   DESCRIPTION: Inserts a SCHED_EDF task behind every task whose
+ *                deadline is not later than its own
+ *   INPUTS: pid -- task to queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links the task into arrays[EDF_ARRAY] of its CPU's run queue
+ */
+static void edf_enqueue(int pid) {
+    prio_array* array = &task_rq(pid)->arrays[EDF_ARRAY];
+    int next = array->head[0];
 
-             /********** Save EBP and ESP  **********/
-                asm volatile(
-                    "movl %%esp, %0     \n;"
-                    :"=r" (esp_val)
-                    :
-                    :"memory"
-                );
-                asm volatile(
-                    "movl %%ebp, %0     \n;"
-                    :"=r" (ebp_val)
-                    :
-                    :"memory"
-                );
+    while (next >= 0 && !deadline_before(pcb_array[pid].rt_deadline, pcb_array[next].rt_deadline)) {
+        next = pcb_array[next].run_next;
+    }
 
-                /*************** Save old ESP & EBP to past PID ***************/
-                set_pcb_esp(past_pid, esp_val);
-                set_pcb_ebp(past_pid, ebp_val);
+    /* Latest deadline, append */
+    if (next < 0) {
+        array_enqueue(EDF_ARRAY, pid);
+        return;
+    }
 
+    pcb_array[pid].run_array = EDF_ARRAY;
+    pcb_array[pid].run_level = 0;
+    pcb_array[pid].run_next = next;
+    pcb_array[pid].run_prev = pcb_array[next].run_prev;
+    if (pcb_array[next].run_prev >= 0) {
+        pcb_array[pcb_array[next].run_prev].run_next = pid;
+    } else {
+        array->head[0] = pid;
+    }
+    pcb_array[next].run_prev = pid;
+    array->nr_queued++;
+}
 
-                /********** Get next EBP and ESP from next PID **********/
-            esp_val = get_esp(global_pid);
-            ebp_val = get_ebp(global_pid);
+/*
+ * queue_task
+ *   DESCRIPTION: Links a task into the array of its scheduling class
+ *   INPUTS: pid -- task to queue
+ *           expired -- best-effort task goes to the expired array
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none beyond the run queue links
+ */
+static void queue_task(int pid, int expired) {
+    switch (pcb_array[pid].policy) {
+        case SCHED_EDF:
+            edf_enqueue(pid);
+            break;
+        case SCHED_RR:
+            array_enqueue(RT_ARRAY, pid);
+            break;
+        default:
+            array_enqueue(expired ? (task_rq(pid)->active ^ 1) : task_rq(pid)->active, pid);
+            break;
+    }
+}
 
-            // sti();
+/*
+ * requeue_task
+ *   DESCRIPTION: Moves a queued task to where its current class,
+ *                priority and deadline put it
+ *   INPUTS: pid -- task, ignored if not queued
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: caller must have interrupts disabled
+ */
+static void requeue_task(int pid) {
+    int expired = (pcb_array[pid].run_array == (task_rq(pid)->active ^ 1));
 
+    if (pcb_array[pid].run_array < 0) {
+        return;
+    }
+    array_dequeue(pid);
+    queue_task(pid, expired);
+}
 
-            // printf("esp_val: %x\n", esp_val);
-            // printf("ebp_val: %x\n", ebp_val);
-            /********** Set next EBP and ESP **********/
-            asm volatile(
-                "movl %0, %%esp     \n;"
-                "movl %1, %%ebp     \n;"
-                :
-                :"g" (esp_val), "g" (ebp_val)
-                :"memory"
-            );
+/*
+ * task_rank
+ *   DESCRIPTION: Scheduling class order, EDF over RR over best effort
+ *   INPUTS: pid -- task
+ *   OUTPUTS: none
+ *   RETURN VALUE: higher runs first, -1 for the idle task
+ *   SIDE EFFECTS: none
+ */
+static int task_rank(int pid) {
+    if (is_idle_pid(pid)) {
+        return -1;
+    }
+    switch (pcb_array[pid].policy) {
+        case SCHED_EDF:
+            return 2;
+        case SCHED_RR:
+            return 1;
+        default:
+            return 0;
+    }
+}
 
+/*
+ * task_preempts
+ *   DESCRIPTION: Whether a freshly woken task should take the CPU right
+ *                away instead of waiting for the next slice expiry.
+ *                Between best-effort tasks the boosted priority decides
+ *   INPUTS: next -- woken task, curr -- running task
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 to preempt, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+static int task_preempts(int next, int curr) {
+    if (task_rank(next) != task_rank(curr)) {
+        return task_rank(next) > task_rank(curr);
+    }
+    switch (pcb_array[curr].policy) {
+        case SCHED_EDF:
+            return deadline_before(pcb_array[next].rt_deadline, pcb_array[curr].rt_deadline);
+        case SCHED_RR:
+            return pcb_array[next].rt_priority < pcb_array[curr].rt_priority;
+        default:
+            return effective_prio(next) < effective_prio(curr);
+    }
+}
 
-            
-            
-    // }
-    // else{
-    //     send_eoi(0);
-    // }   
+/*
+ * task_slice
+ *   DESCRIPTION: Full slice of a task, its override if it has one and
+ *                the weight of its boosted priority otherwise
+ *   INPUTS: pid -- task
+ *   OUTPUTS: none
+ *   RETURN VALUE: slice length in PIT ticks
+ *   SIDE EFFECTS: none
+ */
+static int task_slice(int pid) {
+    if (pcb_array[pid].slice_ticks > 0) {
+        return pcb_array[pid].slice_ticks;
+    }
+    return prio_to_slice[effective_prio(pid)];
+}
 
-    /********** Switch **********/
-    // printf("Finished!\n");
+/*
+ * sched_target
+ *   DESCRIPTION: Resolves the PID argument of the priority system calls
+ *   INPUTS: pid -- PID, negative for the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: live user PID, -1 if there is none
+ *   SIDE EFFECTS: none
+ */
+static int sched_target(int pid) {
+    if (pid < 0) {
+        pid = get_global_pid();
+    }
+    if (pid < 0 || pid >= MAX_PROCESSES || pcb_array[pid].state == TASK_UNUSED) {
+        return -1;
+    }
+    return pid;
+}
 
-    return;
+/*
+ * sched_task_init
+ *   DESCRIPTION: Resets the scheduler fields of a freshly created task
+ *   INPUTS: pid -- new task
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: task starts with its parent's priority, slice override
+ *                 and scheduling class (DEFAULT_PRIO best effort for base
+ *                 shells) and a full slice, on the creating CPU
+ */
+void sched_task_init(int pid) {
+    int parent = pcb_array[pid].parent_pcb_pid;
+
+    pcb_array[pid].state = TASK_BLOCKED;
+    pcb_array[pid].priority = DEFAULT_PRIO;
+    pcb_array[pid].slice_ticks = 0;
+    pcb_array[pid].policy = SCHED_NORMAL;
+    pcb_array[pid].rt_priority = 0;
+    pcb_array[pid].rt_rel_deadline = 0;
+
+    /* Programs started from a reniced shell stay reniced */
+    if (parent >= 0 && parent < MAX_PROCESSES) {
+        pcb_array[pid].priority = pcb_array[parent].priority;
+        pcb_array[pid].slice_ticks = pcb_array[parent].slice_ticks;
+        pcb_array[pid].policy = pcb_array[parent].policy;
+        pcb_array[pid].rt_priority = pcb_array[parent].rt_priority;
+        pcb_array[pid].rt_rel_deadline = pcb_array[parent].rt_rel_deadline;
+    }
+    pcb_array[pid].rt_period = 0;
+    pcb_array[pid].rt_deadline = 0;
+    pcb_array[pid].rt_released = 0;
+    pcb_array[pid].deadline_misses = 0;
+    pcb_array[pid].kbd_boost = 0;
+    pcb_array[pid].timeslice = task_slice(pid);
+    pcb_array[pid].run_array = -1;
+    pcb_array[pid].run_level = 0;
+    pcb_array[pid].run_prev = -1;
+    pcb_array[pid].run_next = -1;
+    pcb_array[pid].sched_ticks = 0;
+    pcb_array[pid].wait_chan = NULL;
+    pcb_array[pid].preempt_count = 0;
+    pcb_array[pid].cpu = smp_processor_id();
+    pcb_array[pid].lock_depth = 0;
+}
+
+/*
+ * find_idle_cpu
+ *   DESCRIPTION: Another online CPU that is running its idle task
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: CPU index, -1 if every other CPU is busy
+ *   SIDE EFFECTS: none
+ */
+static int find_idle_cpu(void) {
+    int cpu;
+
+    for (cpu = 0; cpu < num_cpus; cpu++) {
+        if (cpu != smp_processor_id() && cpus[cpu].online && is_idle_pid(cpus[cpu].curr_pid)) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+/*
+ * enqueue_task
+ *   DESCRIPTION: Makes a task runnable by adding it to the active array
+ *                of its scheduling class, on the run queue of its CPU
+ *   INPUTS: pid -- task to wake
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: caller must have interrupts disabled. Pokes the owning
+ *                 CPU, and an idle one that may steal the task if the
+ *                 owner is busy
+ */
+void enqueue_task(int pid) {
+    if (!rq_initialized) {
+        rq_init();
+    }
+    if (pcb_array[pid].run_array >= 0) {
+        return;
+    }
+    queue_task(pid, 0);
+    pcb_array[pid].state = TASK_RUNNABLE;
+    task_rq(pid)->nr_running++;
+
+    /* A new deadline may exist now (slice expiry, leaving idle) */
+    tick_rearm();
+    if (pcb_array[pid].cpu != smp_processor_id()) {
+        smp_send_resched(pcb_array[pid].cpu);
+    }
+    if (!is_idle_pid(cpus[pcb_array[pid].cpu].curr_pid)) {
+        smp_send_resched(find_idle_cpu());
+    }
+}
+
+/*
+ * dequeue_task
+ *   DESCRIPTION: Removes a task from the run queue (blocking or exiting)
+ *   INPUTS: pid -- task to remove
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: caller must have interrupts disabled
+ */
+void dequeue_task(int pid) {
+    if (pcb_array[pid].run_array < 0) {
+        return;
+    }
+    array_dequeue(pid);
+    pcb_array[pid].state = TASK_BLOCKED;
+    task_rq(pid)->nr_running--;
+}
+
+/*
+ * pick_next_task
+ *   DESCRIPTION: O(1) pick of the earliest deadline SCHED_EDF task, else
+ *                the highest SCHED_RR one, else the highest priority
+ *                best-effort task with slice left, swapping the arrays
+ *                once every active task expired. A throttled CPU skips
+ *                the real-time classes while best-effort tasks wait
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PID to run next on this CPU, -1 if its run queue is empty
+ *   SIDE EFFECTS: may swap the active and expired arrays
+ */
+int pick_next_task(void) {
+    runqueue* rq = this_rq();
+    prio_array* array;
+
+    if (!rq_initialized || rq->nr_running == 0) {
+        return -1;
+    }
+
+    /* Real-time classes first, earliest deadline then fixed priority */
+    if (!rq->rt_throttled || rq->arrays[rq->active].nr_queued + rq->arrays[rq->active ^ 1].nr_queued == 0) {
+        if (rq->arrays[EDF_ARRAY].nr_queued > 0) {
+            return rq->arrays[EDF_ARRAY].head[0];
+        }
+        array = &rq->arrays[RT_ARRAY];
+        if (array->nr_queued > 0) {
+            return array->head[find_first_bit(array->bitmap)];
+        }
+    }
+
+    array = &rq->arrays[rq->active];
+    if (array->nr_queued == 0) {
+        rq->active ^= 1;
+        array = &rq->arrays[rq->active];
+    }
+    if (array->nr_queued == 0) {
+        return -1;
+    }
+
+    return array->head[find_first_bit(array->bitmap)];
+}
+
+/*
+ * steal_task
+ *   DESCRIPTION: Work stealing for a CPU with an empty run queue: moves a
+ *                queued task that is not running from the busiest other
+ *                queue over here, highest scheduling class first
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: stolen PID, -1 if no CPU has a task to spare
+ *   SIDE EFFECTS: the task stays on this CPU until stolen back
+ */
+static int steal_task(void) {
+    int me = smp_processor_id();
+    int cpu, pid, spare, expired;
+    int busiest = -1, most = 0, victim = -1;
+
+    if (!rq_initialized) {
+        return -1;
+    }
+
+    for (cpu = 0; cpu < num_cpus; cpu++) {
+        if (cpu == me || !cpus[cpu].online) {
+            continue;
+        }
+        /* The task running there stays queued but cannot move */
+        spare = rqs[cpu].nr_running;
+        if (cpus[cpu].curr_pid >= 0 && !is_idle_pid(cpus[cpu].curr_pid) &&
+            pcb_array[cpus[cpu].curr_pid].run_array >= 0) {
+            spare--;
+        }
+        if (spare > most) {
+            most = spare;
+            busiest = cpu;
+        }
+    }
+    if (busiest < 0) {
+        return -1;
+    }
+
+    for (pid = 0; pid < MAX_PROCESSES; pid++) {
+        if (pcb_array[pid].run_array < 0 || pcb_array[pid].cpu != busiest || pid == cpus[busiest].curr_pid) {
+            continue;
+        }
+        if (victim < 0 || task_rank(pid) > task_rank(victim)) {
+            victim = pid;
+        }
+    }
+    if (victim < 0) {
+        return -1;
+    }
+
+    expired = (pcb_array[victim].run_array == (rqs[busiest].active ^ 1));
+    array_dequeue(victim);
+    rqs[busiest].nr_running--;
+    pcb_array[victim].cpu = me;
+    queue_task(victim, expired);
+    rqs[me].nr_running++;
+
+    return victim;
+}
+
+/*
+ * scheduler_tick
+ *   DESCRIPTION: Charges the running task for one tick and moves it
+ *                to the expired array (best effort) or the tail of its
+ *                list (real time) once its slice is used up
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called from the timer handlers with interrupts disabled
+ */
+void scheduler_tick(void) {
+    int curr_pid = get_global_pid();
+
+    if (curr_pid < 0) {
+        return;
+    }
+    sched_rt_tick(curr_pid);
+    if (curr_pid == IDLE_PID) {
+        idle_ticks++;
+        return;
+    }
+    busy_ticks++;
+
+    if (pcb_array[curr_pid].run_array < 0) {
+        return;
+    }
+
+    pcb_array[curr_pid].sched_ticks++;
+    if (--pcb_array[curr_pid].timeslice > 0) {
+        return;
+    }
+
+    /* A whole slice of CPU is no longer interactive */
+    pcb_array[curr_pid].kbd_boost = 0;
+    pcb_array[curr_pid].timeslice = task_slice(curr_pid);
+
+    /* A job still running past its deadline has missed it, push the
+     * deadline back a period so the other real-time tasks get the CPU */
+    if (pcb_array[curr_pid].policy == SCHED_EDF && pcb_array[curr_pid].rt_released) {
+        if (deadline_before(pcb_array[curr_pid].rt_deadline, get_rtc_ticks())) {
+            pcb_array[curr_pid].deadline_misses++;
+            pcb_array[curr_pid].rt_deadline += pcb_array[curr_pid].rt_period;
+        }
+    }
+
+    /* Slice used up, RT tasks go to the back of their list, best-effort
+     * ones wait for the array swap */
+    array_dequeue(curr_pid);
+    queue_task(curr_pid, 1);
+}
+
+/*
+ * sched_rt_tick
+ *   DESCRIPTION: Real-time bandwidth accounting of one tick on this CPU.
+ *                Once SCHED_RR and SCHED_EDF tasks ran RT_RUNTIME_TICKS of
+ *                the RT_PERIOD_TICKS period the CPU is throttled until
+ *                the period ends
+ *   INPUTS: pid -- task the tick went to, idle included
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called by scheduler_tick with interrupts disabled
+ */
+void sched_rt_tick(int pid) {
+    runqueue* rq = this_rq();
+
+    if (++rq->rt_period_ticks >= RT_PERIOD_TICKS) {
+        rq->rt_period_ticks = 0;
+        rq->rt_time = 0;
+        rq->rt_throttled = 0;
+        return;
+    }
+    if (is_idle_pid(pid) || pcb_array[pid].policy == SCHED_NORMAL) {
+        return;
+    }
+    if (++rq->rt_time >= RT_RUNTIME_TICKS) {
+        rq->rt_throttled = 1;
+    }
+}
+
+/*
+ * get_nr_running
+ *   DESCRIPTION: Number of runnable tasks on the calling CPU
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: tasks on its run queue
+ *   SIDE EFFECTS: none
+ */
+int get_nr_running(void) {
+    return this_rq()->nr_running;
+}
+
+/*
+ * sched_setpriority
+ *   DESCRIPTION: Changes the static priority of a task. A queued
+ *                best-effort task moves to the list of its new level in
+ *                the same array
+ *   INPUTS: pid -- task, negative for the caller
+ *           prio -- 0 (highest) to NUM_PRIO - 1
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on a bad PID or priority
+ *   SIDE EFFECTS: the slice left is cut down to the new full slice
+ */
+int32_t sched_setpriority(int pid, int prio) {
+    uint32_t flags;
+
+    pid = sched_target(pid);
+    if (pid < 0 || prio < 0 || prio >= NUM_PRIO) {
+        return -1;
+    }
+
+    cli_and_save(flags);
+    pcb_array[pid].priority = prio;
+    requeue_task(pid);
+    if (pcb_array[pid].timeslice > task_slice(pid)) {
+        pcb_array[pid].timeslice = task_slice(pid);
+    }
+    tick_rearm();
+    restore_flags(flags);
+
+    return 0;
+}
+
+/*
+ * sched_getpriority
+ *   DESCRIPTION: Reads the static priority of a task
+ *   INPUTS: pid -- task, negative for the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: priority, -1 on a bad PID
+ *   SIDE EFFECTS: none
+ */
+int32_t sched_getpriority(int pid) {
+    pid = sched_target(pid);
+    if (pid < 0) {
+        return -1;
+    }
+    return pcb_array[pid].priority;
+}
+
+/*
+ * sched_set_timeslice
+ *   DESCRIPTION: Overrides the slice a task gets from its priority
+ *   INPUTS: pid -- task, negative for the caller
+ *           ms -- slice length, rounded up to whole PIT ticks,
+ *                 0 to go back to the priority default
+ *   OUTPUTS: none
+ *   RETURN VALUE: slice in ms after rounding, -1 on a bad PID or length
+ *   SIDE EFFECTS: takes effect from the next refill, or right away if
+ *                 less than the new slice is left
+ */
+int32_t sched_set_timeslice(int pid, int ms) {
+    uint32_t flags;
+
+    pid = sched_target(pid);
+    if (pid < 0 || ms < 0 || ms > MAX_SLICE_MS) {
+        return -1;
+    }
+
+    cli_and_save(flags);
+    pcb_array[pid].slice_ticks = (ms * PIT_HZ + 999) / 1000;    // 1000 ms per second
+    if (pcb_array[pid].timeslice > task_slice(pid)) {
+        pcb_array[pid].timeslice = task_slice(pid);
+    }
+    tick_rearm();
+    restore_flags(flags);
+
+    return task_slice(pid) * (1000 / PIT_HZ);
+}
+
+/*
+ * sched_setscheduler
+ *   DESCRIPTION: Moves a task to another scheduling class
+ *   INPUTS: pid -- task, negative for the caller
+ *           policy -- SCHED_NORMAL, SCHED_RR or SCHED_EDF
+ *           param -- SCHED_RR: rt priority, 0 (highest) to NUM_PRIO - 1
+ *                    SCHED_EDF: relative deadline in ms, 0 for the
+ *                    period of the task's RTC reads
+ *                    SCHED_NORMAL: ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on a bad PID, policy or param
+ *   SIDE EFFECTS: resets the deadline miss count
+ */
+int32_t sched_setscheduler(int pid, int policy, int param) {
+    uint32_t flags;
+    int queued;
+
+    pid = sched_target(pid);
+    if (pid < 0 || param < 0) {
+        return -1;
+    }
+    if (policy == SCHED_RR && param >= NUM_PRIO) {
+        return -1;
+    }
+    if (policy != SCHED_NORMAL && policy != SCHED_RR && policy != SCHED_EDF) {
+        return -1;
+    }
+
+    cli_and_save(flags);
+    queued = (pcb_array[pid].run_array >= 0);
+    if (queued) {
+        array_dequeue(pid);
+    }
+    pcb_array[pid].policy = policy;
+    pcb_array[pid].rt_priority = (policy == SCHED_RR) ? param : 0;
+    pcb_array[pid].rt_rel_deadline = (policy == SCHED_EDF) ? (param * RTC_MAX + 999) / 1000 : 0;  // ms to RTC ticks
+    pcb_array[pid].rt_released = 0;
+    pcb_array[pid].rt_deadline = get_rtc_ticks();
+    pcb_array[pid].deadline_misses = 0;
+    if (queued) {
+        queue_task(pid, 0);
+    }
+    tick_rearm();
+    restore_flags(flags);
+
+    return 0;
+}
+
+/*
+ * sched_getscheduler
+ *   DESCRIPTION: Reads the scheduling class of a task
+ *   INPUTS: pid -- task, negative for the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: SCHED_* policy, -1 on a bad PID
+ *   SIDE EFFECTS: none
+ */
+int32_t sched_getscheduler(int pid) {
+    pid = sched_target(pid);
+    if (pid < 0) {
+        return -1;
+    }
+    return pcb_array[pid].policy;
+}
+
+/*
+ * sched_deadline_misses
+ *   DESCRIPTION: Jobs of a real-time task that finished after their
+ *                deadline, or overran it by a whole slice
+ *   INPUTS: pid -- task, negative for the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: miss count since the last sched_setscheduler, -1 on a
+ *                 bad PID
+ *   SIDE EFFECTS: none
+ */
+int32_t sched_deadline_misses(int pid) {
+    pid = sched_target(pid);
+    if (pid < 0) {
+        return -1;
+    }
+    return pcb_array[pid].deadline_misses;
+}
+
+/*
+ * sched_rt_complete
+ *   DESCRIPTION: Ends the current job of a real-time task, called when
+ *                it goes back to waiting for its next period
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: counts a miss if the job finished past its deadline
+ */
+void sched_rt_complete(void) {
+    uint32_t flags;
+    int pid = get_global_pid();
+
+    if (pid < 0 || pid >= MAX_PROCESSES || pcb_array[pid].policy == SCHED_NORMAL) {
+        return;
+    }
+
+    cli_and_save(flags);
+    if (pcb_array[pid].rt_released &&
+        deadline_before(pcb_array[pid].rt_deadline, get_rtc_ticks())) {
+        pcb_array[pid].deadline_misses++;
+    }
+    pcb_array[pid].rt_released = 0;
+    restore_flags(flags);
+}
+
+/*
+ * sched_rt_release
+ *   DESCRIPTION: Starts a new job of a real-time task, called when its
+ *                period elapsed. The deadline is one period out unless
+ *                SCHED_EDF was given a relative deadline
+ *   INPUTS: period -- RTC ticks between the task's wakeups
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: re-sorts a SCHED_EDF task on its new deadline
+ */
+void sched_rt_release(uint32_t period) {
+    uint32_t flags;
+    int pid = get_global_pid();
+
+    if (pid < 0 || pid >= MAX_PROCESSES || pcb_array[pid].policy == SCHED_NORMAL) {
+        return;
+    }
+
+    cli_and_save(flags);
+    pcb_array[pid].rt_period = pcb_array[pid].rt_rel_deadline ? pcb_array[pid].rt_rel_deadline : period;
+    pcb_array[pid].rt_deadline = get_rtc_ticks() + pcb_array[pid].rt_period;
+    pcb_array[pid].rt_released = 1;
+    requeue_task(pid);
+    restore_flags(flags);
+}
+
+/*
+ * sched_idle_init
+ *   DESCRIPTION: Turns the calling CPU's boot context into its idle task.
+ *                Called once by the kernel before the first shell is
+ *                spawned, so spawning saves the boot frame as the idle
+ *                task's context, and by ap_main on the other CPUs
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets the global PID to IDLE_PID
+ */
+void sched_idle_init(void) {
+    sched_task_init(IDLE_PID);
+    pcb_array[IDLE_PID].state = TASK_RUNNABLE;     // always runnable, never queued
+    pcb_array[IDLE_PID].terminal_idx = 0;
+    pcb_array[IDLE_PID].parent_pcb_pid = -1;
+    pcb_array[IDLE_PID].ctx.esp0 = KERNEL_STACK_TOP(IDLE_PID);
+    pcb_array[IDLE_PID].ctx.cr3 = (uint32_t) page_directory;     // kernel only mappings
+    strcpy(pcb_array[IDLE_PID].comm, (int8_t*) "idle");
+    set_global_pid(IDLE_PID);
+}
+
+/*
+ * cpu_idle
+ *   DESCRIPTION: Body of the idle task, halts until the next interrupt
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: enables interrupts
+ */
+void cpu_idle(void) {
+    while (1) {
+        irqsoff_hook_on();
+        asm volatile ("sti; hlt" : : : "memory");
+    }
+}
+
+/*
+ * get_idle_ticks / get_busy_ticks
+ *   DESCRIPTION: Ticks that landed in an idle task / in a process, summed
+ *                over all CPUs
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: tick count since boot
+ *   SIDE EFFECTS: none
+ */
+uint32_t get_idle_ticks(void) {
+    return idle_ticks;
+}
+
+uint32_t get_busy_ticks(void) {
+    return busy_ticks;
+}
+
+/*
+ * sched_stat_field
+ *   DESCRIPTION: Appends a string and a separator to a line
+ *   INPUTS: line -- line being built, str -- text to add,
+ *           sep -- character after it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: line must have room for str and 2 more characters
+ */
+static void sched_stat_field(int8_t* line, const int8_t* str, int8_t sep) {
+    int8_t* end = line + strlen(line);
+
+    strcpy(end, str);
+    end += strlen(end);
+    end[0] = sep;
+    end[1] = '\0';
+}
+
+/*
+ * sched_stat_read
+ *   DESCRIPTION: Writes a header, then "pid cpu state class prio ticks
+ *                name" for every process and kernel thread, then the idle
+ *                and busy tick totals. State is R (running), Q (on a run
+ *                queue) or S (sleeping), ticks are PIT ticks run
+ *   INPUTS: buf -- destination, nbytes -- its size
+ *   OUTPUTS: the text, not NUL terminated
+ *   RETURN VALUE: bytes written, lines that do not fit are left out
+ *   SIDE EFFECTS: none
+ */
+int32_t sched_stat_read(uint8_t* buf, int32_t nbytes) {
+    static const int8_t* class_names[] = { "normal", "rr", "edf" };
+    int8_t line[SCHED_STAT_LINE];
+    int8_t num[12];                     // 10 digits, sign and NUL
+    int32_t len, written = 0;
+    int pid, state;
+
+    for (pid = -1; pid <= MAX_PROCESSES; pid++) {
+        line[0] = '\0';
+        if (pid < 0) {
+            strcpy(line, (int8_t*) "pid cpu state class prio ticks name\n");
+        } else if (pid == MAX_PROCESSES) {
+            sched_stat_field(line, (int8_t*) "idle", ' ');
+            itoa(idle_ticks, num, 10);
+            sched_stat_field(line, num, ' ');
+            sched_stat_field(line, (int8_t*) "busy", ' ');
+            itoa(busy_ticks, num, 10);
+            sched_stat_field(line, num, '\n');
+        } else if (pcb_array[pid].state != TASK_UNUSED) {
+            state = pcb_array[pid].state;
+            itoa(pid, num, 10);
+            sched_stat_field(line, num, ' ');
+            itoa(pcb_array[pid].cpu, num, 10);
+            sched_stat_field(line, num, ' ');
+            if (cpus[pcb_array[pid].cpu].curr_pid == pid) {
+                sched_stat_field(line, (int8_t*) "R", ' ');
+            } else {
+                sched_stat_field(line, (int8_t*) ((state == TASK_RUNNABLE) ? "Q" : "S"), ' ');
+            }
+            sched_stat_field(line, class_names[pcb_array[pid].policy], ' ');
+            itoa((pcb_array[pid].policy == SCHED_RR) ? pcb_array[pid].rt_priority : pcb_array[pid].priority, num, 10);
+            sched_stat_field(line, num, ' ');
+            itoa(pcb_array[pid].sched_ticks, num, 10);
+            sched_stat_field(line, num, ' ');
+            sched_stat_field(line, pcb_array[pid].comm, '\n');
+        }
+
+        len = strlen(line);
+        if (written + len > nbytes) {
+            break;
+        }
+        memcpy(buf + written, line, len);
+        written += len;
+    }
+    return written;
+}
+
+/*
+ * sleep_on
+ *   DESCRIPTION: Takes the current task off the run queue until
+ *                wake_up(chan). Callers recheck their condition in a
+ *                loop with interrupts off so a wakeup cannot be lost
+ *   INPUTS: chan -- any address identifying the event
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: switches to another task or the idle task
+ */
+void sleep_on(void* chan) {
+    uint32_t flags;
+    int curr_pid = get_global_pid();
+
+    cli_and_save(flags);
+    if (curr_pid < 0 || curr_pid == IDLE_PID) {
+        /* No task to park (boot / tests), wait for the next interrupt */
+        irqsoff_hook_on();
+        asm volatile ("sti; hlt; cli" : : : "memory");
+        irqsoff_hook_off();
+    }
+    else {
+        dequeue_task(curr_pid);
+        pcb_array[curr_pid].wait_chan = chan;
+        pcb_array[curr_pid].kbd_boost = 0;
+        scheduling_context_switch(schedule());
+    }
+    restore_flags(flags);
+}
+
+/*
+ * wake_up
+ *   DESCRIPTION: Puts every task sleeping on chan back on the run queue
+ *   INPUTS: chan -- address passed to sleep_on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: safe to call from interrupt handlers
+ */
+void wake_up(void* chan) {
+    uint32_t flags;
+    int pid;
+
+    cli_and_save(flags);
+    for (pid = 0; pid < MAX_PROCESSES; pid++) {
+        if (pcb_array[pid].state == TASK_BLOCKED && pcb_array[pid].wait_chan == chan) {
+            pcb_array[pid].wait_chan = NULL;
+            enqueue_task(pid);
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * wake_up_process
+ *   DESCRIPTION: Puts one sleeping task back on the run queue, whatever
+ *                it sleeps on
+ *   INPUTS: pid -- the task
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none if the task is not sleeping. Safe to call from
+ *                 interrupt handlers
+ */
+void wake_up_process(int pid) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (pid >= 0 && pid < MAX_PROCESSES && pcb_array[pid].state == TASK_BLOCKED &&
+        pcb_array[pid].wait_chan != NULL) {
+        pcb_array[pid].wait_chan = NULL;
+        enqueue_task(pid);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * process_timeout
+ *   DESCRIPTION: Timer callback of sleep_on_timeout
+ *   INPUTS: data -- PID of the sleeper
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: a woken real-time task preempts best effort
+ */
+static void process_timeout(uint32_t data) {
+    wake_up_process((int) data);
+    preempt_wakeup();
+}
+
+/*
+ * sleep_on_timeout
+ *   DESCRIPTION: sleep_on that also ends after a number of ticks, on a
+ *                kernel timer. Callers recheck their condition in a loop
+ *                like with sleep_on
+ *   INPUTS: chan -- address identifying the event, ticks -- longest wait
+ *   OUTPUTS: none
+ *   RETURN VALUE: ticks left of the timeout, 0 once it passed
+ *   SIDE EFFECTS: switches to another task or the idle task
+ */
+uint32_t sleep_on_timeout(void* chan, uint32_t ticks) {
+    timer_list_t timer = TIMER_INIT(process_timeout, get_global_pid());
+    uint32_t expires = jiffies + ticks;
+    uint32_t flags;
+
+    if (ticks == 0) {
+        return 0;
+    }
+
+    cli_and_save(flags);
+    mod_timer(&timer, expires);
+    sleep_on(chan);
+    del_timer(&timer);
+    restore_flags(flags);
+
+    return time_after_eq(jiffies, expires) ? 0 : expires - jiffies;
+}
+
+/*
+ * wake_up_interactive
+ *   DESCRIPTION: wake_up for keyboard input, the woken tasks get
+ *                KBD_BOOST until they sleep again or use up a slice
+ *   INPUTS: chan -- address passed to sleep_on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: safe to call from interrupt handlers
+ */
+void wake_up_interactive(void* chan) {
+    uint32_t flags;
+    int pid;
+
+    cli_and_save(flags);
+    for (pid = 0; pid < MAX_PROCESSES; pid++) {
+        if (pcb_array[pid].state == TASK_BLOCKED && pcb_array[pid].wait_chan == chan) {
+            pcb_array[pid].wait_chan = NULL;
+            pcb_array[pid].kbd_boost = 1;
+            enqueue_task(pid);
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * sched_fg_changed
+ *   DESCRIPTION: Moves queued best-effort tasks to their new level after
+ *                the displayed terminal changed, FG_BOOST follows it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none beyond the run queue order
+ */
+void sched_fg_changed(void) {
+    uint32_t flags;
+    int pid;
+
+    cli_and_save(flags);
+    for (pid = 0; pid < MAX_PROCESSES; pid++) {
+        if (pcb_array[pid].run_array >= 0 && pcb_array[pid].policy == SCHED_NORMAL) {
+            requeue_task(pid);
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * preempt_wakeup
+ *   DESCRIPTION: Switches right away, instead of on the next PIT tick,
+ *                when an interrupt handler woke a task that outranks the
+ *                running one: anything over idle, real time over best
+ *                effort, an earlier deadline or a higher rt priority
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: only call from a handler that already sent its EOI.
+ *                Deferred while the running task has preemption disabled
+ */
+void preempt_wakeup(void) {
+    uint32_t flags;
+    int curr_pid = get_global_pid();
+    int next_pid;
+
+    if (curr_pid < 0) {
+        return;
+    }
+
+    cli_and_save(flags);
+    next_pid = schedule();
+    if (next_pid != curr_pid && task_preempts(next_pid, curr_pid)) {
+        if (preemptible(curr_pid)) {
+            scheduling_context_switch(next_pid);
+        } else {
+            this_cpu()->need_resched = 1;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * schedule()
+ *   DESCRIPTION: Picks the next program to run from this CPU's run
+ *                queue, or steals one when it is empty
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PID of the next program, IDLE_PID if nothing is runnable
+ *   SIDE EFFECTS: may move a task to this CPU
+ * 
+ */
+int schedule() {
+    int next_pid = pick_next_task();
+    if (next_pid < 0) {
+        next_pid = steal_task();
+    }
+    return (next_pid < 0) ? IDLE_PID : next_pid;
+}
+
+/*
+ * init_task_context
+ *   DESCRIPTION: Builds the kernel stack of a new process so that the
+ *                first switch_to into it lands in ret_from_fork, which
+ *                irets to the program entry point in user mode
+ *   INPUTS: pid -- new process
+ *           entry -- user EIP to start at
+ *           cr3 -- page directory of the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: overwrites the top of pid's kernel stack
+ */
+void init_task_context(int pid, uint32_t entry, uint32_t cr3) {
+    uint32_t* sp = (uint32_t*) KERNEL_STACK_TOP(pid);
+
+    /* iret frame into user mode, interrupts on */
+    *--sp = USER_DS;
+    *--sp = USER_STACK_TOP;
+    *--sp = EFLAGS_IF | EFLAGS_RESERVED;
+    *--sp = USER_CS;
+    *--sp = entry;
+
+    /* switch_to pops these and returns to ret_from_fork */
+    *--sp = (uint32_t) ret_from_fork;
+    *--sp = 0;                          // ebp
+    *--sp = 0;                          // ebx
+    *--sp = 0;                          // esi
+    *--sp = 0;                          // edi
+
+    pcb_array[pid].ctx.esp = (uint32_t) sp;
+    pcb_array[pid].ctx.esp0 = KERNEL_STACK_TOP(pid);
+    pcb_array[pid].ctx.cr3 = cr3;
+
+    /* Enters with the kernel lock of its creator's system call, ret_from_fork drops it */
+    pcb_array[pid].lock_depth = 1;
+}
+
+/*
+ * scheduling_context_switch()
+ *   DESCRIPTION: Updates global PID and task switches to
+ *                run next program
+ *   INPUTS: next_pid -- program to switch to
+ *   OUTPUTS: none
+ *   RETURN VALUE: none, returns once the caller is scheduled again
+ *   SIDE EFFECTS: switch_to loads next's stack, this CPU's tss.esp0 and CR3
+ * 
+ */
+void scheduling_context_switch(int next_pid) {
+
+    /********** Get current program PID **********/
+    int past_pid = get_global_pid();
+
+    if (next_pid == past_pid) {
+        return;
+    }
+
+    trace_event(TRACE_SWITCH, past_pid, next_pid);
+
+    /*************** Update to next Global PID  ***************/
+    set_global_pid(next_pid);
+    this_cpu()->need_resched = 0;
+
+    /********** Switch **********/
+    switch_to(&pcb_array[past_pid].ctx, &pcb_array[next_pid].ctx, this_cpu()->tss);
 }
 
 
@@ -1,20 +1,140 @@
+#ifndef SCHEDULING_H
+#define SCHEDULING_H
 #include "lib.h"
 #include "i8259.h"
 #include "pcb.h"
 #include "x86_desc.h"
 #include "paging.h"
 #include "system_calls.h"
-#include "lib.h"
 
+/* PIT configuration */
+#define MAX_PIT_SPEED   1193182         // PIT input clock (Hz)
+#define PIT_HZ          100             // scheduler tick rate, 10 ms per tick
+#define PIT_TICK_CYCLES (MAX_PIT_SPEED / PIT_HZ)
+
+/* Dynamic tick: program the PIT one-shot for the next deadline instead of
+ * interrupting every tick. Comment out for the periodic 100 Hz timer */
+#define TICKLESS
+#define PIT_MIN_SHOT    64              // ~54 us, keeps back to back interrupts apart
+#define PIT_MAX_SHOT    0xFFFF          // 16-bit counter, ~55 ms
+
+/* Run queue priorities, 0 is the highest */
+#define NUM_PRIO        8
+#define DEFAULT_PRIO    4               // 2 tick (20 ms) slice, see prio_to_slice
+#define MAX_SLICE_MS    500             // longest timeslice override
+
+/* Scheduling classes, real-time tasks run before best-effort ones while
+ * their CPU has real-time bandwidth left */
+#define SCHED_NORMAL    0               // best effort, priority arrays
+#define SCHED_RR        1               // fixed real-time priority, round robin within a level
+#define SCHED_EDF       2               // earliest deadline first, paced by RTC reads
+
+/* Real-time bandwidth: SCHED_RR and SCHED_EDF tasks of a CPU may run
+ * RT_RUNTIME_TICKS of every RT_PERIOD_TICKS, queued best-effort tasks
+ * get the rest even next to a spinning real-time task */
+#define RT_PERIOD_TICKS     100         // 1 s
+#define RT_RUNTIME_TICKS    95          // 950 ms
+
+/* Interactive boosts, in priority levels, for best-effort tasks */
+#define FG_BOOST        1               // task runs on the displayed terminal
+#define KBD_BOOST       2               // task was just woken by keyboard input
+
+#define SCHED_STAT_LINE 64              // sched_stat line: six numbers and a name
 
 extern int pid_arr_idx;
 
 int setup_pit();
 
+void pit_delay_cycles(uint32_t cycles);
+
+void pit_delay_us(uint32_t us);
+
 void pit_handler();
 
+void sched_ap_tick(void);
+
 int schedule();
 
-void scheduling_context_switch();
+void scheduling_context_switch(int next_pid);
+
+void init_task_context(int pid, uint32_t entry, uint32_t cr3);
 
 int get_line_number();
+
+/* Run queue interface */
+void sched_task_init(int pid);
+
+void enqueue_task(int pid);
+
+void dequeue_task(int pid);
+
+int pick_next_task(void);
+
+void scheduler_tick(void);
+
+int get_nr_running(void);
+
+/* Priority and timeslice control, pid < 0 means the caller */
+int32_t sched_setpriority(int pid, int prio);
+
+int32_t sched_getpriority(int pid);
+
+int32_t sched_set_timeslice(int pid, int ms);
+
+/* Real-time classes */
+int32_t sched_setscheduler(int pid, int policy, int param);
+
+int32_t sched_getscheduler(int pid);
+
+int32_t sched_deadline_misses(int pid);
+
+void sched_rt_complete(void);
+
+void sched_rt_release(uint32_t period);
+
+void sched_rt_tick(int pid);
+
+/* Timekeeping */
+uint32_t get_jiffies(void);
+
+void tick_rearm(void);
+
+/* Idle task */
+void sched_idle_init(void);
+
+void cpu_idle(void);
+
+uint32_t get_idle_ticks(void);
+
+uint32_t get_busy_ticks(void);
+
+/* Per-task scheduler statistics as text, one task per line */
+int32_t sched_stat_read(uint8_t* buf, int32_t nbytes);
+
+/* Kernel preemption: switches out of a task are deferred while its
+ * preempt count is raised, preempt_point() takes a pending one early
+ * once it is back to zero */
+void preempt_disable(void);
+
+void preempt_enable(void);
+
+void preempt_point(void);
+
+/* Sleep until wake_up() is called on the same channel */
+void sleep_on(void* chan);
+
+void wake_up(void* chan);
+
+void wake_up_interactive(void* chan);
+
+/* Wakes one sleeping task, whatever channel it sleeps on */
+void wake_up_process(int pid);
+
+/* sleep_on for at most ticks scheduler ticks, returns the ticks left */
+uint32_t sleep_on_timeout(void* chan, uint32_t ticks);
+
+void sched_fg_changed(void);
+
+void preempt_wakeup(void);
+
+#endif
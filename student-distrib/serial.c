@@ -0,0 +1,73 @@
+/* serial.c - Polled output on COM1
+ * vim:ts=4 noexpandtab
+ */
+
+#include "serial.h"
+#include "lib.h"
+#include "spinlock.h"
+
+/* 16550 registers, offsets from the base port */
+#define UART_DATA           0           // divisor low byte with DLAB set
+#define UART_IER            1           // divisor high byte with DLAB set
+#define UART_FCR            2
+#define UART_LCR            3
+#define UART_MCR            4
+#define UART_LSR            5
+
+#define UART_LCR_8N1        0x03
+#define UART_LCR_DLAB       0x80
+#define UART_FCR_ENABLE     0xC7        // enable and clear both FIFOs, 14 byte threshold
+#define UART_MCR_DTR_RTS    0x03
+#define UART_LSR_THRE       0x20        // transmit holding register empty
+#define UART_CLOCK          115200      // divisor 1 rate
+
+/* Bounds the wait for a transmitter that never drains */
+#define SERIAL_SPIN         100000
+
+static spinlock_t serial_lock = SPIN_LOCK_INIT("serial");
+
+/*
+ * serial_init
+ *   DESCRIPTION: Programs COM1 for output at SERIAL_BAUD, 8 data bits,
+ *                no parity, one stop bit
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: COM1 interrupts stay off, output is polled
+ */
+void serial_init(void) {
+    uint32_t divisor = UART_CLOCK / SERIAL_BAUD;
+
+    outb(0x00, COM1_PORT + UART_IER);
+    outb(UART_LCR_DLAB, COM1_PORT + UART_LCR);
+    outb(divisor & 0xFF, COM1_PORT + UART_DATA);
+    outb((divisor >> 8) & 0xFF, COM1_PORT + UART_IER);
+    outb(UART_LCR_8N1, COM1_PORT + UART_LCR);
+    outb(UART_FCR_ENABLE, COM1_PORT + UART_FCR);
+    outb(UART_MCR_DTR_RTS, COM1_PORT + UART_MCR);
+}
+
+/*
+ * serial_write
+ *   DESCRIPTION: Sends bytes on COM1
+ *   INPUTS: buf -- bytes, nbytes -- how many
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: busy waits for the transmitter, gives up on a byte
+ *                 after SERIAL_SPIN polls so a missing UART cannot hang
+ */
+void serial_write(const uint8_t* buf, int32_t nbytes) {
+    uint32_t flags;
+    int32_t i, spin;
+
+    spin_lock_irqsave(&serial_lock, flags);
+    for (i = 0; i < nbytes; i++) {
+        for (spin = 0; spin < SERIAL_SPIN; spin++) {
+            if (inb(COM1_PORT + UART_LSR) & UART_LSR_THRE) {
+                break;
+            }
+        }
+        outb(buf[i], COM1_PORT + UART_DATA);
+    }
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
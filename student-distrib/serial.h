@@ -0,0 +1,20 @@
+/* serial.h - Polled output on COM1, for getting profiles and traces out
+ * of the machine (e.g. QEMU -serial file:out.txt)
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "types.h"
+
+#define COM1_PORT           0x3F8
+#define SERIAL_BAUD         115200
+
+/* Programs COM1 for SERIAL_BAUD 8N1, interrupts off */
+void serial_init(void);
+
+/* Sends bytes, waiting for the transmitter between them */
+void serial_write(const uint8_t* buf, int32_t nbytes);
+
+#endif /* _SERIAL_H */
@@ -0,0 +1,397 @@
+/* smp.c - Application processor startup, per-CPU data and the kernel lock
+ * vim:ts=4 noexpandtab
+ */
+
+#include "smp.h"
+#include "apic.h"
+#include "ioapic.h"
+#include "lib.h"
+#include "pcb.h"
+#include "paging.h"
+#include "scheduling.h"
+#include "sysenter.h"
+
+/* CPU 0 is the boot processor, the others are numbered in MP table order */
+cpu_info cpus[MAX_CPUS] = {
+    [0] = { .online = 1, .curr_pid = -1, .tss = &tss },
+    [1 ... MAX_CPUS - 1] = { .curr_pid = -1 }
+};
+int num_cpus = 1;
+
+/* Processors listed in the MP table, started by smp_init */
+static int mp_cpus = 1;
+
+static tss_t ap_tss[MAX_CPUS - 1];
+
+/* CPU the trampoline is currently starting, read by ap_main */
+static volatile int ap_boot_cpu = 0;
+
+/* Every CPU takes it on each kernel entry, first come first served */
+static ticketlock_t kernel_lock = TICKET_LOCK_INIT("kernel");
+
+/*
+ * mp_checksum
+ *   DESCRIPTION: MP structures are valid when their bytes sum to 0
+ *   INPUTS: p -- structure, len -- its length in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the checksum matches, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+static int mp_checksum(uint8_t* p, uint32_t len) {
+    uint8_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return sum == 0;
+}
+
+/*
+ * mp_scan
+ *   DESCRIPTION: Looks for the MP floating pointer on 16 byte boundaries
+ *   INPUTS: base -- physical start, len -- bytes to search
+ *   OUTPUTS: none
+ *   RETURN VALUE: the structure, NULL if not found
+ *   SIDE EFFECTS: range must be mapped
+ */
+static mp_fp* mp_scan(uint32_t base, uint32_t len) {
+    uint32_t addr;
+
+    for (addr = base; addr + sizeof(mp_fp) <= base + len; addr += 16) {
+        if (strncmp((int8_t*) addr, (int8_t*) "_MP_", 4) == 0 &&
+            mp_checksum((uint8_t*) addr, sizeof(mp_fp))) {
+            return (mp_fp*) addr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * mp_parse
+ *   DESCRIPTION: Reads the MP configuration table the BIOS left in low
+ *                memory (EBDA, last kB of base memory or the BIOS ROM):
+ *                the enabled processors, the I/O APICs and where the ISA
+ *                IRQs enter them
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of CPUs, 1 without a usable table
+ *   SIDE EFFECTS: fills in cpus[].apic_id and the I/O APIC routing table,
+ *                 first 4 MB must be mapped
+ */
+static int mp_parse(void) {
+    uint32_t ebda = (*(uint16_t*) 0x40E) << 4;     // BIOS data area: EBDA segment
+    int isa_bus[MP_MAX_BUSES] = { 0 };
+    mp_fp* fp = NULL;
+    mp_config* conf;
+    mp_proc* proc;
+    mp_bus* bus;
+    mp_ioapic* ioapic;
+    mp_irq* irq;
+    uint8_t* entry;
+    int i, n = 1;
+
+    if (ebda != 0) {
+        fp = mp_scan(ebda, 1024);
+    }
+    if (fp == NULL) {
+        fp = mp_scan(0x9FC00, 1024);
+    }
+    if (fp == NULL) {
+        fp = mp_scan(0xF0000, 0x10000);
+    }
+
+    /* Default configurations and tables above the low mapping are not supported */
+    if (fp == NULL || fp->config == 0 || fp->config >= 0x400000) {
+        return 1;
+    }
+    conf = (mp_config*) fp->config;
+    if (strncmp(conf->signature, (int8_t*) "PCMP", 4) != 0 ||
+        !mp_checksum((uint8_t*) conf, conf->length)) {
+        return 1;
+    }
+    if (fp->feature[1] & MP_IMCR) {
+        ioapic_set_imcr();
+    }
+
+    entry = (uint8_t*) (conf + 1);
+    for (i = 0; i < conf->entry_count; i++) {
+        switch (*entry) {
+        case MP_PROCESSOR:
+            proc = (mp_proc*) entry;
+            if (proc->flags & MP_CPU_BSP) {
+                cpus[0].apic_id = proc->apic_id;
+            } else if ((proc->flags & MP_CPU_ENABLED) && n < MAX_CPUS) {
+                cpus[n++].apic_id = proc->apic_id;
+            }
+            entry += sizeof(mp_proc);
+            continue;
+
+        case MP_BUS:
+            bus = (mp_bus*) entry;
+            if (bus->bus_id < MP_MAX_BUSES) {
+                isa_bus[bus->bus_id] = (strncmp(bus->bus_type, (int8_t*) "ISA", 3) == 0);
+            }
+            break;
+
+        case MP_IOAPIC:
+            ioapic = (mp_ioapic*) entry;
+            if (ioapic->flags & MP_IOAPIC_USABLE) {
+                ioapic_add(ioapic->apic_id, ioapic->address);
+            }
+            break;
+
+        case MP_IOINTR:
+            /* Only ISA devices are driven, PCI interrupts stay unrouted */
+            irq = (mp_irq*) entry;
+            if (irq->irq_type == MP_INT && irq->bus_id < MP_MAX_BUSES && isa_bus[irq->bus_id]) {
+                ioapic_add_route(irq->bus_irq, irq->ioapic_id, irq->ioapic_pin, irq->flags);
+            }
+            break;
+        }
+        entry += MP_ENTRY_SIZE;
+    }
+    return n;
+}
+
+/*
+ * mp_init
+ *   DESCRIPTION: Looks for the other processors and the I/O APIC, then
+ *                enables the boot CPU's local APIC and measures its timer.
+ *                Does nothing without a local APIC
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after setup_paging, before irq_init and smp_init
+ */
+void mp_init(void) {
+    if (!lapic_present()) {
+        return;
+    }
+
+    map_low_memory(1);
+    mp_cpus = mp_parse();
+    map_low_memory(0);
+
+    lapic_map();
+    lapic_init();
+    cpus[0].apic_id = lapic_id();
+    lapic_timer_calibrate();
+}
+
+/*
+ * ap_tss_init
+ *   DESCRIPTION: Builds the TSS and its GDT descriptor for a CPU
+ *   INPUTS: cpu -- application processor, 1 to MAX_CPUS - 1
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: esp0 starts on the CPU's idle stack
+ */
+static void ap_tss_init(int cpu) {
+    seg_desc_t the_tss_desc = tss_desc_ptr;     // same limit and flags as CPU 0's
+
+    the_tss_desc.type = 0x9;                    // available, ltr marks it busy
+    SET_TSS_PARAMS(the_tss_desc, &ap_tss[cpu - 1], tss_size);
+    ap_tss_desc_ptr[cpu - 1] = the_tss_desc;
+
+    ap_tss[cpu - 1].ldt_segment_selector = KERNEL_LDT;
+    ap_tss[cpu - 1].ss0 = KERNEL_DS;
+    ap_tss[cpu - 1].esp0 = KERNEL_STACK_TOP(MAX_PROCESSES + cpu);
+    cpus[cpu].tss = &ap_tss[cpu - 1];
+}
+
+/*
+ * start_ap
+ *   DESCRIPTION: INIT-SIPI-SIPI sequence for one CPU, then waits up to
+ *                100 ms for it to reach ap_main
+ *   INPUTS: cpu -- application processor
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the trampoline must already be at AP_TRAMPOLINE
+ */
+static void start_ap(int cpu) {
+    int i;
+
+    ap_tss_init(cpu);
+    ap_boot_cpu = cpu;
+    ap_boot_stack = KERNEL_STACK_TOP(MAX_PROCESSES + cpu);
+
+    lapic_send_init(cpus[cpu].apic_id);
+    pit_delay_us(10000);                        // 10 ms
+    for (i = 0; i < 2 && !cpus[cpu].online; i++) {
+        lapic_send_sipi(cpus[cpu].apic_id, AP_TRAMPOLINE >> 12);
+        pit_delay_us(200);
+    }
+    for (i = 0; i < 100 && !cpus[cpu].online; i++) {
+        pit_delay_us(1000);
+    }
+
+    if (cpus[cpu].online) {
+        num_cpus = cpu + 1;
+    }
+}
+
+/*
+ * smp_init
+ *   DESCRIPTION: Starts the processors mp_init found one at a time, each
+ *                ends up in its own idle task. Falls back to the boot CPU
+ *                alone without a local APIC or MP table
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after sched_idle_init with the kernel lock held,
+ *                 the started CPUs wait for it
+ */
+void smp_init(void) {
+#ifdef SMP
+    int cpu;
+
+    if (mp_cpus > 1) {
+        map_low_memory(1);
+        memcpy((void*) AP_TRAMPOLINE, &ap_trampoline, &ap_trampoline_end - &ap_trampoline);
+        for (cpu = 1; cpu < mp_cpus; cpu++) {
+            start_ap(cpu);
+        }
+        map_low_memory(0);
+    }
+
+    printf("%d CPUs online, %s interrupts\n", num_cpus, irq_chip_name());
+#endif
+}
+
+/*
+ * ap_main
+ *   DESCRIPTION: Reached from the trampoline in protected mode with
+ *                paging on, on the CPU's idle stack. Sets up the per-CPU
+ *                state and becomes the CPU's idle task
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: enables interrupts
+ */
+void ap_main(void) {
+    int cpu = ap_boot_cpu;
+
+    ltr(AP_TSS_SEL(cpu));
+    sysenter_init();
+    lapic_init();
+    sched_idle_init();
+    lapic_timer_start();
+    cpus[cpu].online = 1;
+
+    cpu_idle();
+}
+
+/*
+ * smp_send_resched
+ *   DESCRIPTION: Interrupts a CPU so it picks from its run queue again
+ *   INPUTS: cpu -- CPU to poke
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none for offline CPUs
+ */
+void smp_send_resched(int cpu) {
+    if (cpu < 0 || cpu >= num_cpus || !cpus[cpu].online) {
+        return;
+    }
+    lapic_send_ipi(cpus[cpu].apic_id, RESCHED_VECTOR);
+}
+
+/*
+ * resched_ipi_handler
+ *   DESCRIPTION: Another CPU queued work here (or for us to steal)
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may switch tasks
+ */
+void resched_ipi_handler(void) {
+    lapic_eoi();
+    tick_rearm();
+    preempt_wakeup();
+}
+
+/*
+ * smp_flush_tlb_others
+ *   DESCRIPTION: Makes the other CPUs reload CR3 after a page table
+ *                entry every address space shares was changed
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: does not wait for the flush
+ */
+void smp_flush_tlb_others(void) {
+    if (num_cpus > 1) {
+        lapic_send_ipi_others(TLB_FLUSH_VECTOR);
+    }
+}
+
+/*
+ * tlb_flush_ipi_handler
+ *   DESCRIPTION: Drops this CPU's non-global TLB entries
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: runs without the kernel lock
+ */
+void tlb_flush_ipi_handler(void) {
+    flush_tlbs();
+    lapic_eoi();
+}
+
+/*
+ * lock_kernel
+ *   DESCRIPTION: Enters the kernel. Nests per task: only the outermost
+ *                entry spins for the lock, a task switch hands it over
+ *                with the CPU
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: no-op before the boot CPU has an idle task. Also starts
+ *                 timing the interrupts-off window of the entry
+ */
+void lock_kernel(void) {
+#ifdef SMP
+    uint32_t flags;
+    int pid;
+#endif
+
+    /* Every interrupt gate entry passes here first */
+    irqsoff_entry();
+
+#ifdef SMP
+
+    cli_and_save(flags);
+    pid = get_global_pid();
+    if (pid >= 0 && pcb_array[pid].lock_depth++ == 0) {
+        ticket_lock(&kernel_lock);
+    }
+    restore_flags(flags);
+#endif
+}
+
+/*
+ * unlock_kernel
+ *   DESCRIPTION: Leaves the kernel, the outermost exit frees the lock
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: other CPUs may enter the kernel, ends the timed
+ *                 interrupts-off window
+ */
+void unlock_kernel(void) {
+#ifdef SMP
+    uint32_t flags;
+    int pid;
+
+    cli_and_save(flags);
+    pid = get_global_pid();
+    if (pid >= 0 && --pcb_array[pid].lock_depth == 0) {
+        ticket_unlock(&kernel_lock);
+    }
+    restore_flags(flags);
+#endif
+
+    /* and the last thing before the iret */
+    irqsoff_exit();
+}
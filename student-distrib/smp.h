@@ -0,0 +1,146 @@
+/* smp.h - Application processor startup and per-CPU data
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "types.h"
+#include "x86_desc.h"
+#include "spinlock.h"
+#include "irqsoff.h"
+
+/* Start the application processors and run tasks on all CPUs.
+ * Comment out for the uniprocessor kernel */
+#define SMP
+
+/* MP floating pointer structure (Intel MP spec 1.4, 4.1) */
+typedef struct __attribute__((packed)) mp_fp {
+    int8_t signature[4];                // "_MP_"
+    uint32_t config;                    // physical address of the config table
+    uint8_t length;                     // in 16 byte units
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t feature[5];                 // feature[0] != 0: default config, no table
+} mp_fp;
+
+/* MP configuration table header (4.2), entries follow it */
+typedef struct __attribute__((packed)) mp_config {
+    int8_t signature[4];                // "PCMP"
+    uint16_t length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    int8_t oem_id[8];
+    int8_t product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_addr;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} mp_config;
+
+/* Processor entry (4.3.1), the other entry types are 8 bytes */
+typedef struct __attribute__((packed)) mp_proc {
+    uint8_t type;                       // MP_PROCESSOR
+    uint8_t apic_id;
+    uint8_t apic_ver;
+    uint8_t flags;                      // MP_CPU_*
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} mp_proc;
+
+/* Bus entry (4.3.2) */
+typedef struct __attribute__((packed)) mp_bus {
+    uint8_t type;                       // MP_BUS
+    uint8_t bus_id;
+    int8_t bus_type[6];                 // "ISA   ", "PCI   ", ...
+} mp_bus;
+
+/* I/O APIC entry (4.3.3) */
+typedef struct __attribute__((packed)) mp_ioapic {
+    uint8_t type;                       // MP_IOAPIC
+    uint8_t apic_id;
+    uint8_t apic_ver;
+    uint8_t flags;                      // bit 0: usable
+    uint32_t address;
+} mp_ioapic;
+
+/* I/O interrupt assignment entry (4.3.4) */
+typedef struct __attribute__((packed)) mp_irq {
+    uint8_t type;                       // MP_IOINTR
+    uint8_t irq_type;                   // MP_INT for vectored interrupts
+    uint16_t flags;                     // polarity and trigger mode
+    uint8_t bus_id;
+    uint8_t bus_irq;
+    uint8_t ioapic_id;
+    uint8_t ioapic_pin;
+} mp_irq;
+
+#define MP_PROCESSOR        0
+#define MP_BUS              1
+#define MP_IOAPIC           2
+#define MP_IOINTR           3
+#define MP_ENTRY_SIZE       8
+#define MP_MAX_BUSES        32
+#define MP_CPU_ENABLED      0x01
+#define MP_CPU_BSP          0x02
+#define MP_IOAPIC_USABLE    0x01
+#define MP_INT              0
+#define MP_IMCR             0x80        // feature[1]: board boots in PIC mode
+
+/* Per-CPU data */
+typedef struct cpu_info {
+    int apic_id;                        // local APIC ID, IPI destination
+    volatile int online;                // reached its idle loop
+    int curr_pid;                       // task running here (-1 = none yet)
+    volatile int need_resched;          // a switch out of curr_pid was deferred
+    tss_t* tss;                         // esp0 of curr_pid
+    uint64_t irqsoff_start;             // TSC when interrupts went off
+    irqsoff_site* irqsoff_site;         // who turned them off, NULL = nobody timed
+} cpu_info;
+
+extern cpu_info cpus[MAX_CPUS];
+extern int num_cpus;
+
+/* Index of the running CPU: CPU 0 uses KERNEL_TSS, the others
+ * AP_TSS_SEL(cpu). Valid on every CPU from its ltr on */
+static inline int smp_processor_id(void) {
+    uint16_t sel;
+    asm volatile ("str %0" : "=r" (sel));
+    if (sel < AP_TSS_BASE) {
+        return 0;
+    }
+    return ((sel - AP_TSS_BASE) >> 3) + 1;
+}
+
+#define this_cpu()          (&cpus[smp_processor_id()])
+
+/* Reads the MP table and enables the boot CPU's local APIC */
+void mp_init(void);
+
+/* Starts the other CPUs, called once by the boot CPU */
+void smp_init(void);
+
+/* 32-bit entry of an application processor */
+void ap_main(void);
+
+/* Asks another CPU to look at its run queue */
+void smp_send_resched(int cpu);
+
+void resched_ipi_handler(void);
+
+/* Drops stale shared mappings (video memory) on the other CPUs */
+void smp_flush_tlb_others(void);
+
+void tlb_flush_ipi_handler(void);
+
+/* Big kernel lock: taken on every interrupt and system call entry, so
+ * kernel code runs on one CPU at a time while user code runs on all */
+void lock_kernel(void);
+
+void unlock_kernel(void);
+
+#endif /* _SMP_H */
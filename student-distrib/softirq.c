@@ -0,0 +1,203 @@
+/* softirq.c - Runs the work interrupt handlers deferred, with interrupts
+ * back on, right before the interrupt returns
+ * vim:ts=4 noexpandtab
+ */
+
+#include "softirq.h"
+#include "lib.h"
+#include "smp.h"
+#include "scheduling.h"
+
+/* Queued tasklets of one list on one CPU, FIFO */
+typedef struct tasklet_list {
+    tasklet_t* head;
+    tasklet_t* tail;
+} tasklet_list;
+
+static void tasklet_action(int nr);
+
+static softirq_action softirq_vec[NR_SOFTIRQS] = {
+    [HI_SOFTIRQ] = tasklet_action,
+    [TASKLET_SOFTIRQ] = tasklet_action
+};
+
+/* Per CPU: raised softirqs, whether do_softirq is running and the
+ * tasklets waiting, one list per tasklet softirq */
+static volatile uint32_t softirq_pending[MAX_CPUS];
+static int softirq_running[MAX_CPUS];
+static tasklet_list tasklet_vec[MAX_CPUS][NR_SOFTIRQS];
+
+/*
+ * open_softirq
+ *   DESCRIPTION: Installs the handler of a softirq number
+ *   INPUTS: nr -- softirq number, action -- handler
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ignores numbers out of range
+ */
+void open_softirq(int nr, softirq_action action) {
+    if (nr < 0 || nr >= NR_SOFTIRQS) {
+        return;
+    }
+    softirq_vec[nr] = action;
+}
+
+/*
+ * raise_softirq
+ *   DESCRIPTION: Marks a softirq pending on this CPU, it runs when the
+ *                current interrupt returns
+ *   INPUTS: nr -- softirq number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: outside an interrupt it waits for the next one
+ */
+void raise_softirq(int nr) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    softirq_pending[smp_processor_id()] |= (1 << nr);
+    restore_flags(flags);
+}
+
+/*
+ * tasklet_enqueue
+ *   DESCRIPTION: Appends a tasklet to a list of this CPU and raises the
+ *                list's softirq
+ *   INPUTS: t -- tasklet, nr -- HI_SOFTIRQ or TASKLET_SOFTIRQ
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none if the tasklet is queued already
+ */
+static void tasklet_enqueue(tasklet_t* t, int nr) {
+    tasklet_list* list;
+    uint32_t flags;
+    int cpu;
+
+    cli_and_save(flags);
+    if (!(t->state & TASKLET_SCHED)) {
+        t->state |= TASKLET_SCHED;
+        t->next = NULL;
+
+        cpu = smp_processor_id();
+        list = &tasklet_vec[cpu][nr];
+        if (list->tail != NULL) {
+            list->tail->next = t;
+        } else {
+            list->head = t;
+        }
+        list->tail = t;
+        softirq_pending[cpu] |= (1 << nr);
+    }
+    restore_flags(flags);
+}
+
+void tasklet_schedule(tasklet_t* t) {
+    tasklet_enqueue(t, TASKLET_SOFTIRQ);
+}
+
+void tasklet_hi_schedule(tasklet_t* t) {
+    tasklet_enqueue(t, HI_SOFTIRQ);
+}
+
+/*
+ * tasklet_action
+ *   DESCRIPTION: Runs the tasklets queued on one list of this CPU
+ *   INPUTS: nr -- HI_SOFTIRQ or TASKLET_SOFTIRQ
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called with interrupts on. A tasklet may queue itself
+ *                 again, it then runs in the next round
+ */
+static void tasklet_action(int nr) {
+    tasklet_list* list;
+    tasklet_t* t;
+    tasklet_t* next;
+
+    /* Take the whole list, interrupts may queue more meanwhile */
+    cli();
+    list = &tasklet_vec[smp_processor_id()][nr];
+    t = list->head;
+    list->head = NULL;
+    list->tail = NULL;
+    sti();
+
+    while (t != NULL) {
+        next = t->next;
+        t->next = NULL;
+        t->state &= ~TASKLET_SCHED;
+        t->func(t->data);
+        t = next;
+    }
+}
+
+/*
+ * do_softirq
+ *   DESCRIPTION: Runs the softirqs pending on this CPU with interrupts
+ *                on and preemption off. Softirqs raised meanwhile run in
+ *                further rounds, up to MAX_SOFTIRQ_RESTART
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts off, returns with them off. An
+ *                 interrupt arriving meanwhile leaves its work to this
+ *                 loop. Takes a task switch the bottom halves deferred
+ */
+void do_softirq(void) {
+    int cpu = smp_processor_id();
+    int restart = MAX_SOFTIRQ_RESTART;
+    uint32_t pending;
+    int nr;
+
+    if (softirq_running[cpu] || softirq_pending[cpu] == 0) {
+        return;
+    }
+    softirq_running[cpu] = 1;
+    preempt_disable();
+
+    do {
+        pending = softirq_pending[cpu];
+        softirq_pending[cpu] = 0;
+        sti();
+
+        for (nr = 0; nr < NR_SOFTIRQS; nr++) {
+            if ((pending & (1 << nr)) && softirq_vec[nr] != NULL) {
+                softirq_vec[nr](nr);
+            }
+        }
+
+        cli();
+    } while (softirq_pending[cpu] != 0 && --restart > 0);
+
+    softirq_running[cpu] = 0;
+    sti();
+    preempt_enable();
+    cli();
+}
+
+/*
+ * irq_exit
+ *   DESCRIPTION: Drains the bottom halves the handler queued. Called by
+ *                the IRQ linkage between the handler and unlock_kernel
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: interrupts are on while the softirqs run, off again on
+ *                 return
+ */
+void irq_exit(void) {
+    if (softirq_pending[smp_processor_id()] != 0) {
+        do_softirq();
+    }
+}
+
+/*
+ * in_softirq
+ *   DESCRIPTION: Whether this CPU is running bottom halves
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 inside do_softirq, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int in_softirq(void) {
+    return softirq_running[smp_processor_id()];
+}
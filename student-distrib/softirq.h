@@ -0,0 +1,59 @@
+/* softirq.h - Bottom halves: work an interrupt handler queues instead of
+ * doing it with interrupts off, run on the way out of the interrupt
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+#include "types.h"
+
+/* Softirq numbers, lower ones run first */
+#define HI_SOFTIRQ          0           // tasklet_hi_schedule, e.g. RTC wakeups
+#define TIMER_SOFTIRQ       1           // expired kernel timers, see timer.c
+#define TASKLET_SOFTIRQ     2           // tasklet_schedule, e.g. keyboard input
+#define NR_SOFTIRQS         3
+
+/* Rounds of newly raised softirqs one interrupt exit drains, the rest
+ * waits for the next interrupt */
+#define MAX_SOFTIRQ_RESTART 10
+
+#define TASKLET_SCHED       0x1         // queued on some CPU
+
+/* Deferred function of a driver. Runs with interrupts on and preemption
+ * off, must not sleep. Queued at most once: scheduling it again before it
+ * ran does nothing. The kernel lock keeps one tasklet off two CPUs */
+typedef struct tasklet {
+    struct tasklet* next;
+    volatile uint32_t state;
+    void (*func)(uint32_t data);
+    uint32_t data;
+} tasklet_t;
+
+#define TASKLET_INIT(f, d)  { .next = NULL, .state = 0, .func = (f), .data = (d) }
+
+/* Softirq handler, gets its number */
+typedef void (*softirq_action)(int nr);
+
+/* Installs the handler of a softirq number, the tasklet ones are built in.
+ * Softirqs without a handler are ignored */
+void open_softirq(int nr, softirq_action action);
+
+/* Marks a softirq pending on this CPU */
+void raise_softirq(int nr);
+
+/* Queue a tasklet on this CPU's normal / high priority list */
+void tasklet_schedule(tasklet_t* t);
+
+void tasklet_hi_schedule(tasklet_t* t);
+
+/* Runs the pending softirqs of this CPU, call with interrupts off */
+void do_softirq(void);
+
+/* Last step of an IRQ handler before the kernel lock is dropped */
+void irq_exit(void);
+
+/* 1 while this CPU runs bottom halves */
+int in_softirq(void);
+
+#endif /* _SOFTIRQ_H */
@@ -0,0 +1,89 @@
+/* spinlock.c - Table of lock contention statistics
+ * vim:ts=4 noexpandtab
+ */
+
+#include "spinlock.h"
+#include "lib.h"
+
+/* Named locks seen so far, in order of first acquisition */
+static lock_stat_t* lock_stats[MAX_LOCK_STATS];
+static int num_lock_stats = 0;
+
+/* Guards the table, has no statistics of its own */
+static volatile uint32_t lock_stats_lock = 0;
+
+/*
+ * lock_stat_list
+ *   DESCRIPTION: Adds a lock to the table the first time it is taken
+ *   INPUTS: stat -- counters of the lock, its holder calls this
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: locks beyond MAX_LOCK_STATS keep counting unlisted
+ */
+void lock_stat_list(lock_stat_t* stat) {
+    while (xchg(&lock_stats_lock, 1) != 0) {
+        asm volatile ("pause" : : : "memory");
+    }
+    if (!stat->listed && num_lock_stats < MAX_LOCK_STATS) {
+        lock_stats[num_lock_stats++] = stat;
+    }
+    stat->listed = 1;
+    asm volatile ("" : : : "memory");
+    lock_stats_lock = 0;
+}
+
+/*
+ * lock_stat_field
+ *   DESCRIPTION: Appends a number and a separator to a line
+ *   INPUTS: line -- line being built, value -- number to print,
+ *           sep -- character after it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: line must have room for 11 more characters
+ */
+static void lock_stat_field(int8_t* line, uint32_t value, int8_t sep) {
+    int8_t* end = line + strlen(line);
+
+    itoa(value, end, 10);
+    end += strlen(end);
+    end[0] = sep;
+    end[1] = '\0';
+}
+
+/*
+ * lock_stat_read
+ *   DESCRIPTION: Writes "name acquired contended spin" for every listed
+ *                lock. Spin time is in units of 1024 TSC cycles. The
+ *                counters are read without their locks, a line may mix
+ *                two updates
+ *   INPUTS: buf -- destination, nbytes -- its size
+ *   OUTPUTS: the text, not NUL terminated
+ *   RETURN VALUE: bytes written, lines that do not fit are left out
+ *   SIDE EFFECTS: none
+ */
+int32_t lock_stat_read(uint8_t* buf, int32_t nbytes) {
+    int8_t line[MAX_LOCK_LINE];
+    int32_t len, written = 0;
+    lock_stat_t* stat;
+    int i;
+
+    for (i = 0; i < num_lock_stats; i++) {
+        stat = lock_stats[i];
+        strncpy(line, (int8_t*) stat->name, MAX_LOCK_NAME);
+        line[MAX_LOCK_NAME] = '\0';
+        len = strlen(line);
+        line[len] = ' ';
+        line[len + 1] = '\0';
+        lock_stat_field(line, stat->acquired, ' ');
+        lock_stat_field(line, stat->contended, ' ');
+        lock_stat_field(line, (uint32_t) (stat->spin_cycles >> 10), '\n');
+
+        len = strlen(line);
+        if (written + len > nbytes) {
+            break;
+        }
+        memcpy(buf + written, line, len);
+        written += len;
+    }
+    return written;
+}
@@ -0,0 +1,163 @@
+/* spinlock.h - Busy-wait locks for data shared between processors and
+ * with interrupt handlers, with contention statistics
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "types.h"
+#include "tsc.h"
+
+#define MAX_LOCK_STATS      32
+#define MAX_LOCK_NAME       16          // longer names are cut in lock_stat output
+#define MAX_LOCK_LINE       64          // name and three 10 digit numbers
+
+/* Contention counters of one lock, updated by the holder. Named locks
+ * show up in the lock_stat system call from their first acquisition */
+typedef struct lock_stat {
+    const char* name;                   // NULL: not listed
+    uint32_t acquired;                  // times taken
+    uint32_t contended;                 // times the taker had to wait
+    uint64_t spin_cycles;               // TSC cycles spent waiting
+    int listed;
+} lock_stat_t;
+
+/* Test and set lock, 0 = free. Holders must not sleep */
+typedef struct spinlock {
+    volatile uint32_t locked;
+    lock_stat_t stat;
+} spinlock_t;
+
+/* Ticket lock: waiters get the lock in arrival order. For locks several
+ * CPUs fight over, where a test and set lock can starve one of them */
+typedef struct ticketlock {
+    volatile uint16_t next;             // ticket handed to the next taker
+    volatile uint16_t owner;            // ticket allowed in
+    lock_stat_t stat;
+} ticketlock_t;
+
+#define SPIN_LOCK_UNLOCKED      { 0 }
+#define SPIN_LOCK_INIT(n)       { .locked = 0, .stat = { .name = (n) } }
+#define TICKET_LOCK_INIT(n)     { .next = 0, .owner = 0, .stat = { .name = (n) } }
+
+/* Adds a named lock to the lock_stat table, see spinlock.c */
+void lock_stat_list(lock_stat_t* stat);
+
+/* Formats the table as text, one lock per line */
+int32_t lock_stat_read(uint8_t* buf, int32_t nbytes);
+
+/* Atomically stores val in *addr and returns the old value */
+static inline uint32_t xchg(volatile uint32_t* addr, uint32_t val) {
+    asm volatile ("xchgl %0, %1"
+            : "+r" (val), "+m" (*addr)
+            :
+            : "memory"
+    );
+    return val;
+}
+
+/* Atomically adds val to *addr and returns the old value */
+static inline uint16_t xadd16(volatile uint16_t* addr, uint16_t val) {
+    asm volatile ("lock xaddw %0, %1"
+            : "+r" (val), "+m" (*addr)
+            :
+            : "memory"
+    );
+    return val;
+}
+
+/* Bookkeeping of the holder, right after it got the lock */
+static inline void lock_stat_acquired(lock_stat_t* stat) {
+    stat->acquired++;
+    if (!stat->listed && stat->name != NULL) {
+        lock_stat_list(stat);
+    }
+}
+
+static inline void lock_stat_waited(lock_stat_t* stat, uint64_t start) {
+    stat->contended++;
+    stat->spin_cycles += rdtsc() - start;
+}
+
+/* Spins on plain reads between attempts so waiters do not keep
+ * stealing the cache line from the holder */
+static inline void spin_lock(spinlock_t* lock) {
+    uint64_t start;
+
+    if (xchg(&lock->locked, 1) != 0) {
+        start = rdtsc();
+        do {
+            while (lock->locked) {
+                asm volatile ("pause" : : : "memory");
+            }
+        } while (xchg(&lock->locked, 1) != 0);
+        lock_stat_waited(&lock->stat, start);
+    }
+    lock_stat_acquired(&lock->stat);
+}
+
+/* Returns 1 if the lock was taken, 0 if somebody holds it */
+static inline int spin_trylock(spinlock_t* lock) {
+    if (xchg(&lock->locked, 1) != 0) {
+        return 0;
+    }
+    lock_stat_acquired(&lock->stat);
+    return 1;
+}
+
+/* Stores are not reordered with older stores on x86, a compiler
+ * barrier is enough to keep the critical section inside */
+static inline void spin_unlock(spinlock_t* lock) {
+    asm volatile ("" : : : "memory");
+    lock->locked = 0;
+}
+
+static inline void ticket_lock(ticketlock_t* lock) {
+    uint16_t ticket = xadd16(&lock->next, 1);
+    uint64_t start;
+
+    if (lock->owner != ticket) {
+        start = rdtsc();
+        while (lock->owner != ticket) {
+            asm volatile ("pause" : : : "memory");
+        }
+        lock_stat_waited(&lock->stat, start);
+    }
+    lock_stat_acquired(&lock->stat);
+}
+
+/* Only the holder writes owner, no locked instruction needed */
+static inline void ticket_unlock(ticketlock_t* lock) {
+    asm volatile ("" : : : "memory");
+    lock->owner = lock->owner + 1;
+}
+
+/* Interrupt safe variants for data an interrupt handler also touches.
+ * flags keeps the caller's interrupt state, so they nest and never turn
+ * interrupts on for a caller that had them off. Need lib.h */
+#define spin_lock_irqsave(lock, flags)          \
+do {                                            \
+    cli_and_save(flags);                        \
+    spin_lock(lock);                            \
+} while (0)
+
+#define spin_unlock_irqrestore(lock, flags)     \
+do {                                            \
+    spin_unlock(lock);                          \
+    restore_flags(flags);                       \
+} while (0)
+
+#define ticket_lock_irqsave(lock, flags)        \
+do {                                            \
+    cli_and_save(flags);                        \
+    ticket_lock(lock);                          \
+} while (0)
+
+#define ticket_unlock_irqrestore(lock, flags)   \
+do {                                            \
+    ticket_unlock(lock);                        \
+    restore_flags(flags);                       \
+} while (0)
+
+#endif /* _SPINLOCK_H */
@@ -0,0 +1,66 @@
+/* sysenter.c - Sets up the SYSENTER/SYSEXIT system call entry
+ * vim:ts=4 noexpandtab
+ */
+
+#include "sysenter.h"
+#include "x86_desc.h"
+#include "smp.h"
+
+/*
+ * wrmsr
+ *   DESCRIPTION: Writes a model specific register
+ *   INPUTS: msr -- register number, val -- low 32 bits, high ones are 0
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: faults for registers the CPU does not have
+ */
+static inline void wrmsr(uint32_t msr, uint32_t val) {
+    asm volatile ("wrmsr" : : "c" (msr), "a" (val), "d" (0));
+}
+
+/*
+ * sysenter_present
+ *   DESCRIPTION: Checks CPUID for SYSENTER/SYSEXIT. The first Pentium Pros
+ *                report it but do not have it (family 6, model and
+ *                stepping below 3)
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if usable, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int sysenter_present(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile ("cpuid"
+            : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+            : "a" (1)
+    );
+    if (!(edx & CPUID_SEP)) {
+        return 0;
+    }
+    if (((eax >> 8) & 0xF) == 6 && ((eax >> 4) & 0xF) < 3 && (eax & 0xF) < 3) {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * sysenter_init
+ *   DESCRIPTION: Loads the SYSENTER MSRs of the calling CPU. SYSENTER
+ *                starts on the CPU's TSS as stack, sysenter_entry swaps
+ *                it for the esp0 stored there, so nothing changes per
+ *                task switch
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none on CPUs without SYSENTER, user programs then keep
+ *                 using int 0x80
+ */
+void sysenter_init(void) {
+    if (!sysenter_present()) {
+        return;
+    }
+    wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t) this_cpu()->tss);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+}
@@ -0,0 +1,23 @@
+/* sysenter.h - SYSENTER/SYSEXIT fast system call entry, int 0x80 keeps
+ * working next to it
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SYSENTER_H
+#define _SYSENTER_H
+
+#include "types.h"
+
+#define MSR_SYSENTER_CS     0x174       // kernel CS, SS = CS + 8, user CS/SS = CS + 16/24
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+#define CPUID_SEP           0x800       // CPUID 1 EDX bit 11: SYSENTER/SYSEXIT
+
+/* CPU has working SYSENTER/SYSEXIT (CPUID) */
+int sysenter_present(void);
+
+/* Points the calling CPU's SYSENTER MSRs at sysenter_entry, after its ltr */
+void sysenter_init(void);
+
+#endif /* _SYSENTER_H */
@@ -1,12 +1,12 @@
 #include "system_calls.h"
+#include "scheduling.h"
 // #include "i8259.h"
 // #define VIDEO_MEM   0xB8000
 // #define VIDMAP_VA   0xF0000000
 
 static int num_times_run = 0;
-static char argument_passed[128];
-static int global_pid = -1;
-static int prev_global_pid = -1;
+
+static int32_t load_program(const uint8_t* command, int term_idx, int parent);
  /* int32_t sys_call_read()
  * DESCRIPTION: reads from a particular device based on file descriptor.
  * INPUTS: file descriptor, buffer that needs to be filled up, and how many bytes that need to be read.
@@ -23,12 +23,12 @@ int32_t sys_call_read (int32_t fd, void* buf, int32_t nbytes){
     if(nbytes < 0)  return -1; 
     if(fd < 0)      return -1;
     if(buf == 0)    return -1;
-    if(pcb_valid(global_pid, fd) == -1) return -1;
+    if(pcb_valid(get_global_pid(), fd) == -1) return -1;
 
     // printf("\nchecked args");
    
     /* Read from the file*/
-    pcb_val = get_pcb_pid(global_pid);
+    pcb_val = get_pcb_pid(get_global_pid());
     uint32_t num_bytes_read;
     if (fd == 0) {
         num_bytes_read = terminal_read(fd, buf, nbytes);
@@ -39,12 +39,12 @@ int32_t sys_call_read (int32_t fd, void* buf, int32_t nbytes){
     else if (pcb_val.fd_array[fd].ops.read == &dir_read) {
         num_bytes_read = dir_read(fd, buf, nbytes);
         if (num_bytes_read > 0) {
-            set_pcb_file_position(global_pid, fd, pcb_val.fd_array[fd].file_position + 32);
+            set_pcb_file_position(get_global_pid(), fd, pcb_val.fd_array[fd].file_position + 32);
         }
     }
     else {
         num_bytes_read = file_read(fd, buf, nbytes);
-        set_pcb_file_position(global_pid, fd, pcb_val.fd_array[fd].file_position + num_bytes_read);
+        set_pcb_file_position(get_global_pid(), fd, pcb_val.fd_array[fd].file_position + num_bytes_read);
     }
 
     /* Done file read */
@@ -67,16 +67,16 @@ int32_t sys_call_write (int32_t fd, const void* buf, int32_t nbytes){
     if(nbytes < 0) return -1; 
     if(fd < 0) return -1;
     if(buf==0) return -1;
-    if(pcb_valid(global_pid, fd) == -1) return -1;
+    if(pcb_valid(get_global_pid(), fd) == -1) return -1;
 
     uint32_t num_bytes_written;
     if (fd == 1) {
         num_bytes_written = terminal_write(fd, buf, nbytes);
     }
-    else if (get_pcb_pid(global_pid).fd_array[fd].ops.write == &rtc_write) {
+    else if (get_pcb_pid(get_global_pid()).fd_array[fd].ops.write == &rtc_write) {
         num_bytes_written = rtc_write(fd, buf, nbytes);
     }
-    else if (get_pcb_pid(global_pid).fd_array[fd].ops.write == &dir_write) {
+    else if (get_pcb_pid(get_global_pid()).fd_array[fd].ops.write == &dir_write) {
         num_bytes_written = dir_write(fd, buf, nbytes);
     }
     else {
@@ -116,7 +116,7 @@ int32_t sys_call_open (const uint8_t* filename){
         2: first index of non stdin and stdout file 
         8: we want to loop through index 7*/
     for(i = 2; i < 8; i++){
-        if(!get_pcb_pid(global_pid).fd_array[i].flags){
+        if(!get_pcb_pid(get_global_pid()).fd_array[i].flags){
             cur_file_open = i;
             break;
         }
@@ -132,38 +132,39 @@ int32_t sys_call_open (const uint8_t* filename){
         case (0):
             //! Fix RTC
             // Sets read, write, open, close, and inode num
-            set_pcb_open(global_pid, cur_file_open,(int32_t *) &rtc_open);
-            set_pcb_read(global_pid, cur_file_open,(int32_t *) &rtc_read);
-            set_pcb_write(global_pid, cur_file_open,(int32_t *) &rtc_write);
-            set_pcb_close(global_pid, cur_file_open,(int32_t *) &rtc_close);
-            set_pcb_inode(global_pid, cur_file_open, dentry.inode_num);
+            set_pcb_open(get_global_pid(), cur_file_open,(int32_t *) &rtc_open);
+            set_pcb_read(get_global_pid(), cur_file_open,(int32_t *) &rtc_read);
+            set_pcb_write(get_global_pid(), cur_file_open,(int32_t *) &rtc_write);
+            set_pcb_close(get_global_pid(), cur_file_open,(int32_t *) &rtc_close);
+            set_pcb_inode(get_global_pid(), cur_file_open, dentry.inode_num);
             break;
 
         case (1):
             // Sets read, write, open, close, and inode num
-            set_pcb_open(global_pid, cur_file_open,(int32_t *) &dir_open);
-            set_pcb_read(global_pid, cur_file_open,(int32_t *) &dir_read);
-            set_pcb_write(global_pid, cur_file_open,(int32_t *) &dir_write);
-            set_pcb_close(global_pid, cur_file_open,(int32_t *) &dir_close);
-            set_pcb_inode(global_pid, cur_file_open, 0);
+            set_pcb_open(get_global_pid(), cur_file_open,(int32_t *) &dir_open);
+            set_pcb_read(get_global_pid(), cur_file_open,(int32_t *) &dir_read);
+            set_pcb_write(get_global_pid(), cur_file_open,(int32_t *) &dir_write);
+            set_pcb_close(get_global_pid(), cur_file_open,(int32_t *) &dir_close);
+            set_pcb_inode(get_global_pid(), cur_file_open, 0);
             break;
 
         case (2):
             // Sets read, write, open, close, and inode num
-            set_pcb_open(global_pid, cur_file_open, (int32_t *) &file_open);
-            set_pcb_read(global_pid, cur_file_open, (int32_t *) &file_read);
-            set_pcb_write(global_pid, cur_file_open, (int32_t *) &file_write);
-            set_pcb_close(global_pid, cur_file_open, (int32_t *) &file_close);
-            set_pcb_inode(global_pid, cur_file_open, dentry.inode_num);
+            set_pcb_open(get_global_pid(), cur_file_open, (int32_t *) &file_open);
+            set_pcb_read(get_global_pid(), cur_file_open, (int32_t *) &file_read);
+            set_pcb_write(get_global_pid(), cur_file_open, (int32_t *) &file_write);
+            set_pcb_close(get_global_pid(), cur_file_open, (int32_t *) &file_close);
+            set_pcb_inode(get_global_pid(), cur_file_open, dentry.inode_num);
             break;
     }
 
     /* Set generic PCB */
-    set_pcb_file_position(global_pid, cur_file_open, 0);
-    set_pcb_flags(global_pid, cur_file_open, 1);
+    set_pcb_file_position(get_global_pid(), cur_file_open, 0);
+    set_pcb_flags(get_global_pid(), cur_file_open, 1);
+    set_pcb_read_timeout(get_global_pid(), cur_file_open, 0);
 
     /* Open file, opens any file */
-    get_pcb_pid(global_pid).fd_array[cur_file_open].ops.open(filename);
+    get_pcb_pid(get_global_pid()).fd_array[cur_file_open].ops.open(filename);
     return cur_file_open;
 }
 
@@ -183,43 +184,111 @@ int32_t sys_call_close (int32_t fd){
     /* Input validation */
     /* magic number 8: fd cannot be more than 7*/
     if(fd <= 1 || fd >= 8) return -1; // there are 8 elements in the fd array
-    if(pcb_valid(global_pid, fd) == -1) return -1;
+    if(pcb_valid(get_global_pid(), fd) == -1) return -1;
 
     /* Close files */
-    int32_t retval = get_pcb_pid(global_pid).fd_array[fd].ops.close(fd);
+    int32_t retval = get_pcb_pid(get_global_pid()).fd_array[fd].ops.close(fd);
 
     /* Reset file flags to close file */
-    get_pcb_pid(global_pid).fd_array[fd].inode = 0;
-    get_pcb_pid(global_pid).fd_array[fd].flags = 0;
-    get_pcb_pid(global_pid).fd_array[fd].file_position = 0;
+    get_pcb_pid(get_global_pid()).fd_array[fd].inode = 0;
+    get_pcb_pid(get_global_pid()).fd_array[fd].flags = 0;
+    get_pcb_pid(get_global_pid()).fd_array[fd].file_position = 0;
+    get_pcb_pid(get_global_pid()).fd_array[fd].read_timeout = 0;
 
     /* Reset file operations, except close */
-    get_pcb_pid(global_pid).fd_array[fd].ops.open = NULL;
-    get_pcb_pid(global_pid).fd_array[fd].ops.close = NULL;
-    get_pcb_pid(global_pid).fd_array[fd].ops.read = NULL;
-    get_pcb_pid(global_pid).fd_array[fd].ops.write = NULL;
+    get_pcb_pid(get_global_pid()).fd_array[fd].ops.open = NULL;
+    get_pcb_pid(get_global_pid()).fd_array[fd].ops.close = NULL;
+    get_pcb_pid(get_global_pid()).fd_array[fd].ops.read = NULL;
+    get_pcb_pid(get_global_pid()).fd_array[fd].ops.write = NULL;
     
     /* Done closing */
     return retval;
 }
 
 /* int32_t sys_call_execute()
- * DESCRIPTION: takes in command, parses it, and then loads executable into memory to begin execution of program.
- *              Reads from files specified in command. Context of task is pushed onto the stack.
+ * DESCRIPTION: runs command as a child of the calling program, on the caller's terminal.
+ *              The caller sleeps off the run queue until the child halts.
  * INPUTS: command, which is a string
  * OUTPUTS: prints to the screen,
- * SIDE EFFECTS: program executable memory address if overwritten. pid incremented.
- * RETURN: -1 if failure to read command
+ * SIDE EFFECTS: see do_execute
+ * RETURN: -1 if failure to read command, the child's halt status once it halts
 */
 int32_t sys_call_execute (const uint8_t* command){
 
-    //printf("\nsys_call_execute");
-    // cli();
+    sti();
+    if (get_global_pid() < 0) {
+        return -1;
+    }
+    return do_execute(command, pcb_array[get_global_pid()].terminal_idx, get_global_pid());
+}
+
+/* int32_t spawn_shell()
+ * DESCRIPTION: starts the base shell of a terminal. Called directly by the kernel (boot and
+ *              terminal switch) instead of through int 0x80, so nobody waits on the shell.
+ * INPUTS: term_idx, 0-based terminal the shell owns
+ * OUTPUTS: none
+ * SIDE EFFECTS: see do_execute. The interrupted program (if any) stays on the run queue
+ *               and resumes by returning from here.
+ * RETURN: -1 if no process slot is free
+*/
+int32_t spawn_shell (int term_idx){
+    return do_execute((const uint8_t*)"shell", term_idx, -1);
+}
+
+/* int32_t do_execute()
+ * DESCRIPTION: runs command as a new process and, unless it is a base shell, waits for it.
+ *              The program load yields at read_data's preemption points unless the caller
+ *              holds a preempt_disable section (halt respawning a base shell).
+ * INPUTS: command, which is a string
+ *         term_idx, 0-based terminal the program runs on
+ *         parent, PID that waits for the program, -1 for a terminal's base shell
+ * OUTPUTS: prints to the screen,
+ * SIDE EFFECTS: New PID queued on the scheduler, parent removed from it until halt.
+ * RETURN: -1 if failure to read command or no free PID, otherwise 0 for a base shell and
+ *         the status passed to halt for anything else
+*/
+int32_t do_execute (const uint8_t* command, int term_idx, int parent){
+    uint32_t flags;
+    int32_t child;
+
     sti();
     num_times_run++;
-    // if(num_times_run == 1){
 
-    // }
+    child = load_program(command, term_idx, parent);
+
+    if (child < 0) {
+        return -1;
+    }
+
+    /* Base shell, the caller keeps running */
+    if (parent < 0) {
+        return 0;
+    }
+
+    /* Parent sleeps until the child halts and hands back its status */
+    cli_and_save(flags);
+    while (pcb_array[parent].waiting_child >= 0) {
+        sleep_on(&pcb_array[parent]);
+    }
+    restore_flags(flags);
+
+    return pcb_array[parent].exit_status;
+}
+
+/* int32_t load_program()
+ * DESCRIPTION: takes in command, parses it, and then loads executable into memory to begin execution of program.
+ *              Reads from files specified in command. Context of task is pushed onto the stack.
+ * INPUTS: command, which is a string
+ *         term_idx, 0-based terminal the program runs on
+ *         parent, PID that waits for the program, -1 for a terminal's base shell
+ * OUTPUTS: none
+ * SIDE EFFECTS: program executable memory address if overwritten. New PID queued on the scheduler,
+ *               parent marked as waiting on it. Only reserving the slot and setting up its PCB
+ *               is a preempt_disable section, the image copy may switch away.
+ * RETURN: PID of the new process, -1 if failure to read command or no free PID
+*/
+static int32_t load_program (const uint8_t* command, int term_idx, int parent){
+
     /* Check if NULL command */
      if(command == 0){
         return -1;
@@ -258,23 +327,17 @@ int32_t sys_call_execute (const uint8_t* command){
         }
     }
 
-    char cmd_arg[128];
-    for(i = 0; i < 128; i++) {
-            argument_passed[i] = 0;
+    char cmd_arg[MAX_ARG_LEN];
+    for (i = 0; i < MAX_ARG_LEN; i++) {
+        cmd_arg[i] = 0;
     }
 
-    /* Parse user input into command and command args */
+    /* Parse user input into command and command args, the args go to the child's PCB */
 
     if (!(space_index == strlen((int8_t*)command))) {
-        for (i = 0; i < 128; i++) {
-            cmd_arg[i] = 0;
-        }
-        for(i = space_index + 1; i < strlen((int8_t*)command); i++){
+        for(i = space_index + 1; i < strlen((int8_t*)command) && i - space_index - 1 < MAX_ARG_LEN - 1; i++){
             cmd_arg[i - space_index - 1] = command[i];
         }
-        for(i = 0; i < strlen((int8_t*)cmd_arg); i++) {
-            argument_passed[i] = cmd_arg[i];
-        }
     }
 
     /* Read first four bytes of executable */
@@ -309,190 +372,123 @@ int32_t sys_call_execute (const uint8_t* command){
         return -1;
     }
 
-    /* Increment PID, if not base shell (PID = 0) */
+    /* Take the lowest free PID, run queue stays untouched by the PIT meanwhile */
+    uint32_t flags;
+    int child = -1;
+    int curr_pid = get_global_pid();
 
-    int lowest_null_index;
-
-    for (i = 0; i < 6; i++) {
-        if (get_pcb_pid(i).fd_array[0].flags == 0) {
-            lowest_null_index = i;
+    preempt_disable();
+    cli_and_save(flags);
+    for (i = 0; i < MAX_PROCESSES; i++) {
+        if (pcb_array[i].state == TASK_UNUSED) {
+            child = i;
             break;
         }
     }
 
-    prev_global_pid = global_pid;
-    global_pid = lowest_null_index;
-
-    /*initialize pcb*/
-    int curr_terminal_pcb;
-    curr_terminal_pcb = get_terminal_array_entry(get_term_num() - 1);
-    init_pcb(get_term_num() - 1, curr_terminal_pcb, global_pid);     // INIT basic PCB
-    set_pcb_cmd(global_pid, (uint8_t*) cmd);
-    // set_pcb_ebp(global_pid, 0x800000 - (global_pid * 0x2000));
+    /* Process table full */
+    if (child < 0) {
+        restore_flags(flags);
+        preempt_enable();
+        return -1;
+    }
 
-    set_terminal_array_entry(get_term_num() - 1, global_pid);
+    /*initialize pcb, slot is reserved (blocked) until the program is loaded*/
+    init_pcb(term_idx, parent, child);     // INIT basic PCB
+    set_pcb_cmd(child, (uint8_t*) cmd);
+    strncpy(pcb_array[child].comm, (int8_t*) cmd, TASK_COMM_LEN - 1);
+    pcb_array[child].comm[TASK_COMM_LEN - 1] = '\0';
+    trace_execute(child, pcb_array[child].comm);
+    memcpy(pcb_array[child].args, cmd_arg, MAX_ARG_LEN);
+    sched_task_init(child);
+    restore_flags(flags);
+    preempt_enable();
 
     /* Unpack starting address from file */
     /* Known starting addresses: 0x080482E8 Shell, 0x08048248 LS */
     // 0xFF because this masks the byte being read
     uint32_t image_start = (execaddr[0] & 0x0FF) + ((execaddr[1] & 0x0FF)<<8) + ((execaddr[2] & 0x0FF)<<16) + ((execaddr[3] & 0x0FF)<<24);
-    // if (num_times_run == 2) {
-    //     image_start = 0x8048248;
-    // }
-    set_pcb_image_start(global_pid, image_start);
-
-    /*4 = 4 mb per page, 8 = starting 8 mb physical address*/
-    int phys_address_mb = (global_pid * 4) + 8;
-    // if (num_times_run == 2) {
-    //     phys_address_mb = 8;
-    // }
-    execute_page_setup(phys_address_mb); // sets up the page + VA and PA mapping
+    set_pcb_image_start(child, image_start);
+
+    /* Copy the program through the child's page directory. The caller's context
+     * carries it meanwhile, so a task switch during the load keeps it loaded */
+    uint32_t child_cr3 = process_page_setup(child, USER_PAGE_MB(child));
+    uint32_t curr_cr3 = pcb_array[curr_pid].ctx.cr3;
+    pcb_array[curr_pid].ctx.cr3 = child_cr3;
+    load_page_directory((void*) child_cr3);
     user_level_program_loader((uint8_t*) cmd); // copies the file to the given VA
-    
-
-
-    /* Task Switch */
-    tss.ss0 = KERNEL_DS;
-    /*magic numbers:
-     * 0x800000: 8MB, virtual adress of bottom of kernel page
-     * 0x2000: 8 kb, the amount of space per task kernel stack*/
-    tss.esp0 = 0x800000 - (global_pid * 0x2000) - 4;//- 4;
-
-    uint32_t sav_ebp;
-    uint32_t sav_esp;
+    pcb_array[curr_pid].ctx.cr3 = curr_cr3;
+    load_page_directory((void*) curr_cr3);
 
-    asm volatile(
-        "mov %%ebp, %0            ;\n"
-        "mov %%esp, %1            ;\n"
-        :"=g" (sav_ebp), "=g" (sav_esp)
-        :
-        :"memory", "cc"
-    );
-
-    set_ebpesp_halt(global_pid, sav_ebp, sav_esp);
-    set_ebpesp(global_pid, sav_ebp, sav_esp); 
-
-
-    // sti();
-    // cli();
-    asm volatile(
-            "pushl %0                     ;\n"
-            "pushl %3                     ;\n"
-            "pushfl                       ;\n"
-            "popl %%eax                       ;\n"
-            "orl $0x200, %%eax                       ;\n"
-            "pushl %%eax                       ;\n"
-            "pushl %1                     ;\n"
-            "pushl %2                     ;\n"
-            "iret                         ;\n"
-            : 
-            :"g" (0x0000002B),"g" (0x00000023),"g" (image_start), "g" (0x8400000 - 4)
-            :"memory"                   
-    );
-
-    // 0x0000002B because this is the value of USER_DS
-    // 0x00000023 because this is the value of USER_CS
-    // 0x8400000 is the starting address of the 128-132MB page stack. 
-    // 4 because there are 4 bytes for each address in memory, so this goes to the previous address before the start of the stack
-    //sti();
-    //printf("no page fault");
-asm("returnhere:");
-    /* Turn off FD's */
-    /*magic numbers:
-     *2 = index of first file after stdin and stdout
-     *8 = loop through index 7 */
-
-    // for(i = 2; i < 8; i++){
-    //     get_pcb_pid(global_pid).fd_array[i].flags = 0;
-    // }
+    /* First switch_to into the child irets to image_start */
+    init_task_context(child, image_start, child_cr3);
 
+    /* Parent is marked before the child can run, and halt, at all */
+    cli_and_save(flags);
+    if (parent >= 0) {
+        pcb_array[parent].waiting_child = child;
+    }
+    set_terminal_array_entry(term_idx, child);
+    enqueue_task(child);
+    restore_flags(flags);
 
-    return 0;
-    
+    return child;
 }
 
 /* int32_t sys_call_halt()
- * DESCRIPTION: takes in command, parses it, and then loads executable into memory to begin execution of program.
- *              Reads from files specified in command. Context of task is pushed onto the stack.
- * INPUTS: command, which is a string
- * OUTPUTS: prints to the screen,
- * SIDE EFFECTS: program executable memory address if overwritten. pid incremented.
- * RETURN: -1 if failure to read command
+ * DESCRIPTION: terminates the calling program. Its parent wakes up and execute returns status
+ *              to it. A terminal's base shell is replaced by a new one instead.
+ * INPUTS: status, value returned by the parent's execute
+ * OUTPUTS: none
+ * SIDE EFFECTS: frees the PID, switches to the next task on the run queue
+ * RETURN: never returns
 */
 int32_t sys_call_halt(uint8_t status) {
 
+    trace_event(TRACE_HALT, status, 0);
+
+    /* Interrupts stay off until we switched away, except while a base shell
+     * respawns (do_execute turns them on), the count keeps us here meanwhile */
     cli();
+    preempt_disable();
 
     int parent_pcb_val, term_number, child_pcb_val;
 
-    if(get_pcb_pid(global_pid).parent_pcb_pid < 0){
-        clear_pcb(global_pid);
-        const uint8_t shell[] = "shell";
-        sys_call_execute(shell);
-    }
+    child_pcb_val = get_global_pid();
+    parent_pcb_val = get_pcb_pid(get_global_pid()).parent_pcb_pid;
+    term_number = get_pcb_pid(get_global_pid()).terminal_idx;
 
-    child_pcb_val = global_pid;
-    parent_pcb_val = get_pcb_pid(global_pid).parent_pcb_pid;
-    term_number = get_pcb_pid(global_pid).terminal_idx;
+    /* Drop the halting program's vidmap page */
+    unmap_term_vidmap(term_number + 1);
 
-    clear_pcb(global_pid);
-    set_terminal_array_entry(term_number, parent_pcb_val);
-  
-    /* Close FD entires */
-    int i;
-    /*Magic number 8 = total number of files in fd array*/
-    for(i = 0; i < 8; i++) {
-        set_pcb_flags(global_pid, i, 0);
-    }
-
-    global_pid = parent_pcb_val;
-  
-    /* Decrement PID, unless base */
-    
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = 0x800000 - (global_pid * 0x2000);
-    // 0x800000 is the value of 8 MB in memory, and 0x2000 is 8 kB
-
-    /* Restore page and delete PCB */
-    /*Magic numbers:
-     * 4 = 4 mb
-     * 8 = 8 mb*/
-    int phys_address_mb = (global_pid * 4) + 8;
-    execute_page_setup(phys_address_mb); // sets up the page + VA and PA mapping
+    if(parent_pcb_val < 0){
+        /* Base shell exited, start a new one on the same terminal */
+        set_terminal_array_entry(term_number, -1);
+        if(spawn_shell(term_number) < 0){
+            /* Every slot is taken, the terminal is left without a shell */
+            printf("halt: no free process for the shell of terminal %d\n", term_number + 1);
+        }
 
-    //!TEST
-    //setup_4kb_page(0xb8000, 0x0F0000000, 0);
-    if (get_term_num() == 1) {
-        setup_4kb_page(0xb9000, 0x0F0000000, 0);
+        /* The run queue unlink and the switch below need them off again */
+        cli();
     }
-    else if (get_term_num() == 2) {
-        setup_4kb_page(0xbA000, 0x0F0000000, 0);
+    else{
+        /* Parent runs again, execute returns status */
+        set_terminal_array_entry(term_number, parent_pcb_val);
+        pcb_array[parent_pcb_val].exit_status = status;
+        pcb_array[parent_pcb_val].waiting_child = -1;
+        wake_up(&pcb_array[parent_pcb_val]);
     }
-    else if (get_term_num() == 3) {
-        setup_4kb_page(0xbB000, 0x0F0000000, 0);
-    }
-        // Jump to execute table
-
-    // goto execute_done;
-    uint32_t sav_ebp, sav_esp;
-    sav_ebp = get_ebp_halt(child_pcb_val);
-    sav_esp = get_esp_halt(child_pcb_val);
 
-    // sav_ebp = 0x7fffcc;
-    // sav_esp = 0x7ffcb4;
+    /* Leave the run queue and free the PID, the slot (and this kernel stack)
+     * is only reused after we switched away */
+    dequeue_task(child_pcb_val);
+    clear_pcb(child_pcb_val);
+    pcb_array[child_pcb_val].state = TASK_UNUSED;
 
-    sti();
-
-    asm volatile(
-        "movl %1, %%esp      ;\n"
-        "movl %0, %%ebp      ;\n"
-        :
-        :"r"(sav_ebp), "r"(sav_esp)
-        :"memory" 
-    );
-
-    asm("jmp returnhere");
+    scheduling_context_switch(schedule());
 
+    /* Never scheduled again */
     return 0;
 }
 
@@ -501,25 +497,26 @@ int32_t sys_call_halt(uint8_t status) {
  * INPUTS: uint8_t* buf, an empty buffer
  *          uint32_t nbytes, number of bytes to be copied
  * OUTPUTS: none
- * SIDE EFFECTS: argument_passed is read, buffer is written to 
+ * SIDE EFFECTS: the caller's PCB args are read, buffer is written to 
  * RETURN: -1 if null buffer passed, 0 if successful
 */
 int32_t sys_call_get_args (uint8_t* buf, int32_t nbytes){
     int i;
+    int8_t* args = pcb_array[get_global_pid()].args;
 
     // return error if buf is NULL
     if(buf == 0) return -1; 
-    if ((strlen(argument_passed) == 0) || strlen(argument_passed) > 32) {
+    if ((strlen(args) == 0) || strlen(args) > 32) {
         return -1;
     } 
 
     // fills the buffer with the argument
-    for (i = 0; i < strlen(argument_passed); i++) {
-        buf[i] = argument_passed[i];
+    for (i = 0; i < strlen(args); i++) {
+        buf[i] = args[i];
     }
 
     // NULL terminating the buffer
-    buf[strlen(argument_passed)] = 0;
+    buf[strlen(args)] = 0;
     return 0;
 }
 /* int32_t sys_call_vidmap (uint8_t** screen_start)
@@ -553,11 +550,9 @@ int32_t sys_call_vidmap (uint8_t** screen_start){
     //choose the 4kb block to start at 0xF0000000 virtual memory/
     //0xb8000 is the physical memory address of video memory/
 
-    //EFFFF000 for t2
-    //EFFFE000 for t3/
-    uint32_t va_t1= 0xF0000000;
-    uint32_t va_t2 = 0xEFFFE000;
-    uint32_t va_t3 = 0xEFFFC000;
+    //EFFFE000 for t2
+    //EFFFC000 for t3/
+    //see map_term_vidmap in multiple_terminals.c
 
 
 
@@ -568,22 +563,8 @@ int32_t sys_call_vidmap (uint8_t** screen_start){
     //setup the 4kb page, set it to present*/
     //set the pointer to the virtual address/
 
-    switch(get_term_num()){
-        case 1:
-            setup_4kb_page((uint32_t) (0xB8000 + get_term_num() * 0x1000), va_t1, 1);
-            *screen_start = (uint8_t*) va_t1;
-            return 0;
-        case 2:
-           setup_4kb_page((uint32_t) (0xB8000 + get_term_num() * 0x1000), va_t2, 1);
-           *screen_start = (uint8_t*) va_t2;
-           return 0;
-        case 3:
-            setup_4kb_page((uint32_t) (0xB8000 + get_term_num() * 0x1000), va_t3, 1);
-            *screen_start = (uint8_t*) va_t3;
-            return 0;
-        default:
-            return 0; 
-    }
+    /* Map the caller's terminal, VGA memory while displayed, its backing page otherwise */
+    *screen_start = (uint8_t*) map_term_vidmap(pcb_array[get_global_pid()].terminal_idx + 1);
 
     //set the pointer to the virtual address/
 
@@ -597,17 +578,305 @@ int32_t sys_call_sigreturn (void){
     return -1;
 }
 
+/* int32_t sys_call_setpriority (int32_t pid, int32_t prio)
+ * DESCRIPTION: sets the scheduling priority of a process. Higher priorities run first and
+ *              get longer timeslices, programs it executes afterwards inherit it.
+ * INPUTS: pid, process to change, -1 for the caller
+ *         prio, 0 (highest) to NUM_PRIO - 1 (lowest), DEFAULT_PRIO to undo
+ * OUTPUTS: none
+ * SIDE EFFECTS: moves the process within the run queue
+ * RETURN: 0 on success, -1 on a bad pid or priority
+ */
+int32_t sys_call_setpriority (int32_t pid, int32_t prio){
+    return sched_setpriority(pid, prio);
+}
+
+/* int32_t sys_call_getpriority (int32_t pid)
+ * DESCRIPTION: reads the scheduling priority of a process
+ * INPUTS: pid, process to read, -1 for the caller
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: priority, -1 on a bad pid
+ */
+int32_t sys_call_getpriority (int32_t pid){
+    return sched_getpriority(pid);
+}
+
+/* int32_t sys_call_set_timeslice (int32_t pid, int32_t ms)
+ * DESCRIPTION: overrides the timeslice a process gets from its priority
+ * INPUTS: pid, process to change, -1 for the caller
+ *         ms, slice length up to MAX_SLICE_MS, 0 for the priority default
+ * OUTPUTS: none
+ * SIDE EFFECTS: inherited by programs the process executes afterwards
+ * RETURN: slice in ms after rounding to PIT ticks, -1 on a bad pid or length
+ */
+int32_t sys_call_set_timeslice (int32_t pid, int32_t ms){
+    return sched_set_timeslice(pid, ms);
+}
+
+/* int32_t sys_call_set_scheduler (int32_t pid, int32_t policy, int32_t param)
+ * DESCRIPTION: moves a process to a scheduling class. Real-time processes (SCHED_RR, SCHED_EDF)
+ *              run before best-effort ones and preempt them when the RTC wakes them, for at
+ *              most RT_RUNTIME_TICKS of every RT_PERIOD_TICKS per CPU.
+ * INPUTS: pid, process to change: -1 for the caller, else the caller or one of its children
+ *         policy, SCHED_NORMAL, SCHED_RR or SCHED_EDF
+ *         param, rt priority for SCHED_RR, relative deadline in ms for SCHED_EDF
+ *                (0 = the period of its RTC reads)
+ * OUTPUTS: none
+ * SIDE EFFECTS: resets the deadline miss count, inherited by programs executed afterwards
+ * RETURN: 0 on success, -1 on a bad pid, someone else's process, policy or param
+ */
+int32_t sys_call_set_scheduler (int32_t pid, int32_t policy, int32_t param){
+    int caller = get_global_pid();
+
+    /* Nobody moves unrelated processes, base shells included */
+    if (pid >= 0 && pid != caller &&
+        (pid >= MAX_PROCESSES || pcb_array[pid].parent_pcb_pid != caller)) {
+        return -1;
+    }
+    return sched_setscheduler(pid, policy, param);
+}
+
+/* int32_t sys_call_get_scheduler (int32_t pid)
+ * DESCRIPTION: reads the scheduling class of a process
+ * INPUTS: pid, process to read, -1 for the caller
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: SCHED_* policy, -1 on a bad pid
+ */
+int32_t sys_call_get_scheduler (int32_t pid){
+    return sched_getscheduler(pid);
+}
+
+/* int32_t sys_call_deadline_misses (int32_t pid)
+ * DESCRIPTION: reports how many periods a real-time process finished late
+ * INPUTS: pid, process to read, -1 for the caller
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: miss count, -1 on a bad pid
+ */
+int32_t sys_call_deadline_misses (int32_t pid){
+    return sched_deadline_misses(pid);
+}
+
+/* int32_t sys_call_lock_stat (uint8_t* buf, int32_t nbytes)
+ * DESCRIPTION: reports how often each kernel lock was taken and waited for
+ * INPUTS: buf, buffer for the text, one "name acquired contended spin" line per lock
+ *         nbytes, size of buf
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: bytes written, -1 for a buffer outside the program page
+ */
+int32_t sys_call_lock_stat (uint8_t* buf, int32_t nbytes){
+    if(nbytes < 0) return -1;
+    if(!user_range_ok(buf, nbytes)) return -1;
+    return lock_stat_read(buf, nbytes);
+}
+
+/* int32_t sys_call_irqsoff_stat (uint8_t* buf, int32_t nbytes)
+ * DESCRIPTION: reports how long each kernel call site kept interrupts off (IRQSOFF_PROFILE)
+ * INPUTS: buf, buffer for the text, a header then one "file:line count max buckets..." line per site
+ *         nbytes, size of buf
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: bytes written, -1 for a buffer outside the program page
+ */
+int32_t sys_call_irqsoff_stat (uint8_t* buf, int32_t nbytes){
+    if(nbytes < 0) return -1;
+    if(!user_range_ok(buf, nbytes)) return -1;
+    return irqsoff_read(buf, nbytes);
+}
+
+/* int32_t sys_call_sched_stat (uint8_t* buf, int32_t nbytes)
+ * DESCRIPTION: lists every process and kernel thread with its CPU, state, class, priority
+ *              and ticks run, then the idle and busy tick totals
+ * INPUTS: buf, buffer for the text, one line per task
+ *         nbytes, size of buf
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: bytes written, -1 for a buffer outside the program page
+ */
+int32_t sys_call_sched_stat (uint8_t* buf, int32_t nbytes){
+    if(nbytes < 0) return -1;
+    if(!user_range_ok(buf, nbytes)) return -1;
+    return sched_stat_read(buf, nbytes);
+}
+
+/* int32_t sys_call_io_setup (io_ring_t* ring, uint32_t flags)
+ * DESCRIPTION: registers the caller's submission / completion rings, see io_ring.c
+ * INPUTS: ring, the rings inside the program page, NULL to drop them
+ *         flags, IORING_SQPOLL to have timer ticks drain the ring without io_enter
+ * OUTPUTS: none
+ * SIDE EFFECTS: empties the rings
+ * RETURN: 0 on success, -1 for bad flags or a ring outside the program page
+ */
+int32_t sys_call_io_setup (io_ring_t* ring, uint32_t flags){
+    return io_ring_setup(ring, flags);
+}
+
+/* int32_t sys_call_io_enter (uint32_t to_submit)
+ * DESCRIPTION: runs a batch of queued reads, writes, opens and closes in order and
+ *              posts one completion per entry, for the cost of one system call
+ * INPUTS: to_submit, most entries to take
+ * OUTPUTS: completions on the caller's ring
+ * SIDE EFFECTS: may sleep in the entries' reads
+ * RETURN: entries taken, -1 without a registered ring
+ */
+int32_t sys_call_io_enter (uint32_t to_submit){
+    return io_ring_enter(to_submit);
+}
+
+/* int32_t sys_call_clock_gettime (int32_t clock_id, timespec_t* ts)
+ * DESCRIPTION: reads the TSC based monotonic clock, nanosecond resolution
+ * INPUTS: clock_id, CLOCK_MONOTONIC
+ *         ts, where to put the seconds and nanoseconds since boot
+ * OUTPUTS: *ts
+ * SIDE EFFECTS: none
+ * RETURN: 0 on success, -1 for an unknown clock or ts outside the program page
+ */
+int32_t sys_call_clock_gettime (int32_t clock_id, timespec_t* ts){
+    if(!user_range_ok(ts, sizeof(timespec_t))) return -1;
+    return clock_read(clock_id, ts);
+}
+
+/* int32_t sys_call_sleep (uint32_t ms)
+ * DESCRIPTION: blocks the caller for a number of milliseconds on a kernel timer,
+ *              the CPU runs other tasks or idles meanwhile
+ * INPUTS: ms, how long to sleep
+ * OUTPUTS: none
+ * SIDE EFFECTS: sleeps at least ms, rounded up to the next scheduler tick
+ * RETURN: 0
+ */
+int32_t sys_call_sleep (uint32_t ms){
+    sleep_until_ns(clock_ns() + (uint64_t) ms * (NSEC_PER_SEC / 1000));
+    return 0;
+}
+
+/* int32_t sys_call_nanosleep (const timespec_t* req, timespec_t* rem)
+ * DESCRIPTION: blocks the caller for the time in req on a kernel timer
+ * INPUTS: req, seconds and nanoseconds to sleep
+ *         rem, optional, where to put the time left
+ * OUTPUTS: *rem, always 0 since nothing cuts a sleep short
+ * SIDE EFFECTS: sleeps at least req, rounded up to the next scheduler tick
+ * RETURN: 0 on success, -1 for pointers outside the program page or tv_nsec of 1 s or more
+ */
+int32_t sys_call_nanosleep (const timespec_t* req, timespec_t* rem){
+    if(!user_range_ok(req, sizeof(timespec_t))) return -1;
+    if(rem != NULL && !user_range_ok(rem, sizeof(timespec_t))) return -1;
+    if(req->tv_nsec >= NSEC_PER_SEC) return -1;
+
+    sleep_until_ns(clock_ns() + (uint64_t) req->tv_sec * NSEC_PER_SEC + req->tv_nsec);
+    if(rem != NULL){
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return 0;
+}
+
+/* int32_t sys_call_read_timeout (int32_t fd, int32_t ms)
+ * DESCRIPTION: bounds how long reads on a file may block. Terminal and RTC reads
+ *              return -1 once the timeout passes, other files never block
+ * INPUTS: fd, open file descriptor
+ *         ms, longest wait in milliseconds, 0 to wait forever
+ * OUTPUTS: none
+ * SIDE EFFECTS: applies to every later read of fd until it is closed
+ * RETURN: 0 on success, -1 for a bad fd or a negative ms
+ */
+int32_t sys_call_read_timeout (int32_t fd, int32_t ms){
+    if(fd < 0 || fd >= 8 || ms < 0) return -1; // there are 8 elements in the fd array
+    if(pcb_valid(get_global_pid(), fd) == -1) return -1;
+
+    set_pcb_read_timeout(get_global_pid(), fd, ms_to_ticks(ms));
+    return 0;
+}
+
+/* int32_t sys_call_prof_ctl (int32_t hz)
+ * DESCRIPTION: starts the sampling profiler on empty rings, or stops it. Every CPU's timer
+ *              interrupt then records the interrupted EIP, CS and task hz times a second
+ * INPUTS: hz, 1 to PIT_HZ samples per second and CPU, 0 to stop
+ * OUTPUTS: none
+ * SIDE EFFECTS: drops samples not dumped yet when starting
+ * RETURN: 0 on success, -1 for a bad rate or a kernel built without SAMPLE_PROFILE
+ */
+int32_t sys_call_prof_ctl (int32_t hz){
+    if(hz < 0) return -1;
+    return prof_start(hz);
+}
+
+/* int32_t sys_call_prof_dump (uint8_t* buf, int32_t nbytes)
+ * DESCRIPTION: moves profiler samples out of the kernel, one "cpu pid cs eip name" line each
+ *              with CS and EIP in hex. With a NULL buf every sample goes to COM1 instead
+ * INPUTS: buf, buffer for the text or NULL
+ *         nbytes, size of buf
+ * OUTPUTS: none
+ * SIDE EFFECTS: dumped samples are gone from the kernel
+ * RETURN: bytes written, 0 once all samples were dumped, -1 for a buffer outside the
+ *         program page
+ */
+int32_t sys_call_prof_dump (uint8_t* buf, int32_t nbytes){
+    if(buf == 0) return prof_dump_serial();
+    if(nbytes < 0) return -1;
+    if(!user_range_ok(buf, nbytes)) return -1;
+    return prof_read(buf, nbytes);
+}
+
+/* int32_t sys_call_trace_ctl (int32_t on)
+ * DESCRIPTION: starts the tracepoints on empty rings, or stops them. System calls, context
+ *              switches, IRQs, page faults, execute and halt are then recorded on every CPU
+ * INPUTS: on, 1 to start, 0 to stop
+ * OUTPUTS: none
+ * SIDE EFFECTS: drops records not dumped yet when starting
+ * RETURN: 0 on success, -1 for another value or a kernel built without TRACEPOINTS
+ */
+int32_t sys_call_trace_ctl (int32_t on){
+    if(on != 0 && on != 1) return -1;
+    return trace_start(on);
+}
+
+/* int32_t sys_call_trace_dump (uint8_t* buf, int32_t nbytes)
+ * DESCRIPTION: moves trace records out of the kernel, 20 byte binary trace_rec_t each and a
+ *              TRACE_HEADER record first. With a NULL buf every record goes to COM1 instead
+ * INPUTS: buf, buffer for the records or NULL
+ *         nbytes, size of buf
+ * OUTPUTS: none
+ * SIDE EFFECTS: dumped records are gone from the kernel
+ * RETURN: bytes written, 0 once all records were dumped, -1 for a buffer outside the
+ *         program page
+ */
+int32_t sys_call_trace_dump (uint8_t* buf, int32_t nbytes){
+    if(buf == 0) return trace_dump_serial();
+    if(nbytes < 0) return -1;
+    if(!user_range_ok(buf, nbytes)) return -1;
+    return trace_read(buf, nbytes);
+}
+
+/* int user_range_ok (const void* p, uint32_t n)
+ * DESCRIPTION: checks that a buffer a program passed lies inside its 128 MB program page,
+ *              before the kernel reads or writes it
+ * INPUTS: p, start of the buffer
+ *         n, its size in bytes
+ * OUTPUTS: none
+ * SIDE EFFECTS: none
+ * RETURN: 1 if it does, 0 otherwise
+ */
+int user_range_ok (const void* p, uint32_t n){
+    uint32_t addr = (uint32_t) p;
+
+    return addr >= USER_PAGE_START && addr < USER_PAGE_END && n <= USER_PAGE_END - addr;
+}
+
+/* Task running on the calling CPU, -1 before its idle task exists */
 int get_global_pid() {
-    return global_pid;
+    return this_cpu()->curr_pid;
 }
 
 void set_global_pid(int val) {
-    global_pid = val;
+    this_cpu()->curr_pid = val;
 }
 
 void set_tss_ss0(int ss0) {
-    tss.ss0 = ss0;
+    this_cpu()->tss->ss0 = ss0;
 }
 void set_tss_esp0(int esp0) {
-    tss.esp0 = esp0;
+    this_cpu()->tss->esp0 = esp0;
 }
@@ -7,6 +7,11 @@
 #include "keyboard.h"
 #include "i8259.h"
 #include "multiple_terminals.h"
+#include "io_ring.h"
+#include "clock.h"
+#include "timer.h"
+#include "profile.h"
+#include "trace.h"
 
 
 // Called by user
@@ -20,6 +25,25 @@ int32_t getargs(uint8_t* buf, int32_t nbytes);
 int32_t vidmap(uint8_t** screen_start);
 int32_t set_handler(int32_t signum, void* handler_address);
 int32_t sigreturn(void);
+int32_t setpriority(int32_t pid, int32_t prio);
+int32_t getpriority(int32_t pid);
+int32_t set_timeslice(int32_t pid, int32_t ms);
+int32_t set_scheduler(int32_t pid, int32_t policy, int32_t param);
+int32_t get_scheduler(int32_t pid);
+int32_t deadline_misses(int32_t pid);
+int32_t lock_stat(uint8_t* buf, int32_t nbytes);
+int32_t irqsoff_stat(uint8_t* buf, int32_t nbytes);
+int32_t sched_stat(uint8_t* buf, int32_t nbytes);
+int32_t io_setup(io_ring_t* ring, uint32_t flags);
+int32_t io_enter(uint32_t to_submit);
+int32_t clock_gettime(int32_t clock_id, timespec_t* ts);
+int32_t sleep(uint32_t ms);
+int32_t nanosleep(const timespec_t* req, timespec_t* rem);
+int32_t read_timeout(int32_t fd, int32_t ms);
+int32_t prof_ctl(int32_t hz);
+int32_t prof_dump(uint8_t* buf, int32_t nbytes);
+int32_t trace_ctl(int32_t on);
+int32_t trace_dump(uint8_t* buf, int32_t nbytes);
 
 
 // Called by kernel
@@ -33,6 +57,32 @@ extern int32_t sys_call_get_args(uint8_t* buf, int32_t nbytes);
 extern int32_t sys_call_vidmap(uint8_t** screen_start);
 extern int32_t sys_call_sethandler(int32_t signum, void* handler_address);
 extern int32_t sys_call_sigreturn(void);
+extern int32_t sys_call_setpriority(int32_t pid, int32_t prio);
+extern int32_t sys_call_getpriority(int32_t pid);
+extern int32_t sys_call_set_timeslice(int32_t pid, int32_t ms);
+extern int32_t sys_call_set_scheduler(int32_t pid, int32_t policy, int32_t param);
+extern int32_t sys_call_get_scheduler(int32_t pid);
+extern int32_t sys_call_deadline_misses(int32_t pid);
+extern int32_t sys_call_lock_stat(uint8_t* buf, int32_t nbytes);
+extern int32_t sys_call_irqsoff_stat(uint8_t* buf, int32_t nbytes);
+extern int32_t sys_call_sched_stat(uint8_t* buf, int32_t nbytes);
+extern int32_t sys_call_io_setup(io_ring_t* ring, uint32_t flags);
+extern int32_t sys_call_io_enter(uint32_t to_submit);
+extern int32_t sys_call_clock_gettime(int32_t clock_id, timespec_t* ts);
+extern int32_t sys_call_sleep(uint32_t ms);
+extern int32_t sys_call_nanosleep(const timespec_t* req, timespec_t* rem);
+extern int32_t sys_call_read_timeout(int32_t fd, int32_t ms);
+extern int32_t sys_call_prof_ctl(int32_t hz);
+extern int32_t sys_call_prof_dump(uint8_t* buf, int32_t nbytes);
+extern int32_t sys_call_trace_ctl(int32_t on);
+extern int32_t sys_call_trace_dump(uint8_t* buf, int32_t nbytes);
+
+/* Process creation */
+int32_t do_execute(const uint8_t* command, int term_idx, int parent);
+int32_t spawn_shell(int term_idx);
+
+/* 1 if a program's buffer lies inside its program page */
+int user_range_ok(const void* p, uint32_t n);
 
 void set_global_pid(int val);
 int get_global_pid();
@@ -1,12 +1,19 @@
 #include "terminal.h"
+#include "scheduling.h"
+#include "timer.h"
+#include "pcb.h"
 static uint8_t key_buf[BUF_SIZE];                     //buffer to store keyboard input
 static uint8_t key_buf_1[BUF_SIZE];   
 static uint8_t key_buf_2[BUF_SIZE];   
 static uint8_t key_buf_3[BUF_SIZE];   
 //initialize struct variables to 0
-static terminal_info info = {0, 0};
+static terminal_info info[3];                         //line state per terminal
 static int typed_command;
 
+/* Line buffers, line state and the screens. Taken by the keyboard
+ * interrupt (add_char, terminal switches) and by read/write */
+spinlock_t tty_lock = SPIN_LOCK_INIT("tty");
+
 /* void add_char(void)
  * DESCRIPTION: copies char processed in keyboard interrupt into buffer of size 128
  * INPUTS: unsigned 8 bit integer (char), passed in by keyboard interrupt handler
@@ -17,7 +24,9 @@ static int typed_command;
 
 void add_char(uint8_t c){
     int i;
+    uint32_t flags;
     int tid = get_term_num();
+    terminal_info * cur_info = &info[tid - 1];
     uint8_t * cur_buf = key_buf_1;
     switch(tid){
         case 1:
@@ -32,26 +41,28 @@ void add_char(uint8_t c){
         default:
             break;
     }
+    spin_lock_irqsave(&tty_lock, flags);
     switch(c){
         case ENTER_10:
-            if(info.count == BUF_SIZE){
+            if(cur_info->count == BUF_SIZE){
                 cur_buf[BUF_SIZE-1] = c;
             } 
             else{
-                cur_buf[info.count] = c;
-                info.count++;
+                cur_buf[cur_info->count] = c;
+                cur_info->count++;
             }
-            info.enter_pressed = 1;
+            cur_info->enter_pressed = 1;
+            wake_up_interactive(cur_info);
             putc(c);
             break;
         case BACKSPACE:
-            if(info.count > 0){
-                cur_buf[info.count-1] = 0;
-                info.count--;
+            if(cur_info->count > 0){
+                cur_buf[cur_info->count-1] = 0;
+                cur_info->count--;
                 putc(c);
             }
             else{
-                info.count = 0;
+                cur_info->count = 0;
             }
             break;
         case TAB:
@@ -60,32 +71,32 @@ void add_char(uint8_t c){
                 buffer overflow is handled when enter is pressed (if condition above).
                 So, here the last character of the buffer might be set to nul but when
                 enter is eventually pressed, index 127 will be replaced with '\n'*/
-                if(info.count < BUF_SIZE){
-                    cur_buf[info.count] = 32;
+                if(cur_info->count < BUF_SIZE){
+                    cur_buf[cur_info->count] = 32;
                     putc(0);
-                    info.count++;
+                    cur_info->count++;
                 }
             }
             break;
         default:
-            if(info.count < BUF_SIZE){
+            if(cur_info->count < BUF_SIZE){
             /*add the character to the buffer */
-                cur_buf[info.count] = c;
-                info.count++;
+                cur_buf[cur_info->count] = c;
+                cur_info->count++;
                 putc(c);
             }
             break;
     }
-    // cli();
     memcpy(key_buf, cur_buf, 128);
-    // stid();
+    spin_unlock_irqrestore(&tty_lock, flags);
 }
 
 /* int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
  * DESCRIPTION: copies char_buffer into user buffer. Ensures that more than 128 
                 by are tried to be copied into user buffer. 
  * INPUTS: file descriptor, user buffer (generic pointer type), and number of bytes to be read
- * OUTPUTS: returns the number of bytes read from the key_buf
+ * OUTPUTS: returns the number of bytes read from the key_buf, -1 if the fd's read timeout
+            passed before enter
  * SIDE EFFECTS: resets count, enter flag, and buffer after every read.
  * 
 */
@@ -94,7 +105,9 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes){
         - fill in buffer passed in as argument with one line terminated by enter (from key_buf),
           or how much fits in buffer from one such line. Includes line feed (enter, ascii 10).
          */
-    int tid = get_term_num();
+    /*read the line typed on the caller's terminal, not the displayed one*/
+    int tid = get_current_term() + 1;
+    terminal_info * cur_info = &info[tid - 1];
     uint8_t * cur_buf = key_buf_1;
     switch(tid){
         case 1:
@@ -116,20 +129,39 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes){
 
     /*initialize bytes read to 0*/
     int32_t bytes_read = 0;
+    uint32_t flags;
 
     //printf("\nEnter hasn't been pressed yet : fd = %d, nbytes = %d", fd, nbytes);
     //while(1);
-    /*do not read from terminal until user presses enter*/
-    while(info.enter_pressed != 1){}
-    
     /*user buffer passed as a void pointer, cast as a char (uint8_t) pointer*/
     uint8_t* buffer = (uint8_t*) buf;
     //printf("\nRight before CLI");
-    /*do not allow interrupts, namely keyboard interrupts. 
+    /*hold the tty lock with interrupts off. 
         This is because the following critical section needs to execute 
         without global variable key_buf, enter_pressed, and count being overwritten.
         Keyboard interrupts call add_char, which reads/writes to these global variables. */
-    cli();
+    spin_lock_irqsave(&tty_lock, flags);
+
+    /*do not read from terminal until user presses enter, add_char wakes us up.
+        Interrupts stay off while the lock is dropped to sleep, so the wakeup cannot be lost.
+        With a read timeout on the fd give up once it passes*/
+    uint32_t timeout = fd_read_timeout(fd);
+    uint32_t deadline = get_jiffies() + timeout;
+    while(cur_info->enter_pressed != 1){
+        if(timeout != 0 && time_after_eq(get_jiffies(), deadline)){
+            spin_unlock_irqrestore(&tty_lock, flags);
+            return -1;
+        }
+        spin_unlock(&tty_lock);
+        if(timeout != 0){
+            sleep_on_timeout(cur_info, deadline - get_jiffies());
+        }
+        else{
+            sleep_on(cur_info);
+        }
+        spin_lock(&tty_lock);
+    }
+
     /*loop variable i*/
     int i;
     /*if the number of bytes user wants to read is greater than what is contained in the buffer,
@@ -151,14 +183,13 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes){
     }
 
     /*reset flag, count, and buffer*/
-    info.enter_pressed = 0; 
-    info.count = 0;
+    cur_info->enter_pressed = 0; 
+    cur_info->count = 0;
     for(i = 0; i<BUF_SIZE; i++){
         cur_buf[i] = 0;
     }
-    /*unmask interrupts*/
-    sti();
-    //printf("\nAfter STI");
+    /*back to the caller's interrupt state*/
+    spin_unlock_irqrestore(&tty_lock, flags);
     return bytes_read;
 }
 
@@ -173,7 +204,7 @@ int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes){
     /*-writes data to terminal
         - display all data to screen immediately (printf?)
         - return number of bytes written, or -1 in failure*/
-    cli();
+    uint32_t flags;
     int terminal = get_pcb_pid(get_global_pid()).terminal_idx;
     // printf("Terminal Number: %d\n", terminal);
     /*null pointer is passed, return with failure*/
@@ -197,6 +228,7 @@ int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes){
     }
     
     /*loop through the caller's biffer and write it to the terminal*/
+    spin_lock_irqsave(&tty_lock, flags);
     for(i=0; i < nbytes; i++){
         /*ignore null characters. */
         if(buffer[i]==0){
@@ -208,7 +240,7 @@ int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes){
             bytes_written++;
         }
     }
-    sti();
+    spin_unlock_irqrestore(&tty_lock, flags);
 
     /*return bytes written*/
     return bytes_written; 
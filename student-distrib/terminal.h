@@ -1,6 +1,7 @@
 #ifndef TERMINAL_H
 #define TERMINAL_H
 #include "types.h"
+#include "spinlock.h"
 #include "lib.h"
 #include "multiple_terminals.h"
 #include "pcb.h"
@@ -19,6 +20,9 @@ typedef struct terminal_info{
     //!need to keep track of terminal id
 }terminal_info;
 
+/* Guards the line buffers and the terminal screens */
+extern spinlock_t tty_lock;
+
 
 
 
@@ -3,6 +3,13 @@
 #include "lib.h"
 #include "rtc.h"
 #include "file_system.h"
+#include "scheduling.h"
+#include "softirq.h"
+#include "io_ring.h"
+#include "clock.h"
+#include "timer.h"
+#include "profile.h"
+#include "trace.h"
 #ifndef RUN_TESTS
 #include "terminal.h"
 
@@ -423,7 +430,7 @@ static int rtc_freq_loop(){
 		count = 0;
 
 		/* Write next frequency */
-		rtc_change(freq);
+		rtc_change(0, freq);
 
 		/* Test RTC Read at given freq */
 		while(count < count_offset){
@@ -541,6 +548,543 @@ static int terminal_test(){
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/*
+ * run queue priority test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: queues two unused PIDs for a moment, interrupts off
+ * Coverage: enqueue_task, dequeue_task, pick_next_task
+ */
+static int runqueue_priority_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	int low = MAX_PROCESSES - 1;		// last two slots are free at boot
+	int high = MAX_PROCESSES - 2;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	sched_task_init(low);
+	sched_task_init(high);
+	pcb_array[low].priority = NUM_PRIO - 1;
+	pcb_array[high].priority = 0;
+
+	/* Highest priority wins no matter the queue order */
+	enqueue_task(low);
+	enqueue_task(high);
+	if (pick_next_task() != high) result = FAIL;
+
+	/* Blocked task is skipped */
+	dequeue_task(high);
+	if (pcb_array[high].state != TASK_BLOCKED) result = FAIL;
+	if (get_nr_running() > 0 && pick_next_task() == high) result = FAIL;
+
+	dequeue_task(low);
+	pcb_array[low].state = TASK_UNUSED;
+	pcb_array[high].state = TASK_UNUSED;
+	restore_flags(flags);
+
+	return result;
+}
+
+/*
+ * setpriority test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: queues an unused PID for a moment, interrupts off
+ * Coverage: sched_setpriority, sched_getpriority, sched_set_timeslice
+ */
+static int setpriority_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	int pid = MAX_PROCESSES - 1;		// free at boot
+	uint32_t flags;
+
+	cli_and_save(flags);
+	sched_task_init(pid);
+	pcb_array[pid].priority = NUM_PRIO - 1;
+	enqueue_task(pid);
+
+	/* Raised to the top level it is picked first */
+	if (sched_setpriority(pid, 0) != 0) result = FAIL;
+	if (sched_getpriority(pid) != 0) result = FAIL;
+	if (pick_next_task() != pid) result = FAIL;
+	if (sched_setpriority(pid, NUM_PRIO) != -1) result = FAIL;
+
+	/* 15 ms rounds up to two 10 ms ticks */
+	if (sched_set_timeslice(pid, 15) != 20) result = FAIL;
+	if (sched_set_timeslice(pid, MAX_SLICE_MS + 1) != -1) result = FAIL;
+
+	dequeue_task(pid);
+	pcb_array[pid].state = TASK_UNUSED;
+	restore_flags(flags);
+
+	if (sched_getpriority(pid) != -1) result = FAIL;
+
+	return result;
+}
+
+
+/*
+ * real-time class test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: queues unused PIDs for a moment, interrupts off
+ * Coverage: sched_setscheduler, EDF ordering, class order in pick_next_task
+ */
+static int rt_class_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	int late = MAX_PROCESSES - 1;		// last three slots are free at boot
+	int early = MAX_PROCESSES - 2;
+	int rr = MAX_PROCESSES - 3;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	sched_task_init(late);
+	sched_task_init(early);
+	sched_task_init(rr);
+	if (sched_setscheduler(late, SCHED_EDF, 0) != 0) result = FAIL;
+	if (sched_setscheduler(early, SCHED_EDF, 0) != 0) result = FAIL;
+	if (sched_setscheduler(rr, SCHED_RR, 0) != 0) result = FAIL;
+	if (sched_setscheduler(rr, SCHED_RR, NUM_PRIO) != -1) result = FAIL;
+	pcb_array[late].rt_deadline = get_rtc_ticks() + 100;
+	pcb_array[early].rt_deadline = get_rtc_ticks() + 10;
+
+	/* RR beats every best-effort task, EDF beats RR */
+	enqueue_task(rr);
+	if (pick_next_task() != rr) result = FAIL;
+	enqueue_task(late);
+	enqueue_task(early);
+	if (pick_next_task() != early) result = FAIL;
+
+	dequeue_task(early);
+	if (pick_next_task() != late) result = FAIL;
+	dequeue_task(late);
+	dequeue_task(rr);
+	pcb_array[late].state = TASK_UNUSED;
+	pcb_array[early].state = TASK_UNUSED;
+	pcb_array[rr].state = TASK_UNUSED;
+	restore_flags(flags);
+
+	return result;
+}
+
+/*
+ * real-time throttling test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: queues unused PIDs for a moment, interrupts off, moves
+ *               this CPU's real-time bandwidth period along
+ * Coverage: sched_rt_tick, throttled pick in pick_next_task
+ */
+static int rt_throttle_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	int rr = MAX_PROCESSES - 1;			// last two slots are free at boot
+	int normal = MAX_PROCESSES - 2;
+	int i;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	sched_task_init(rr);
+	sched_task_init(normal);
+	if (sched_setscheduler(rr, SCHED_RR, 0) != 0) result = FAIL;
+	enqueue_task(rr);
+	enqueue_task(normal);
+
+	/* A spinning RR task is throttled within a period or two */
+	for (i = 0; i < 2 * RT_PERIOD_TICKS && pick_next_task() == rr; i++) {
+		sched_rt_tick(rr);
+	}
+	if (pick_next_task() != normal) result = FAIL;
+
+	/* Throttled with nothing else to run, it keeps the CPU */
+	dequeue_task(normal);
+	if (pick_next_task() != rr) result = FAIL;
+	enqueue_task(normal);
+
+	/* The next period gives it the CPU back */
+	for (i = 0; i < RT_PERIOD_TICKS && pick_next_task() == normal; i++) {
+		sched_rt_tick(normal);
+	}
+	if (pick_next_task() != rr) result = FAIL;
+
+	dequeue_task(rr);
+	dequeue_task(normal);
+	pcb_array[rr].state = TASK_UNUSED;
+	pcb_array[normal].state = TASK_UNUSED;
+	restore_flags(flags);
+
+	return result;
+}
+
+/*
+ * interactive boost test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: queues unused PIDs for a moment, interrupts off
+ * Coverage: wake_up_interactive, effective priority in pick_next_task
+ */
+static int interactive_boost_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	int batch = MAX_PROCESSES - 1;		// last two slots are free at boot
+	int typist = MAX_PROCESSES - 2;
+	int chan;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	sched_task_init(batch);
+	sched_task_init(typist);
+	pcb_array[batch].terminal_idx = get_term_num() - 1;		// foreground, one level up
+	pcb_array[typist].terminal_idx = get_term_num() % 3;		// background
+	pcb_array[batch].priority = 2;
+	pcb_array[typist].priority = 2;
+
+	/* Foreground beats background at the same static priority */
+	enqueue_task(batch);
+	pcb_array[typist].wait_chan = &chan;
+	wake_up(&chan);
+	if (pick_next_task() != batch) result = FAIL;
+
+	/* A keyboard wakeup outweighs the foreground boost */
+	dequeue_task(typist);
+	pcb_array[typist].wait_chan = &chan;
+	wake_up_interactive(&chan);
+	if (pcb_array[typist].kbd_boost != 1) result = FAIL;
+	if (pick_next_task() != typist) result = FAIL;
+
+	dequeue_task(typist);
+	dequeue_task(batch);
+	pcb_array[batch].state = TASK_UNUSED;
+	pcb_array[typist].state = TASK_UNUSED;
+	restore_flags(flags);
+
+	return result;
+}
+
+/*
+ * lock stat test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: adds "test" to the lock_stat table
+ * Coverage: spin_trylock, spin_lock_irqsave nesting, ticket_lock, lock_stat_read
+ */
+static int lock_stat_test(){
+
+	TEST_HEADER;
+
+	static spinlock_t lock = SPIN_LOCK_INIT("test");
+	static ticketlock_t ticket = TICKET_LOCK_INIT("test_ticket");
+	uint8_t buf[512];
+	uint32_t outer, inner, before;
+	int32_t len;
+	int result = PASS;
+
+	/* Inner irqsave/irqrestore must not turn interrupts back on */
+	cli_and_save(outer);
+	spin_lock_irqsave(&lock, inner);
+	if (spin_trylock(&lock)) result = FAIL;
+	spin_unlock_irqrestore(&lock, inner);
+	asm volatile ("pushfl; popl %0" : "=r" (before));
+	if (before & 0x200) result = FAIL;		// IF
+	restore_flags(outer);
+
+	ticket_lock(&ticket);
+	ticket_unlock(&ticket);
+	ticket_lock(&ticket);
+	ticket_unlock(&ticket);
+
+	if (lock.stat.acquired != 1 || lock.stat.contended != 0) result = FAIL;
+	if (ticket.stat.acquired != 2 || ticket.owner != ticket.next) result = FAIL;
+
+	len = lock_stat_read(buf, sizeof(buf) - 1);
+	buf[len] = '\0';
+	if (len <= 0 || buf[len - 1] != '\n') result = FAIL;
+
+	return result;
+}
+
+/*
+ * irqsoff test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: adds a tests.c site to the irqsoff table
+ * Coverage: cli_and_save/restore_flags hooks, irqsoff_read
+ */
+static int irqsoff_test(){
+
+	TEST_HEADER;
+
+	uint8_t buf[2048];
+	uint32_t flags;
+	int32_t len;
+	int result = PASS;
+
+	/* Only a real on -> off transition opens a window */
+	if (!(read_eflags() & EFLAGS_IF)) return PASS;
+	cli_and_save(flags);
+	restore_flags(flags);
+
+	len = irqsoff_read(buf, sizeof(buf) - 1);
+	buf[len] = '\0';
+	if (len <= 0 || buf[len - 1] != '\n') result = FAIL;
+	if (strncmp((int8_t*) buf, (int8_t*) "site ", 5) != 0) result = FAIL;
+
+	return result;
+}
+
+static int tasklet_runs = 0;
+
+static void test_tasklet_fn(uint32_t data){
+	tasklet_runs += data;
+}
+
+/*
+ * tasklet test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: drains any bottom halves pending on this CPU
+ * Coverage: tasklet_schedule, do_softirq
+ */
+static int tasklet_test(){
+
+	TEST_HEADER;
+
+	static tasklet_t t = TASKLET_INIT(test_tasklet_fn, 1);
+	uint32_t flags, after;
+	int result = PASS;
+
+	/* Queued once however often it is scheduled before it runs */
+	tasklet_runs = 0;
+	cli_and_save(flags);
+	tasklet_schedule(&t);
+	tasklet_schedule(&t);
+	if (tasklet_runs != 0) result = FAIL;
+	do_softirq();
+	after = read_eflags();
+	restore_flags(flags);
+
+	if (tasklet_runs != 1 || (t.state & TASKLET_SCHED)) result = FAIL;
+	if (after & EFLAGS_IF) result = FAIL;		// do_softirq returns with interrupts off
+
+	return result;
+}
+
+/*
+ * sched stat test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: none
+ * Coverage: sched_stat_read, workqueue_init (workers listed by name)
+ */
+static int sched_stat_test(){
+
+	TEST_HEADER;
+
+	uint8_t buf[2048];
+	int32_t len, i;
+	int found = 0;
+
+	len = sched_stat_read(buf, sizeof(buf) - 1);
+	buf[len] = '\0';
+	if (len <= 0 || buf[len - 1] != '\n') return FAIL;
+	if (strncmp((int8_t*) buf, (int8_t*) "pid ", 4) != 0) return FAIL;
+
+	for (i = 0; i + 9 <= len; i++) {
+		if (strncmp((int8_t*) buf + i, (int8_t*) "kworker/0", 9) == 0) found = 1;
+	}
+
+	return found ? PASS : FAIL;
+}
+
+/*
+ * io ring setup test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: none
+ * Coverage: io_ring_setup (rings outside the program page, bad flags)
+ */
+static int io_ring_setup_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+
+	if (io_ring_setup((io_ring_t*) 0x400000, 0) != -1) result = FAIL;			// kernel page
+	if (io_ring_setup((io_ring_t*) (USER_PAGE_END - 4), 0) != -1) result = FAIL;	// runs past the page
+	if (io_ring_setup((io_ring_t*) USER_PAGE_START, 0x80) != -1) result = FAIL;	// unknown flag
+
+	return result;
+}
+
+/*
+ * clock test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: busy waits 10 ms
+ * Coverage: clock_init calibration, clock_ns, clock_read
+ */
+static int clock_test(){
+
+	TEST_HEADER;
+
+	uint64_t start, elapsed;
+	timespec_t ts;
+
+	if (clock_mult == 0 || tsc_khz == 0) return FAIL;
+
+	/* 10 ms of PIT channel 2 should read as 10 ms, give or take 10% */
+	start = clock_ns();
+	pit_delay_us(10000);
+	elapsed = clock_ns() - start;
+	if (elapsed < 9000000 || elapsed > 11000000) return FAIL;
+
+	if (clock_read(CLOCK_MONOTONIC, &ts) != 0) return FAIL;
+	if (ts.tv_nsec >= NSEC_PER_SEC) return FAIL;
+	if (clock_read(0, &ts) != -1) return FAIL;
+
+	return PASS;
+}
+
+/*
+ * rtc_fd_test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: sleeps for a few RTC ticks
+ * Coverage: per-fd virtual RTC rates, RTC_COALESCE reads, rtc_change,
+ *           rtc_read, rtc_close
+ */
+static int rtc_fd_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	uint32_t start;
+
+	/* fd 3 at 2 Hz must not slow fd 2 down to it */
+	if (rtc_change(2, RTC_MAX) != 0 || rtc_change(3, RTC_MIN) != 0) return FAIL;
+	start = get_rtc_ticks();
+	if (rtc_read(2, NULL, 0) != 0 || rtc_read(2, NULL, 0) != 0) result = FAIL;
+	if (get_rtc_ticks() - start > 3) result = FAIL;
+
+	if (rtc_change(2, 3) != -1 || rtc_change(8, RTC_MIN) != -1) result = FAIL;
+
+	/* Coalesced reads only put the count into the program page */
+	uint32_t ticks = 0;
+	if (rtc_change(2, RTC_MAX | RTC_COALESCE) != 0) result = FAIL;
+	if (rtc_read(2, &ticks, sizeof(ticks)) != -1 || ticks != 0) result = FAIL;
+	if (rtc_read(2, NULL, 0) != -1) result = FAIL;
+
+	if (rtc_close(2) != 0 || rtc_close(3) != 0) result = FAIL;
+
+	return result;
+}
+
+static void timer_test_fn(uint32_t data) {
+}
+
+/*
+ * timer test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: none, the timers are disarmed before they run
+ * Coverage: mod_timer, del_timer, timer_next_event, ms_to_ticks
+ */
+static int timer_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	timer_list_t near = TIMER_INIT(timer_test_fn, 0);
+	timer_list_t far = TIMER_INIT(timer_test_fn, 0);
+
+	/* One tv1 slot and one slot three levels up */
+	mod_timer(&near, get_jiffies() + 3);
+	mod_timer(&far, get_jiffies() + 5000000);
+	if (!timer_pending(&near) || !timer_pending(&far)) result = FAIL;
+	if (timer_next_event(10) > 3) result = FAIL;
+
+	/* Re-arming moves it rather than linking it twice */
+	mod_timer(&near, get_jiffies() + 4);
+	if (del_timer(&near) != 1 || timer_pending(&near)) result = FAIL;
+	if (del_timer(&near) != 0) result = FAIL;
+	if (del_timer(&far) != 1) result = FAIL;
+
+	if (ms_to_ticks(0) != 0 || ms_to_ticks(10) != 1 || ms_to_ticks(15) != 2) result = FAIL;
+
+	return result;
+}
+
+/*
+ * prof_test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: leaves the profiler stopped with empty rings
+ * Coverage: prof_start, prof_tick, prof_read
+ */
+static int prof_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	uint8_t buf[PROF_LINE + PROF_COMM_LEN];
+	prof_frame_t frame = { 0x00400000, KERNEL_CS, 0 };
+
+	if (prof_start(PIT_HZ + 1) != -1) return FAIL;
+	if (prof_start(PIT_HZ) != 0) return FAIL;
+	prof_start(0);
+
+	/* A stopped profiler takes no samples, prof_start emptied the rings */
+	prof_tick(&frame);
+	if (prof_read(buf, sizeof(buf)) != 0) result = FAIL;
+
+	return result;
+}
+
+/*
+ * trace_test
+ * Input: NONE
+ * Output: PASS/FAIL
+ * Side Effects: leaves the tracepoints stopped with empty rings
+ * Coverage: trace_start, trace_record, trace_read
+ */
+static int trace_test(){
+
+	TEST_HEADER;
+
+	int result = PASS;
+	trace_rec_t recs[16];
+	int32_t i, n, halts = 0;
+
+	if (trace_start(1) != 0) return FAIL;
+	trace_event(TRACE_HALT, 7, 0);
+	trace_start(0);
+	trace_event(TRACE_HALT, 8, 0);
+
+	/* Header first, then only the record taken while on (other CPUs' IRQs may add theirs) */
+	n = trace_read((uint8_t*) recs, sizeof(recs)) / sizeof(trace_rec_t);
+	if (n < 2 || recs[0].type != TRACE_HEADER || recs[0].arg0 != tsc_khz) return FAIL;
+	for (i = 1; i < n; i++) {
+		if (recs[i].type == TRACE_HALT) {
+			halts++;
+			if (recs[i].arg0 != 7) result = FAIL;
+		}
+	}
+	if (halts != 1) result = FAIL;
+
+	return result;
+}
 
 /* Test suite entry point */
 void launch_tests(){
@@ -585,6 +1129,24 @@ void launch_tests(){
 	TEST_OUTPUT("terminal_close_test", terminal_close_test());
 	/* Checkpoint 2 tests end */
 
+	/* Checkpoint 5 tests start */
+	TEST_OUTPUT("runqueue_priority_test", runqueue_priority_test());
+	TEST_OUTPUT("setpriority_test", setpriority_test());
+	TEST_OUTPUT("rt_class_test", rt_class_test());
+	TEST_OUTPUT("rt_throttle_test", rt_throttle_test());
+	TEST_OUTPUT("interactive_boost_test", interactive_boost_test());
+	TEST_OUTPUT("lock_stat_test", lock_stat_test());
+	TEST_OUTPUT("irqsoff_test", irqsoff_test());
+	TEST_OUTPUT("tasklet_test", tasklet_test());
+	TEST_OUTPUT("sched_stat_test", sched_stat_test());
+	TEST_OUTPUT("io_ring_setup_test", io_ring_setup_test());
+	TEST_OUTPUT("clock_test", clock_test());
+	TEST_OUTPUT("timer_test", timer_test());
+	TEST_OUTPUT("rtc_fd_test", rtc_fd_test());
+	TEST_OUTPUT("prof_test", prof_test());
+	TEST_OUTPUT("trace_test", trace_test());
+	/* Checkpoint 5 tests end */
+
 	//!Checkpoint 2 tests
 	// TEST_OUTPUT("terminal test", terminal_test());
 	// TEST_OUTPUT("terminal_open_test", terminal_open_test());
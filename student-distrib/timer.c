@@ -0,0 +1,306 @@
+/* timer.c - Timer wheel: arming, disarming and expiring a timer are O(1)
+ * however many are pending, timers are only touched again when their
+ * level of the wheel cascades
+ * vim:ts=4 noexpandtab
+ */
+
+#include "timer.h"
+#include "lib.h"
+#include "clock.h"
+#include "scheduling.h"
+#include "softirq.h"
+#include "spinlock.h"
+
+#define TICK_NS             (NSEC_PER_SEC / PIT_HZ)
+#define MS_PER_TICK         (1000 / PIT_HZ)
+#define TV_LEVELS           4           // levels above tv1
+
+/* Slot of level (0 = first level above tv1) that jiffies j falls into */
+#define TV_INDEX(j, level)  (((j) >> (TVR_BITS + (level) * TVN_BITS)) & TVN_MASK)
+
+/* tv1 holds timers due in the next 256 ticks, one slot per tick. Level n
+ * of tvn holds timers due within 256 * 64^(n+1) ticks, one slot per
+ * 256 * 64^n ticks, moved down a level when tv1 wraps to their slot */
+static timer_list_t* tv1[TVR_SIZE];
+static timer_list_t* tvn[TV_LEVELS][TVN_SIZE];
+
+static uint32_t timer_jiffies = 0;      // next tick the wheel has to run
+static uint32_t timer_now = 0;          // last tick seen by timer_tick
+static uint32_t timers_pending = 0;
+static spinlock_t timer_lock = SPIN_LOCK_INIT("timer");
+
+static void run_timers(int nr);
+
+/*
+ * timer_link
+ *   DESCRIPTION: Pushes a timer on a slot's list
+ *   INPUTS: slot -- list head, timer -- timer to add
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with timer_lock held
+ */
+static void timer_link(timer_list_t** slot, timer_list_t* timer) {
+    timer->next = *slot;
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+/*
+ * timer_unlink
+ *   DESCRIPTION: Takes a timer off whatever list holds it
+ *   INPUTS: timer -- pending timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with timer_lock held, the timer is not pending after
+ */
+static void timer_unlink(timer_list_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/*
+ * internal_add_timer
+ *   DESCRIPTION: Puts a timer in the slot its expiry falls into
+ *   INPUTS: timer -- timer with expires set
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with timer_lock held. Expiries already passed run
+ *                 on the next tick
+ */
+static void internal_add_timer(timer_list_t* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t idx = expires - timer_jiffies;
+    int level;
+
+    if ((int32_t) idx < 0) {
+        timer_link(&tv1[timer_jiffies & TVR_MASK], timer);
+    } else if (idx < TVR_SIZE) {
+        timer_link(&tv1[expires & TVR_MASK], timer);
+    } else {
+        for (level = 0; level < TV_LEVELS - 1; level++) {
+            if (idx < (1U << (TVR_BITS + (level + 1) * TVN_BITS))) {
+                break;
+            }
+        }
+        timer_link(&tvn[level][TV_INDEX(expires, level)], timer);
+    }
+}
+
+/*
+ * cascade
+ *   DESCRIPTION: Redistributes one slot of a level over the levels below
+ *   INPUTS: level -- level of tvn, index -- slot
+ *   OUTPUTS: none
+ *   RETURN VALUE: index, 0 means the next level has to cascade too
+ *   SIDE EFFECTS: call with timer_lock held
+ */
+static int cascade(int level, int index) {
+    timer_list_t* timer = tvn[level][index];
+    timer_list_t* next;
+
+    tvn[level][index] = NULL;
+    while (timer != NULL) {
+        next = timer->next;
+        internal_add_timer(timer);
+        timer = next;
+    }
+    return index;
+}
+
+/*
+ * timer_init
+ *   DESCRIPTION: Installs the softirq that runs expired timers
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_init(void) {
+    open_softirq(TIMER_SOFTIRQ, run_timers);
+}
+
+/*
+ * mod_timer
+ *   DESCRIPTION: Arms a timer to run at a tick
+ *   INPUTS: timer -- timer with func and data set, expires -- jiffies
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: moves the timer if it was pending
+ */
+void mod_timer(timer_list_t* timer, uint32_t expires) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer_pending(timer)) {
+        timer_unlink(timer);
+        timers_pending--;
+    }
+    timer->expires = expires;
+    internal_add_timer(timer);
+    timers_pending++;
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * del_timer
+ *   DESCRIPTION: Disarms a timer
+ *   INPUTS: timer -- any timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it was pending, 0 if it ran or was never armed
+ *   SIDE EFFECTS: none
+ */
+int del_timer(timer_list_t* timer) {
+    uint32_t flags;
+    int was_pending = 0;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer_pending(timer)) {
+        timer_unlink(timer);
+        timers_pending--;
+        was_pending = 1;
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return was_pending;
+}
+
+/*
+ * timer_tick
+ *   DESCRIPTION: A scheduler tick passed. Raises the timer softirq when
+ *                the wheel is behind, an empty wheel just moves along
+ *   INPUTS: jiffies -- ticks so far
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: CPU 0, from the tick accounting
+ */
+void timer_tick(uint32_t jiffies) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    timer_now = jiffies;
+    if (timers_pending == 0) {
+        timer_jiffies = jiffies + 1;
+    } else if (time_after_eq(jiffies, timer_jiffies)) {
+        raise_softirq(TIMER_SOFTIRQ);
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * run_timers
+ *   DESCRIPTION: Timer softirq: walks the wheel up to the current tick,
+ *                cascading at every tv1 wrap, and runs the due timers
+ *   INPUTS: nr -- TIMER_SOFTIRQ
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: runs the callbacks without the lock and with interrupts
+ *                 on, they may re-arm their own timer
+ */
+static void run_timers(int nr) {
+    timer_list_t* list;
+    timer_list_t* timer;
+    void (*func)(uint32_t);
+    uint32_t flags, data;
+    int index, level;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    while (time_after_eq(timer_now, timer_jiffies)) {
+        index = timer_jiffies & TVR_MASK;
+        if (index == 0) {
+            for (level = 0; level < TV_LEVELS; level++) {
+                if (cascade(level, TV_INDEX(timer_jiffies, level)) != 0) {
+                    break;
+                }
+            }
+        }
+        timer_jiffies++;
+
+        /* Detach the slot, timers re-armed for now land in the next one */
+        list = tv1[index];
+        tv1[index] = NULL;
+        if (list != NULL) {
+            list->pprev = &list;
+        }
+        while ((timer = list) != NULL) {
+            timer_unlink(timer);
+            timers_pending--;
+            func = timer->func;
+            data = timer->data;
+
+            spin_unlock_irqrestore(&timer_lock, flags);
+            func(data);
+            spin_lock_irqsave(&timer_lock, flags);
+        }
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_next_event
+ *   DESCRIPTION: How long a tickless CPU 0 may sleep without making a
+ *                timer late: the next non-empty tv1 slot, or the next
+ *                cascade since a timer may move into tv1 there
+ *   INPUTS: max -- longest answer of interest, in ticks
+ *   OUTPUTS: none
+ *   RETURN VALUE: ticks after the last tick, 0 if timers are due now
+ *   SIDE EFFECTS: looks at no more than max + 1 slots
+ */
+uint32_t timer_next_event(uint32_t max) {
+    uint32_t flags, j, ticks = max;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timers_pending != 0) {
+        for (j = timer_jiffies; time_after_eq(timer_now + max, j); j++) {
+            if (tv1[j & TVR_MASK] != NULL || (j & TVR_MASK) == 0) {
+                ticks = time_after_eq(timer_now, j) ? 0 : j - timer_now;
+                break;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return ticks;
+}
+
+/*
+ * ms_to_ticks
+ *   DESCRIPTION: Converts a duration, rounding up so a timeout never ends
+ *                early
+ *   INPUTS: ms -- milliseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: scheduler ticks
+ *   SIDE EFFECTS: none
+ */
+uint32_t ms_to_ticks(uint32_t ms) {
+    return ms / MS_PER_TICK + ((ms % MS_PER_TICK) ? 1 : 0);
+}
+
+/*
+ * sleep_until_ns
+ *   DESCRIPTION: Blocks the caller on a timer until the monotonic clock
+ *                reaches a time. The wheel has tick resolution, a wakeup
+ *                a little early sleeps again for the rest
+ *   INPUTS: target_ns -- clock_ns time to wake at
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: off the run queue while sleeping, no polling
+ */
+void sleep_until_ns(uint64_t target_ns) {
+    uint64_t now, left;
+    uint32_t rem;
+    int8_t chan;
+
+    while ((now = clock_ns()) < target_ns) {
+        left = target_ns - now;
+        rem = div64_32(&left, TICK_NS);
+        if ((left >> 31) != 0) {
+            left = 0x7FFFFFFF;
+        }
+        sleep_on_timeout(&chan, (uint32_t) left + (rem ? 1 : 0));
+    }
+}
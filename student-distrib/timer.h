@@ -0,0 +1,61 @@
+/* timer.h - Kernel timers on a hierarchical timer wheel, run from the
+ * scheduler tick
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+
+/* Wheel geometry: 256 one-tick slots, then four levels of 64 slots each
+ * 64 times coarser, which covers every 32-bit expiry */
+#define TVR_BITS            8
+#define TVN_BITS            6
+#define TVR_SIZE            (1 << TVR_BITS)
+#define TVN_SIZE            (1 << TVN_BITS)
+#define TVR_MASK            (TVR_SIZE - 1)
+#define TVN_MASK            (TVN_SIZE - 1)
+
+/* a is at or after b, for wrapping tick counts */
+#define time_after_eq(a, b) ((int32_t) ((a) - (b)) >= 0)
+
+/* A function to call once jiffies reaches expires. Runs in the timer
+ * softirq: interrupts on, must not sleep. Owned by the wheel while
+ * pending */
+typedef struct timer_list {
+    struct timer_list* next;
+    struct timer_list** pprev;          // link pointing at this timer (NULL = not pending)
+    uint32_t expires;                   // jiffies
+    void (*func)(uint32_t data);
+    uint32_t data;
+} timer_list_t;
+
+#define TIMER_INIT(f, d)    { .next = NULL, .pprev = NULL, .expires = 0, .func = (f), .data = (d) }
+
+/* Installs the timer softirq */
+void timer_init(void);
+
+/* Arms a timer, again if it was pending already */
+void mod_timer(timer_list_t* timer, uint32_t expires);
+
+/* Disarms a timer, returns 1 if it was pending */
+int del_timer(timer_list_t* timer);
+
+static inline int timer_pending(const timer_list_t* timer) {
+    return timer->pprev != NULL;
+}
+
+/* Called for every scheduler tick, raises the softirq if timers are due */
+void timer_tick(uint32_t jiffies);
+
+/* Ticks from now until the wheel next has work, at most max */
+uint32_t timer_next_event(uint32_t max);
+
+/* Milliseconds to ticks, rounded up */
+uint32_t ms_to_ticks(uint32_t ms);
+
+/* Blocks the caller on a timer until clock_ns reaches target_ns */
+void sleep_until_ns(uint64_t target_ns);
+
+#endif /* _TIMER_H */
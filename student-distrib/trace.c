@@ -0,0 +1,290 @@
+/* trace.c - Static tracepoints. A record is written with interrupts off
+ * on its own CPU's ring and the reader is the only one moving the tail,
+ * so neither side takes a lock
+ * vim:ts=4 noexpandtab
+ */
+
+#include "trace.h"
+#include "lib.h"
+#include "clock.h"
+#include "pcb.h"
+#include "serial.h"
+#include "smp.h"
+#include "system_calls.h"
+#include "tsc.h"
+
+#define TRACE_MASK          (TRACE_ENTRIES - 1)
+
+/* Records one CPU wrote and the reader has not moved out yet */
+typedef struct trace_ring {
+    volatile uint32_t head;             // next slot, advanced by the CPU's tracepoints
+    volatile uint32_t tail;             // oldest record, advanced by trace_read
+    uint32_t lost;                      // records dropped to a full ring
+    trace_rec_t recs[TRACE_ENTRIES];
+} trace_ring_t;
+
+volatile uint32_t trace_on = 0;
+
+static uint32_t trace_header = 0;       // next trace_read starts a dump
+static trace_ring_t trace_rings[MAX_CPUS];
+
+/*
+ * trace_start
+ *   DESCRIPTION: Starts or stops the tracepoints. Starting empties the rings
+ *   INPUTS: on -- 1 starts, 0 stops
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 without TRACEPOINTS
+ *   SIDE EFFECTS: records not read yet are gone when starting
+ */
+int32_t trace_start(uint32_t on) {
+#ifdef TRACEPOINTS
+    int cpu;
+
+    /* Off first, the tracepoints stop touching the rings */
+    trace_on = 0;
+    if (on == 0) {
+        return 0;
+    }
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        trace_rings[cpu].head = 0;
+        trace_rings[cpu].tail = 0;
+        trace_rings[cpu].lost = 0;
+    }
+    trace_header = 1;
+    trace_on = 1;
+    return 0;
+#else
+    return (on == 0) ? 0 : -1;
+#endif
+}
+
+/*
+ * trace_record
+ *   DESCRIPTION: Stamps an event with the TSC, CPU and task and appends it
+ *                to this CPU's ring
+ *   INPUTS: type -- TRACE_*, pid -- task, TRACE_CURRENT for the running one,
+ *           arg0, arg1 -- type specific
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: a full ring drops the record and counts it. Interrupts
+ *                 are off meanwhile, an IRQ cannot write the same slot
+ */
+void trace_record(uint32_t type, int32_t pid, uint32_t arg0, uint32_t arg1) {
+#ifdef TRACEPOINTS
+    trace_ring_t* ring;
+    trace_rec_t* rec;
+    uint32_t flags, head;
+    int cpu;
+
+    cli_and_save(flags);
+    cpu = smp_processor_id();
+    ring = &trace_rings[cpu];
+    head = ring->head;
+
+    if (head - ring->tail >= TRACE_ENTRIES) {
+        ring->lost++;
+        restore_flags(flags);
+        return;
+    }
+
+    rec = &ring->recs[head & TRACE_MASK];
+    rec->tsc = rdtsc();
+    rec->type = (uint8_t) type;
+    rec->cpu = (uint8_t) cpu;
+    rec->pid = (int16_t) ((pid == TRACE_CURRENT) ? get_global_pid() : pid);
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+
+    /* Stores stay in order on x86, only the compiler must not move the
+     * record past the head */
+    asm volatile ("" : : : "memory");
+    ring->head = head + 1;
+    restore_flags(flags);
+#endif
+}
+
+/*
+ * trace_syscall_enter
+ *   DESCRIPTION: System call tracepoint, called by syscall_dispatch while
+ *                trace_on is set
+ *   INPUTS: nr -- system call number, arg0 -- its first argument
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void trace_syscall_enter(uint32_t nr, uint32_t arg0) {
+    trace_record(TRACE_SYSCALL_ENTER, TRACE_CURRENT, nr, arg0);
+}
+
+/*
+ * trace_syscall_exit
+ *   DESCRIPTION: System call return tracepoint
+ *   INPUTS: nr -- system call number, ret -- its return value
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void trace_syscall_exit(uint32_t nr, int32_t ret) {
+    trace_record(TRACE_SYSCALL_EXIT, TRACE_CURRENT, nr, (uint32_t) ret);
+}
+
+/*
+ * trace_irq_enter
+ *   DESCRIPTION: Interrupt tracepoint of the IRQ linkages, before the handler
+ *   INPUTS: vector -- IDT vector
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void trace_irq_enter(uint32_t vector) {
+    trace_record(TRACE_IRQ_ENTER, TRACE_CURRENT, vector, 0);
+}
+
+/*
+ * trace_irq_exit
+ *   DESCRIPTION: Interrupt tracepoint of the IRQ linkages, after irq_exit
+ *                ran the bottom halves
+ *   INPUTS: vector -- IDT vector
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void trace_irq_exit(uint32_t vector) {
+    trace_record(TRACE_IRQ_EXIT, TRACE_CURRENT, vector, 0);
+}
+
+/*
+ * trace_page_fault
+ *   DESCRIPTION: Page fault tracepoint, records the faulting address and EIP
+ *   INPUTS: frame -- error code, EIP, CS and EFLAGS the fault pushed
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void trace_page_fault(const uint32_t* frame) {
+    uint32_t cr2;
+
+    asm volatile ("movl %%cr2, %0" : "=r" (cr2));
+    trace_record(TRACE_PAGE_FAULT, TRACE_CURRENT, cr2, frame[1]);
+}
+
+/*
+ * trace_execute
+ *   DESCRIPTION: Names a new task for the host, which has no other way to
+ *                tell which program a PID ran
+ *   INPUTS: pid -- the new task, comm -- its program name
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: only the first 8 bytes of the name fit in a record
+ */
+void trace_execute(int32_t pid, const int8_t* comm) {
+    uint32_t name[2] = { 0, 0 };
+
+    if (!trace_on) {
+        return;
+    }
+    strncpy((int8_t*) name, comm, sizeof(name));
+    trace_record(TRACE_EXECUTE, pid, name[0], name[1]);
+}
+
+/*
+ * trace_put
+ *   DESCRIPTION: Copies a record to the read buffer if it fits
+ *   INPUTS: buf -- destination, written -- bytes in it, nbytes -- its size,
+ *           rec -- record
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if copied, 0 if full
+ *   SIDE EFFECTS: advances written
+ */
+static int trace_put(uint8_t* buf, int32_t* written, int32_t nbytes,
+                     const trace_rec_t* rec) {
+    if (*written + (int32_t) sizeof(trace_rec_t) > nbytes) {
+        return 0;
+    }
+    memcpy(buf + *written, rec, sizeof(trace_rec_t));
+    *written += sizeof(trace_rec_t);
+    return 1;
+}
+
+/*
+ * trace_read
+ *   DESCRIPTION: Moves records out of the rings, oldest first per CPU. A
+ *                dump starts with a TRACE_HEADER record and every CPU that
+ *                dropped records adds a TRACE_LOST one
+ *   INPUTS: buf -- destination, nbytes -- its size
+ *   OUTPUTS: whole trace_rec_t records
+ *   RETURN VALUE: bytes written, 0 once the rings are empty. Records that
+ *                 do not fit stay for the next call
+ *   SIDE EFFECTS: frees ring slots for the tracepoints, the next read after
+ *                 a 0 starts a new dump
+ */
+int32_t trace_read(uint8_t* buf, int32_t nbytes) {
+    trace_rec_t rec;
+    int32_t written = 0;
+    uint32_t tail;
+    int cpu;
+
+    if (trace_header) {
+        rec.tsc = rdtsc();
+        rec.type = TRACE_HEADER;
+        rec.cpu = (uint8_t) smp_processor_id();
+        rec.pid = (int16_t) get_global_pid();
+        rec.arg0 = tsc_khz;
+        rec.arg1 = MAX_PROCESSES;
+        if (!trace_put(buf, &written, nbytes, &rec)) {
+            return 0;
+        }
+        trace_header = 0;
+    }
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        trace_ring_t* ring = &trace_rings[cpu];
+
+        if (ring->lost != 0) {
+            rec.tsc = rdtsc();
+            rec.type = TRACE_LOST;
+            rec.cpu = (uint8_t) cpu;
+            rec.pid = -1;
+            rec.arg0 = ring->lost;
+            rec.arg1 = 0;
+            if (!trace_put(buf, &written, nbytes, &rec)) {
+                return written;
+            }
+            ring->lost = 0;
+        }
+
+        for (tail = ring->tail; tail != ring->head; tail++) {
+            if (!trace_put(buf, &written, nbytes, &ring->recs[tail & TRACE_MASK])) {
+                ring->tail = tail;
+                return written;
+            }
+        }
+        ring->tail = tail;
+    }
+
+    if (written == 0) {
+        trace_header = 1;
+    }
+    return written;
+}
+
+/*
+ * trace_dump_serial
+ *   DESCRIPTION: trace_read until the rings are empty, to COM1
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes sent
+ *   SIDE EFFECTS: busy waits on the UART, records written meanwhile are
+ *                 sent too. Stop tracing first for a dump that ends
+ */
+int32_t trace_dump_serial(void) {
+    uint8_t buf[25 * sizeof(trace_rec_t)];
+    int32_t len, total = 0;
+
+    while ((len = trace_read(buf, sizeof(buf))) > 0) {
+        serial_write(buf, len);
+        total += len;
+    }
+    return total;
+}
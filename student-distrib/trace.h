@@ -0,0 +1,78 @@
+/* trace.h - Static tracepoints: TSC stamped binary records of syscalls,
+ * context switches, IRQs, page faults, execute and halt in per-CPU rings,
+ * trace2json.py turns a dump into Chrome/Perfetto trace JSON on the host
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "types.h"
+
+/* Compile the tracepoints in. Comment out to turn every trace_event into
+ * nothing, the assembly linkages then keep only a test of trace_on */
+#define TRACEPOINTS
+
+#define TRACE_ENTRIES       2048        // records per CPU ring, a power of 2
+
+/* Record types, arg0 / arg1 in the comments */
+#define TRACE_HEADER        0           // tsc_khz / MAX_PROCESSES, first record of a dump
+#define TRACE_LOST          1           // records the CPU dropped to a full ring / 0
+#define TRACE_SYSCALL_ENTER 2           // number / first argument
+#define TRACE_SYSCALL_EXIT  3           // number / return value
+#define TRACE_SWITCH        4           // previous PID / next PID
+#define TRACE_IRQ_ENTER     5           // vector / 0
+#define TRACE_IRQ_EXIT      6           // vector / 0
+#define TRACE_PAGE_FAULT    7           // CR2 / faulting EIP
+#define TRACE_EXECUTE       8           // first 8 bytes of the name, pid is the new program's
+#define TRACE_HALT          9           // status / 0
+
+#define TRACE_CURRENT       -2          // trace_record pid of the running task
+
+/* One event, 20 bytes little endian on the wire */
+typedef struct trace_rec {
+    uint64_t tsc;
+    uint8_t type;
+    uint8_t cpu;
+    int16_t pid;                        // task the CPU was running, -1 before the idle task
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_rec_t;
+
+/* 1 while the tracepoints record. Tested inline by trace_event and the
+ * assembly linkages, so a stopped tracer costs one compare */
+extern volatile uint32_t trace_on;
+
+#ifdef TRACEPOINTS
+#define trace_event(type, arg0, arg1)                           \
+do {                                                            \
+    if (trace_on)                                               \
+        trace_record((type), TRACE_CURRENT, (arg0), (arg1));    \
+} while (0)
+#else
+#define trace_event(type, arg0, arg1) do { } while (0)
+#endif
+
+/* Starts tracing on empty rings (1) or stops it (0) */
+int32_t trace_start(uint32_t on);
+
+/* Appends a record to this CPU's ring */
+void trace_record(uint32_t type, int32_t pid, uint32_t arg0, uint32_t arg1);
+
+/* Hooks of the assembly linkages */
+void trace_syscall_enter(uint32_t nr, uint32_t arg0);
+void trace_syscall_exit(uint32_t nr, int32_t ret);
+void trace_irq_enter(uint32_t vector);
+void trace_irq_exit(uint32_t vector);
+void trace_page_fault(const uint32_t* frame);
+
+/* Program name of a new task, from execute */
+void trace_execute(int32_t pid, const int8_t* comm);
+
+/* Moves whole records out of the rings */
+int32_t trace_read(uint8_t* buf, int32_t nbytes);
+
+/* Moves every record out of the rings to COM1 */
+int32_t trace_dump_serial(void);
+
+#endif /* _TRACE_H */
@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""trace2json.py - Chrome/Perfetto trace JSON from a tracepoint dump
+
+Reads the binary records of `trace serial` (e.g. QEMU -serial
+file:trace.bin) or of the trace_dump system call and writes a JSON trace
+for chrome://tracing or ui.perfetto.dev:
+  - a "CPUs" process with one track per CPU showing which task ran,
+    cut at every context switch,
+  - a "tasks" process with one track per program run (PIDs are reused),
+    where its system calls, the IRQs that arrived on its kernel stack and
+    its page faults nest as they did in the kernel.
+
+Records are trace_rec_t of trace.h: u64 tsc, u8 type, u8 cpu, s16 pid,
+u32 arg0, u32 arg1, little endian. The TRACE_HEADER record gives the TSC
+rate in kHz.
+
+usage: trace2json.py [-o trace.json] trace.bin
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+REC = struct.Struct("<QBBhII")
+
+TRACE_HEADER = 0
+TRACE_LOST = 1
+TRACE_SYSCALL_ENTER = 2
+TRACE_SYSCALL_EXIT = 3
+TRACE_SWITCH = 4
+TRACE_IRQ_ENTER = 5
+TRACE_IRQ_EXIT = 6
+TRACE_PAGE_FAULT = 7
+TRACE_EXECUTE = 8
+TRACE_HALT = 9
+
+# Order of sys_call_table in x86_desc.S
+SYSCALLS = [None, "halt", "execute", "read", "write", "open", "close",
+            "getargs", "vidmap", "set_handler", "sigreturn", "setpriority",
+            "getpriority", "set_timeslice", "set_scheduler", "get_scheduler",
+            "deadline_misses", "lock_stat", "irqsoff_stat", "sched_stat",
+            "io_setup", "io_enter", "clock_gettime", "sleep", "nanosleep",
+            "read_timeout", "prof_ctl", "prof_dump", "trace_ctl", "trace_dump"]
+
+IRQS = {32: "pit", 33: "keyboard", 40: "rtc", 240: "apic timer",
+        241: "resched ipi", 242: "tlb ipi"}
+
+CPUS_PID = 0
+TASKS_PID = 1
+
+
+def signed(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def syscall_name(nr):
+    if 0 < nr < len(SYSCALLS):
+        return SYSCALLS[nr]
+    return "syscall %d" % nr
+
+
+def irq_name(vector):
+    return ("irq %d %s" % (vector, IRQS.get(vector, ""))).rstrip()
+
+
+def read_records(paths):
+    recs = []
+    for path in paths:
+        with open(path, "rb") as f:
+            data = f.read()
+        usable = len(data) - len(data) % REC.size
+        if usable != len(data):
+            print("%s: %d trailing bytes ignored" % (path, len(data) - usable),
+                  file=sys.stderr)
+        recs.extend(REC.iter_unpack(data[:usable]))
+    return recs
+
+
+class Converter:
+    def __init__(self, tsc_khz, max_processes, t0):
+        self.khz = tsc_khz
+        self.max_processes = max_processes
+        self.t0 = t0
+        self.events = []
+        self.tracks = {}        # (pid, cpu for pid < 0) -> tid of its current run
+        self.stacks = {}        # tid -> names of the open slices
+        self.running = {}       # cpu -> (start ts, tid)
+        self.names = {}         # tid -> track name
+        self.next_tid = 1
+
+    def ts(self, tsc):
+        return (tsc - self.t0) * 1000.0 / self.khz
+
+    def name_track(self, tid, name):
+        self.names[tid] = name
+        self.events.append({"ph": "M", "name": "thread_name", "pid": TASKS_PID,
+                            "tid": tid, "args": {"name": name}})
+
+    def new_track(self, key, name):
+        tid = self.next_tid
+        self.next_tid += 1
+        self.tracks[key] = tid
+        self.stacks[tid] = []
+        self.name_track(tid, name)
+        return tid
+
+    def track(self, pid, cpu):
+        key = (pid, cpu) if pid < 0 else (pid, None)
+        if key in self.tracks:
+            return self.tracks[key]
+        if pid < 0:
+            name = "boot cpu %d" % cpu
+        elif pid >= self.max_processes:
+            name = "idle cpu %d" % (pid - self.max_processes)
+        else:
+            name = "pid %d" % pid
+        return self.new_track(key, name)
+
+    def begin(self, tid, ts, name, args=None):
+        self.stacks[tid].append(name)
+        ev = {"ph": "B", "name": name, "pid": TASKS_PID, "tid": tid, "ts": ts}
+        if args:
+            ev["args"] = args
+        self.events.append(ev)
+
+    def end(self, tid, ts, name, args=None):
+        stack = self.stacks[tid]
+        if name not in stack:
+            return      # began before tracing started
+        while stack:
+            top = stack.pop()
+            ev = {"ph": "E", "name": top, "pid": TASKS_PID, "tid": tid, "ts": ts}
+            if top == name and args:
+                ev["args"] = args
+            self.events.append(ev)
+            if top == name:
+                break
+
+    def instant(self, tid, ts, name, args):
+        self.events.append({"ph": "i", "s": "t", "name": name, "pid": TASKS_PID,
+                            "tid": tid, "ts": ts, "args": args})
+
+    def switch_in(self, cpu, ts, tid):
+        prev = self.running.get(cpu)
+        if prev is not None and ts > prev[0]:
+            self.events.append({"ph": "X", "name": self.names[prev[1]],
+                                "pid": CPUS_PID, "tid": cpu, "ts": prev[0],
+                                "dur": ts - prev[0], "args": {"track": prev[1]}})
+        if tid is None:
+            self.running.pop(cpu, None)
+        else:
+            self.running[cpu] = (ts, tid)
+
+    def convert(self, recs):
+        cpus = set()
+        last = 0.0
+        for tsc, typ, cpu, pid, arg0, arg1 in recs:
+            if typ == TRACE_HEADER:
+                continue
+            cpus.add(cpu)
+            if typ == TRACE_LOST:
+                # Stamped when dumped, after everything the CPU kept
+                self.events.append({"ph": "i", "s": "g", "name": "lost %d records" % arg0,
+                                    "pid": CPUS_PID, "tid": cpu, "ts": last})
+                continue
+            ts = self.ts(tsc)
+            last = max(last, ts)
+            if typ == TRACE_EXECUTE:
+                name = struct.pack("<II", arg0, arg1).split(b"\0")[0].decode("ascii", "replace")
+                self.instant(self.track_of_cpu(cpu), ts, "execute",
+                             {"pid": pid, "program": name})
+                self.new_track((pid, None), "%s (pid %d)" % (name, pid))
+                continue
+
+            if cpu not in self.running:
+                self.switch_in(cpu, ts, self.track(pid, cpu))
+            tid = self.track(pid, cpu)
+            if typ == TRACE_SYSCALL_ENTER:
+                self.begin(tid, ts, syscall_name(arg0), {"arg0": arg0})
+            elif typ == TRACE_SYSCALL_EXIT:
+                self.end(tid, ts, syscall_name(arg0), {"ret": signed(arg1)})
+            elif typ == TRACE_IRQ_ENTER:
+                self.begin(tid, ts, irq_name(arg0))
+            elif typ == TRACE_IRQ_EXIT:
+                self.end(tid, ts, irq_name(arg0))
+            elif typ == TRACE_PAGE_FAULT:
+                self.instant(tid, ts, "page fault", {"cr2": "0x%x" % arg0, "eip": "0x%x" % arg1})
+            elif typ == TRACE_HALT:
+                self.instant(tid, ts, "halt", {"status": arg0})
+                for name in reversed(list(self.stacks[tid])):
+                    self.end(tid, ts, name)
+            elif typ == TRACE_SWITCH:
+                self.switch_in(cpu, ts, self.track(signed(arg1), cpu))
+
+        for cpu in list(self.running):
+            self.switch_in(cpu, last, None)
+        for tid, stack in self.stacks.items():
+            for name in reversed(list(stack)):
+                self.end(tid, last, name)
+
+        self.events.append({"ph": "M", "name": "process_name", "pid": CPUS_PID,
+                            "args": {"name": "CPUs"}})
+        self.events.append({"ph": "M", "name": "process_name", "pid": TASKS_PID,
+                            "args": {"name": "tasks"}})
+        for cpu in sorted(cpus):
+            self.events.append({"ph": "M", "name": "thread_name", "pid": CPUS_PID,
+                                "tid": cpu, "args": {"name": "cpu %d" % cpu}})
+        return self.events
+
+    def track_of_cpu(self, cpu):
+        """Track of whatever runs on cpu, for events a task does not own"""
+        running = self.running.get(cpu)
+        return running[1] if running else self.track(-1, cpu)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Chrome trace JSON from a tracepoint dump")
+    parser.add_argument("dumps", nargs="+", help="binary trace records")
+    parser.add_argument("-o", "--output", default="-", help="JSON file (default stdout)")
+    args = parser.parse_args()
+
+    recs = read_records(args.dumps)
+    headers = [r for r in recs if r[1] == TRACE_HEADER]
+    if not headers:
+        sys.exit("no TRACE_HEADER record, not a trace dump")
+    _, _, _, _, tsc_khz, max_processes = headers[0]
+    if tsc_khz == 0:
+        sys.exit("TSC rate unknown")
+
+    recs.sort(key=lambda r: r[0])
+    t0 = min(r[0] for r in recs if r[1] != TRACE_HEADER) if len(recs) > len(headers) else 0
+    events = Converter(tsc_khz, max_processes, t0).convert(recs)
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, out)
+    out.write("\n")
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,17 @@
+/* tsc.h - Time stamp counter access
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _TSC_H
+#define _TSC_H
+
+#include "types.h"
+
+/* CPU cycles since reset. Not serializing, good enough for profiling */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+#endif /* _TSC_H */
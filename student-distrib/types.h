@@ -21,6 +21,10 @@ typedef unsigned short uint16_t;
 typedef char int8_t;
 typedef unsigned char uint8_t;
 
+/* No division or modulo on these, gcc would need libgcc */
+typedef long long int64_t;
+typedef unsigned long long uint64_t;
+
 #endif /* ASM */
 
 #endif /* _TYPES_H */
@@ -0,0 +1,121 @@
+/* vdso.c - Fills and maps the pages programs read the time, their PID
+ * and their terminal from
+ * vim:ts=4 noexpandtab
+ */
+
+#include "vdso.h"
+#include "lib.h"
+#include "pcb.h"
+#include "clock.h"
+#include "tsc.h"
+
+/* The pages, each alone in its 4 kB so the user mapping shows nothing else */
+static union {
+    vdso_data_t data;
+    uint8_t page[4096];
+} vdso_page __attribute__((aligned(4096)));
+
+static union {
+    vdso_task_t task;
+    uint8_t page[4096];
+} vdso_task_pages[NUM_TASKS] __attribute__((aligned(4096)));
+
+/* One page table per task: the time page, then the task's own page */
+static struct pt_entry vdso_page_tables[NUM_TASKS][1024] __attribute__((aligned(4096)));
+
+/*
+ * vdso_pte
+ *   DESCRIPTION: Read-only user mapping of a kernel page
+ *   INPUTS: pte -- entry to fill, page -- kernel address of the page
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void vdso_pte(struct pt_entry* pte, void* page) {
+    pte->present = 1;
+    pte->read_write = 0;
+    pte->user_supervisor = 1;
+    pte->write_through = 0;
+    pte->cache_disabled = 0;
+    pte->accessed = 0;
+    pte->dirty = 0;
+    pte->pt_attribute_index = 0;
+    pte->global_page = 0;
+    pte->available = 0;
+    pte->page_base_address = ((uint32_t) page) >> 12;    // 12: offset bits
+}
+
+/*
+ * vdso_init
+ *   DESCRIPTION: Publishes the clock's scale and builds every task's page
+ *                table
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after clock_init, before the first program starts
+ */
+void vdso_init(void) {
+    int pid;
+
+    vdso_page.data.tsc_mult = clock_mult;
+    vdso_page.data.tsc_shift = CLOCK_SHIFT;
+    vdso_page.data.tick_tsc = rdtsc();
+    vdso_page.data.tick_ns = clock_tsc_to_ns(vdso_page.data.tick_tsc);
+
+    for (pid = 0; pid < NUM_TASKS; pid++) {
+        vdso_pte(&vdso_page_tables[pid][(VDSO_VA >> 12) & 0x3FF], &vdso_page);
+        vdso_pte(&vdso_page_tables[pid][(VDSO_TASK_VA >> 12) & 0x3FF], &vdso_task_pages[pid]);
+    }
+}
+
+/*
+ * vdso_map
+ *   DESCRIPTION: Maps the pages read-only at VDSO_VA in a task's page
+ *                directory and writes its PID and terminal
+ *   INPUTS: pid -- the task, dir -- its page directory
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after init_pcb set the terminal
+ */
+void vdso_map(int pid, struct pd_entry* dir) {
+    struct pd_entry_4kB* pde = &dir[VDSO_VA >> 22].pd_entry_union.kB;   // 22: page directory index
+
+    vdso_task_pages[pid].task.pid = pid;
+    vdso_task_pages[pid].task.terminal = pcb_array[pid].terminal_idx;
+
+    pde->present = 1;
+    pde->read_write = 0;
+    pde->user_supervisor = 1;
+    pde->write_through = 0;
+    pde->cache_disabled = 0;
+    pde->accessed = 0;
+    pde->reserved = 0;
+    pde->page_size = 0;
+    pde->global_page = 0;
+    pde->available = 0;
+    pde->pt_base_address = ((uint32_t) vdso_page_tables[pid]) >> 12;
+}
+
+/*
+ * vdso_tick
+ *   DESCRIPTION: Moves the time page's base to now, so readers only
+ *                convert the cycles since the last tick
+ *   INPUTS: jiffies -- scheduler ticks so far
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: CPU 0 only, with interrupts off. The stores are not
+ *                 reordered on x86, compiler barriers keep them inside seq
+ */
+void vdso_tick(uint32_t jiffies) {
+    vdso_data_t* data = &vdso_page.data;
+    uint64_t now = rdtsc();
+    uint64_t ns = clock_tsc_to_ns(now);
+
+    data->seq++;
+    asm volatile ("" : : : "memory");
+    data->tick_tsc = now;
+    data->tick_ns = ns;
+    data->jiffies = jiffies;
+    asm volatile ("" : : : "memory");
+    data->seq++;
+}
@@ -0,0 +1,43 @@
+/* vdso.h - Read-only pages mapped into every program with the time and
+ * the program's own PID and terminal, read without a system call
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _VDSO_H
+#define _VDSO_H
+
+#include "types.h"
+#include "paging.h"
+
+/* User address of the shared time page, the task page follows it. Must
+ * match ece391support.c */
+#define VDSO_VA             0xF0400000
+#define VDSO_TASK_VA        (VDSO_VA + 0x1000)
+
+/* Time page, one for everybody, in clock_ns time. seq is odd while CPU 0
+ * updates it on a tick, readers retry when it was odd or changed */
+typedef struct vdso_data {
+    volatile uint32_t seq;
+    uint32_t tsc_mult;                  // ns = cycles * tsc_mult >> tsc_shift
+    uint32_t tsc_shift;
+    uint32_t jiffies;                   // scheduler ticks, see pit_handler
+    uint64_t tick_tsc;                  // TSC at the last update
+    uint64_t tick_ns;                   // clock_ns at the last update
+} vdso_data_t;
+
+/* Task page, one per task, written before the program starts */
+typedef struct vdso_task {
+    int32_t pid;
+    int32_t terminal;
+} vdso_task_t;
+
+/* Fills the page tables, before the first program */
+void vdso_init(void);
+
+/* Points a task's page directory at the pages and fills its task page */
+void vdso_map(int pid, struct pd_entry* dir);
+
+/* Publishes the time of a tick, called by pit_handler */
+void vdso_tick(uint32_t jiffies);
+
+#endif /* _VDSO_H */
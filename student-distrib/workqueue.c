@@ -0,0 +1,108 @@
+/* workqueue.c - Shared queue of work items and the kernel threads that
+ * run them
+ * vim:ts=4 noexpandtab
+ */
+
+#include "workqueue.h"
+#include "kthread.h"
+#include "lib.h"
+#include "scheduling.h"
+
+/* FIFO of queued items, the workers sleep on work_head while it is empty */
+static work_t* work_head = NULL;
+static work_t* work_tail = NULL;
+static uint32_t work_done = 0;
+
+/*
+ * worker_thread
+ *   DESCRIPTION: Body of a pool thread, runs queued items one at a time
+ *                with interrupts on
+ *   INPUTS: id -- worker number, unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: an item may queue itself again, any worker then runs it
+ */
+static void worker_thread(uint32_t id) {
+    uint32_t flags;
+    work_t* work;
+
+    while (1) {
+        cli_and_save(flags);
+        while (work_head == NULL) {
+            sleep_on(&work_head);
+        }
+        work = work_head;
+        work_head = work->next;
+        if (work_head == NULL) {
+            work_tail = NULL;
+        }
+        work->next = NULL;
+        work->pending = 0;
+        restore_flags(flags);
+
+        work->func(work->data);
+        work_done++;
+    }
+}
+
+/*
+ * workqueue_init
+ *   DESCRIPTION: Starts the NUM_WORKERS pool threads
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes NUM_WORKERS process slots
+ */
+void workqueue_init(void) {
+    int8_t name[TASK_COMM_LEN];
+    int i;
+
+    for (i = 0; i < NUM_WORKERS; i++) {
+        strcpy(name, (int8_t*) "kworker/");
+        itoa(i, name + strlen(name), 10);
+        if (kthread_create(worker_thread, i, name) < 0) {
+            printf("workqueue: no slot for %s\n", name);
+        }
+    }
+}
+
+/*
+ * queue_work
+ *   DESCRIPTION: Appends a work item to the queue and wakes the pool
+ *   INPUTS: work -- item to run
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if queued, 0 if it was still waiting already
+ *   SIDE EFFECTS: none beyond the run queue
+ */
+int queue_work(work_t* work) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (work->pending) {
+        restore_flags(flags);
+        return 0;
+    }
+    work->pending = 1;
+    work->next = NULL;
+    if (work_tail != NULL) {
+        work_tail->next = work;
+    } else {
+        work_head = work;
+    }
+    work_tail = work;
+    wake_up(&work_head);
+    restore_flags(flags);
+    return 1;
+}
+
+/*
+ * get_work_done
+ *   DESCRIPTION: Work items the pool finished
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: count since boot
+ *   SIDE EFFECTS: none
+ */
+uint32_t get_work_done(void) {
+    return work_done;
+}
@@ -0,0 +1,33 @@
+/* workqueue.h - Work items run by a pool of kernel threads, for jobs
+ * that may sleep or take long (unlike tasklets)
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "types.h"
+
+#define NUM_WORKERS         2           // kworker/0, kworker/1
+
+/* A queued function call. Queued at most once: queueing it again before
+ * a worker took it does nothing */
+typedef struct work {
+    struct work* next;
+    volatile uint32_t pending;
+    void (*func)(uint32_t data);
+    uint32_t data;
+} work_t;
+
+#define WORK_INIT(f, d)     { .next = NULL, .pending = 0, .func = (f), .data = (d) }
+
+/* Starts the worker threads, call once the idle task exists */
+void workqueue_init(void);
+
+/* Hands a work item to the pool, safe from interrupt handlers */
+int queue_work(work_t* work);
+
+/* Items run by the pool since boot */
+uint32_t get_work_done(void);
+
+#endif /* _WORKQUEUE_H */
@@ -17,6 +17,35 @@
 #define KERNEL_TSS  0x0030
 #define KERNEL_LDT  0x0038
 
+/* Processors brought up by smp_init. Each application processor (AP) gets
+ * its own TSS descriptor in the GDT slots after the LDT */
+#define MAX_CPUS        4
+#define AP_TSS_BASE     0x0040
+#define AP_TSS_SEL(cpu) (AP_TSS_BASE + (((cpu) - 1) << 3))
+
+/* Real mode AP startup code is copied here, the SIPI vector is its page */
+#define AP_TRAMPOLINE   0x7000
+
+/* Boot stack, doubles as CPU 0's idle task kernel stack.
+ * Must match KERNEL_STACK_TOP(MAX_PROCESSES) in pcb.h */
+#define BOOT_STACK_TOP  0x7D0000
+
+/* thread_ctx field offsets (pcb.h), used by switch_to */
+#define CTX_ESP         0
+#define CTX_ESP0        4
+#define CTX_CR3         8
+
+/* Offset of esp0 in the TSS */
+#define TSS_ESP0        4
+
+/* 128 MB program page, the only place a SYSENTER caller's stack may be.
+ * Must match USER_STACK_TOP in pcb.h */
+#define USER_PAGE_START 0x8000000
+#define USER_PAGE_END   0x8400000
+
+/* Highest system call number, bound of sys_call_table */
+#define NUM_SYSCALLS    29
+
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
 
@@ -139,6 +168,8 @@ extern uint32_t ex_asm_handler_20, ex_asm_handler_21;
 extern uint32_t ex_asm_handler_28, ex_asm_handler_29, ex_asm_handler_30, ex_asm_handler_32;
 // interrupts for keyboard, RTC
 extern uint32_t ex_asm_handler_33, ex_asm_handler_40;
+// local APIC timer and inter-processor interrupts
+extern uint32_t ex_asm_handler_240, ex_asm_handler_241, ex_asm_handler_242, ex_asm_handler_255;
 
 
 // system call interrupt
@@ -147,6 +178,11 @@ extern uint32_t ex_asm_handler_128;
 extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
+extern seg_desc_t ap_tss_desc_ptr[MAX_CPUS - 1];
+
+/* AP startup code (x86_desc.S), copied to AP_TRAMPOLINE by smp_init */
+extern uint8_t ap_trampoline, ap_trampoline_end;
+extern uint32_t ap_boot_stack;
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
@@ -251,6 +287,14 @@ extern void load_page_directory(void* page_directory_pointer);
 
 extern void flush_tlbs();
 
+/* Kernel context switch, see x86_desc.S */
+struct thread_ctx;
+extern void switch_to(struct thread_ctx* prev, struct thread_ctx* next, tss_t* cpu_tss);
+extern void ret_from_fork(void);
+
+/* SYSENTER target, see sysenter.c */
+extern void sysenter_entry(void);
+
 // function that enables paging by setting flags high
 extern void enable_paging();
 
@@ -0,0 +1,99 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define CHUNK 1024
+#define READS_PER_BATCH 16
+
+static io_ring_t ring;
+static uint8_t bufs[READS_PER_BATCH][CHUNK];
+
+/* Appends an entry to the submission ring */
+static void queue (uint32_t opcode, int32_t fd, void* addr, int32_t len,
+		   uint32_t user_data)
+{
+    io_sqe_t* sqe = &ring.sq[ring.sq_tail % IORING_ENTRIES];
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint32_t)addr;
+    sqe->len = len;
+    sqe->user_data = user_data;
+    ring.sq_tail++;
+}
+
+/* Takes the next completion */
+static io_cqe_t reap ()
+{
+    io_cqe_t cqe = ring.cq[ring.cq_head % IORING_ENTRIES];
+
+    ring.cq_head++;
+    return cqe;
+}
+
+/* iocat -- cat through the shared rings: one io_enter opens the file,
+   then each io_enter reads READS_PER_BATCH chunks and the next one writes
+   them out, so the whole file costs a handful of system calls */
+int main ()
+{
+    uint8_t name[CHUNK];
+    uint8_t num[12];
+    int32_t lens[READS_PER_BATCH];
+    int32_t fd, i, n, done = 0, calls = 0;
+    io_cqe_t cqe;
+
+    if (0 != ece391_getargs (name, CHUNK)) {
+        ece391_fdputs (1, (uint8_t*)"could not read arguments\n");
+	return 3;
+    }
+    if (0 != ece391_io_setup (&ring, 0)) {
+        ece391_fdputs (1, (uint8_t*)"io_setup failed\n");
+	return 3;
+    }
+
+    queue (IORING_OP_OPEN, 0, name, 0, 0);
+    ece391_io_enter (1);
+    calls++;
+    if (-1 == (fd = reap ().res)) {
+        ece391_fdputs (1, (uint8_t*)"file not found\n");
+	return 2;
+    }
+
+    while (!done) {
+	/* Reads run in order, each continues where the last one stopped */
+	for (i = 0; i < READS_PER_BATCH; i++)
+	    queue (IORING_OP_READ, fd, bufs[i], CHUNK, i);
+	ece391_io_enter (READS_PER_BATCH);
+	calls++;
+
+	n = 0;
+	for (i = 0; i < READS_PER_BATCH; i++) {
+	    cqe = reap ();
+	    lens[cqe.user_data] = cqe.res;
+	}
+	for (i = 0; i < READS_PER_BATCH; i++) {
+	    if (lens[i] <= 0) {
+		done = 1;
+		break;
+	    }
+	    queue (IORING_OP_WRITE, 1, bufs[i], lens[i], i);
+	    n++;
+	}
+	if (done) {
+	    queue (IORING_OP_CLOSE, fd, 0, 0, 0);
+	    n++;
+	}
+	ece391_io_enter (n);
+	calls++;
+	for (i = 0; i < n; i++)
+	    reap ();
+    }
+
+    ece391_io_setup (0, 0);
+    ece391_fdputs (1, (uint8_t*)"\nio_enter calls: ");
+    ece391_itoa (calls, num, 10);
+    ece391_fdputs (1, num);
+    ece391_fdputs (1, (uint8_t*)"\n");
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 4096
+
+/* irqsoff -- prints how long each kernel call site kept interrupts off,
+   in CPU cycles, with a histogram per site */
+int main ()
+{
+    uint8_t buf[BUFSIZE + 1];
+    int32_t cnt;
+
+    if (-1 == (cnt = ece391_irqsoff_stat (buf, BUFSIZE))) {
+        ece391_fdputs (1, (uint8_t*)"irqsoff_stat failed\n");
+	return 2;
+    }
+    buf[cnt] = '\0';
+
+    ece391_fdputs (1, buf);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+
+/* lockstat -- prints how contended each kernel lock has been since boot */
+int main ()
+{
+    uint8_t buf[BUFSIZE + 1];
+    int32_t cnt;
+
+    if (-1 == (cnt = ece391_lock_stat (buf, BUFSIZE))) {
+        ece391_fdputs (1, (uint8_t*)"lock_stat failed\n");
+	return 2;
+    }
+    buf[cnt] = '\0';
+
+    ece391_fdputs (1, (uint8_t*)"lock acquired contended spin(Kcycles)\n");
+    ece391_fdputs (1, buf);
+    return 0;
+}
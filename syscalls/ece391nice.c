@@ -0,0 +1,42 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+
+/* nice <priority> <command> -- runs command at priority 0 (highest) to 7 */
+int main ()
+{
+    int32_t prio, ret;
+    uint8_t buf[BUFSIZE];
+    uint8_t* cmd;
+
+    if (0 != ece391_getargs (buf, BUFSIZE)) {
+        ece391_fdputs (1, (uint8_t*)"usage: nice <priority> <command>\n");
+	return 3;
+    }
+
+    prio = 0;
+    for (cmd = buf; *cmd >= '0' && *cmd <= '9'; cmd++)
+        prio = prio * 10 + (*cmd - '0');
+    while (*cmd == ' ')
+        cmd++;
+    if (cmd == buf || *cmd == '\0') {
+        ece391_fdputs (1, (uint8_t*)"usage: nice <priority> <command>\n");
+	return 3;
+    }
+
+    /* The command inherits the priority when it is executed */
+    if (-1 == ece391_setpriority (-1, prio)) {
+        ece391_fdputs (1, (uint8_t*)"bad priority\n");
+	return 2;
+    }
+
+    if (-1 == (ret = ece391_execute (cmd))) {
+        ece391_fdputs (1, (uint8_t*)"no such command\n");
+	return 2;
+    }
+
+    return ret;
+}
@@ -38,6 +38,9 @@ int main ()
     ret_val = 32;
     ret_val = ece391_write(rtc_fd, &ret_val, 4);
 
+    // Redraw on every tick even with busy programs around
+    ece391_set_scheduler(-1, SCHED_RR, 0);
+
     while(1)
     {
 	// Move out
@@ -0,0 +1,58 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define DEFAULT_HZ 100
+
+static void usage ()
+{
+    ece391_fdputs (1, (uint8_t*)"usage: prof start [hz] | stop | dump | serial\n");
+}
+
+/* prof -- controls the sampling profiler. "dump" prints the samples,
+   "serial" sends them to COM1; profsym.py turns either into a profile */
+int main ()
+{
+    uint8_t buf[BUFSIZE + 1];
+    uint8_t* arg;
+    int32_t cnt, hz;
+
+    if (0 != ece391_getargs (buf, BUFSIZE)) {
+        usage ();
+	return 3;
+    }
+
+    for (arg = buf; *arg != '\0' && *arg != ' '; arg++)
+        ;
+    if (*arg == ' ')
+        *arg++ = '\0';
+    while (*arg == ' ')
+        arg++;
+
+    if (0 == ece391_strcmp (buf, (uint8_t*)"start")) {
+        hz = 0;
+        for (; *arg >= '0' && *arg <= '9'; arg++)
+            hz = hz * 10 + (*arg - '0');
+        if (hz == 0)
+            hz = DEFAULT_HZ;
+        if (-1 == ece391_prof_ctl (hz)) {
+            ece391_fdputs (1, (uint8_t*)"bad rate or no profiler\n");
+	    return 2;
+        }
+    } else if (0 == ece391_strcmp (buf, (uint8_t*)"stop")) {
+        ece391_prof_ctl (0);
+    } else if (0 == ece391_strcmp (buf, (uint8_t*)"dump")) {
+        while (0 < (cnt = ece391_prof_dump (buf, BUFSIZE))) {
+            buf[cnt] = '\0';
+            ece391_fdputs (1, buf);
+        }
+    } else if (0 == ece391_strcmp (buf, (uint8_t*)"serial")) {
+        ece391_prof_dump (0, 0);
+    } else {
+        usage ();
+	return 3;
+    }
+    return 0;
+}
@@ -102,3 +102,72 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/*
+ * Time and PID without a system call: the kernel maps two read-only
+ * pages at VDSO_VA into every program (student-distrib/vdso.h). The time
+ * page is rewritten on every scheduler tick, seq is odd meanwhile.
+ */
+#define VDSO_VA      0xF0400000
+#define VDSO_TASK_VA (VDSO_VA + 0x1000)
+
+typedef struct vdso_data {
+    volatile uint32_t seq;
+    uint32_t tsc_mult;
+    uint32_t tsc_shift;
+    uint32_t jiffies;
+    uint64_t tick_tsc;
+    uint64_t tick_ns;
+} vdso_data_t;
+
+typedef struct vdso_task {
+    int32_t pid;
+    int32_t terminal;
+} vdso_task_t;
+
+#define vdso_data ((const vdso_data_t*)VDSO_VA)
+#define vdso_task ((const vdso_task_t*)VDSO_TASK_VA)
+
+/* Nanoseconds since boot */
+uint64_t ece391_vdso_ns(void)
+{
+    uint32_t seq, lo, hi, mult, shift;
+    uint64_t tsc, base_tsc, base_ns, delta;
+
+    /* Seqlock read: retry if the kernel was updating the page */
+    do {
+        while ((seq = vdso_data->seq) & 1)
+            asm volatile ("pause" : : : "memory");
+        asm volatile ("" : : : "memory");
+        asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+        mult = vdso_data->tsc_mult;
+        shift = vdso_data->tsc_shift;
+        base_tsc = vdso_data->tick_tsc;
+        base_ns = vdso_data->tick_ns;
+        asm volatile ("" : : : "memory");
+    } while (vdso_data->seq != seq);
+
+    /* Another CPU's TSC may be slightly behind the one that ticked */
+    tsc = ((uint64_t)hi << 32) | lo;
+    delta = (tsc > base_tsc) ? tsc - base_tsc : 0;
+
+    return base_ns + (((uint64_t)(uint32_t)delta * mult) >> shift)
+                   + (((uint64_t)(uint32_t)(delta >> 32) * mult) << (32 - shift));
+}
+
+/* Scheduler ticks since boot, 100 per second */
+uint32_t ece391_vdso_jiffies(void)
+{
+    return vdso_data->jiffies;
+}
+
+int32_t ece391_vdso_getpid(void)
+{
+    return vdso_task->pid;
+}
+
+/* Terminal the program runs on, 0 - 2 */
+int32_t ece391_vdso_terminal(void)
+{
+    return vdso_task->terminal;
+}
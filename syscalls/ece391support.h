@@ -9,5 +9,11 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/* Read from the kernel's vdso pages, no system call */
+extern uint64_t ece391_vdso_ns(void);
+extern uint32_t ece391_vdso_jiffies(void);
+extern int32_t ece391_vdso_getpid(void);
+extern int32_t ece391_vdso_terminal(void);
+
 #endif /* ECE391SUPPORT_H */
 
@@ -0,0 +1,69 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define CALLS 10000
+
+/* Low 32 bits of the time stamp counter */
+static uint32_t rdtsc32 ()
+{
+    uint32_t lo, hi;
+
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+/* Cycles per getpriority call with the current entry method */
+static uint32_t time_calls ()
+{
+    uint32_t start;
+    int32_t i;
+
+    ece391_getpriority (-1);
+    start = rdtsc32 ();
+    for (i = 0; i < CALLS; i++)
+        ece391_getpriority (-1);
+    return (rdtsc32 () - start) / CALLS;
+}
+
+/* Cycles per clock read from the vdso page, for comparison */
+static uint32_t time_vdso ()
+{
+    uint32_t start;
+    int32_t i;
+
+    ece391_vdso_ns ();
+    start = rdtsc32 ();
+    for (i = 0; i < CALLS; i++)
+        ece391_vdso_ns ();
+    return (rdtsc32 () - start) / CALLS;
+}
+
+static void report (const uint8_t* name, uint32_t cycles)
+{
+    uint8_t buf[12];
+
+    ece391_fdputs (1, name);
+    ece391_itoa (cycles, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" cycles per call\n");
+}
+
+/* sysbench -- compares the cost of a short system call through SYSENTER
+   and through INT $0x80, and of reading the clock from the vdso page */
+int main ()
+{
+    uint32_t fast;
+
+    fast = time_calls ();
+    if (ece391_sysenter > 0)
+        report ((uint8_t*)"sysenter: ", fast);
+    else
+        ece391_fdputs (1, (uint8_t*)"sysenter: not supported\n");
+
+    ece391_sysenter = 0;
+    report ((uint8_t*)"int 0x80: ", time_calls ());
+    report ((uint8_t*)"vdso clock: ", time_vdso ());
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+
+static void usage ()
+{
+    ece391_fdputs (1, (uint8_t*)"usage: trace start | stop | serial\n");
+}
+
+/* trace -- controls the tracepoints. "serial" stops tracing and sends
+   the records to COM1; trace2json.py turns them into a timeline */
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+
+    if (0 != ece391_getargs (buf, BUFSIZE)) {
+        usage ();
+	return 3;
+    }
+
+    if (0 == ece391_strcmp (buf, (uint8_t*)"start")) {
+        if (-1 == ece391_trace_ctl (1)) {
+            ece391_fdputs (1, (uint8_t*)"no tracepoints in this kernel\n");
+	    return 2;
+        }
+    } else if (0 == ece391_strcmp (buf, (uint8_t*)"stop")) {
+        ece391_trace_ctl (0);
+    } else if (0 == ece391_strcmp (buf, (uint8_t*)"serial")) {
+        ece391_trace_ctl (0);
+        ece391_trace_dump (0, 0);
+    } else {
+        usage ();
+	return 3;
+    }
+    return 0;
+}